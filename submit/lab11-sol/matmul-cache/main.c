@@ -31,14 +31,23 @@ out_matrix(int n, long a[][n])
 
 enum { MAX_TEST_MATRIX_SIZE = 6 };
 
+//a tracing build also takes the file to which the trace is written
+#ifdef MATMUL_TRACE
+  #define TRACE_ARG " TRACE_FILE"
+  enum { N_ARGS = 4 };
+#else
+  #define TRACE_ARG ""
+  enum { N_ARGS = 3 };
+#endif
+
 int
 main(int argc, const char *argv[])
 {
   int matrixSize = -1;
   int numTests = -1;
-  if (argc != 3 || (matrixSize = atoi(argv[1])) <= 0 ||
+  if (argc != N_ARGS || (matrixSize = atoi(argv[1])) <= 0 ||
       (numTests = atoi(argv[2])) <= 0) {
-    fprintf(stderr, "usage: %s MATRIX_SIZE N_TRIALS\n", argv[0]);
+    fprintf(stderr, "usage: %s MATRIX_SIZE N_TRIALS" TRACE_ARG "\n", argv[0]);
     exit(1);
   }
   int n = matrixSize;
@@ -50,9 +59,15 @@ main(int argc, const char *argv[])
     exit(1);
   }
   initMatrix(n, a); initMatrix(n, b);
+#ifdef MATMUL_TRACE
+  matmul_trace_open(argv[3]);
+#endif
   for (int t = 0; t < numTests; t++) {
     matrix_multiply(n, a, b, c);
   }
+#ifdef MATMUL_TRACE
+  matmul_trace_close();
+#endif
   if (matrixSize <= MAX_TEST_MATRIX_SIZE) out_matrix(n, c);
   free(a); free(b); free(c);
   return 0;
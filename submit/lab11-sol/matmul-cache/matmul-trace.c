@@ -0,0 +1,41 @@
+#include "matmul-trace.h"
+
+#include "trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *trace_path;
+static FILE *trace_file;
+static TraceWriter *trace_writer;
+
+void
+matmul_trace_open(const char *path)
+{
+  if (!(trace_file = fopen(path, "w"))) {
+    fprintf(stderr, "cannot create trace %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+  trace_path = path;
+  trace_writer = new_trace_writer(trace_file, N_ADDR_BITS);
+}
+
+void
+matmul_trace_access(const void *p, bool is_write)
+{
+  trace_write(trace_writer, (MemAddr)p, is_write);
+}
+
+void
+matmul_trace_close(void)
+{
+  bool is_ok = free_trace_writer(trace_writer);
+  if (fclose(trace_file) != 0) is_ok = false;
+  if (!is_ok) {
+    fprintf(stderr, "cannot write trace %s: %s\n", trace_path,
+            strerror(errno));
+    exit(1);
+  }
+}
@@ -0,0 +1,17 @@
+#ifndef _MATMUL_TRACE_H
+#define _MATMUL_TRACE_H
+
+#include <stdbool.h>
+
+/** Start writing a binary address trace (see prj5-sol/trace.h) of
+ *  matrix accesses to file path.  Exits on error.
+ */
+void matmul_trace_open(const char *path);
+
+/** Append an access to p to the trace */
+void matmul_trace_access(const void *p, bool is_write);
+
+/** Finish the trace.  Exits on error. */
+void matmul_trace_close(void);
+
+#endif //#ifndef _MATMUL_TRACE_H
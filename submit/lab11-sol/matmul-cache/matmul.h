@@ -2,4 +2,18 @@
 #define _MATMUL_H
 
 void matrix_multiply(int n, long a[][n], long b[][n], long c[][n]);
+
+/** Matrix element accesses in matrix_multiply() are wrapped in LOAD()
+ *  or STORE() so that a tracing build (-D MATMUL_TRACE) records their
+ *  addresses; otherwise they expand to the plain element.
+ */
+#ifdef MATMUL_TRACE
+  #include "matmul-trace.h"
+  #define LOAD(elem)  (matmul_trace_access(&(elem), false), (elem))
+  #define STORE(elem) (*(matmul_trace_access(&(elem), true), &(elem)))
+#else
+  #define LOAD(elem)  (elem)
+  #define STORE(elem) (elem)
+#endif
+
 #endif //#ifndef _MATMUL_H
@@ -0,0 +1,158 @@
+//replay matmul address traces through prj5-sol's cache simulator
+
+#include "cache-sim.h"
+#include "replacement.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum { MAX_CONFIGS = 16 };
+enum { BATCH_SIZE = 4096 };
+
+//m-s-b-E configs used when none are specified: 32K direct-mapped,
+//32K 8-way, 256K 8-way and 2M 16-way, all with 64-byte blocks
+static const char *DEFAULT_CONFIGS[] = {
+  "48-9-6-1", "48-6-6-8", "48-9-6-8", "48-11-6-16",
+};
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s [-r REPLACEMENT] [-c m-s-b-E]... "
+          "TRACE...\n"
+          "prints the # of misses, and the miss rate, of each binary TRACE\n"
+          "written by a tracing matmul build for each cache -c m-s-b-E\n"
+          "(default", msg, program);
+  for (int i = 0; i < sizeof(DEFAULT_CONFIGS)/sizeof(DEFAULT_CONFIGS[0]);
+       i++) {
+    fprintf(stderr, " %s", DEFAULT_CONFIGS[i]);
+  }
+  fprintf(stderr, ") with REPLACEMENT lru (default)");
+  for (int r = LRU_R + 1; r < N_REPLACEMENTS; r++) {
+    fprintf(stderr, "|%s", get_replacement_policy(r)->name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+/** Parse m-s-b-E spec into *params.  Returns false on error. */
+static bool
+parse_config(const char *spec, Replacement replacement, CacheParams *params)
+{
+  unsigned m, s, b, e;
+  char c;
+  if (sscanf(spec, "%u-%u-%u-%u%c", &m, &s, &b, &e, &c) != 4) return false;
+  *params = (CacheParams) {
+    .n_mem_addr_bits = m, .n_set_index_bits = s,
+    .n_blk_offset_bits = b, .n_lines_per_set = e,
+    .replacement = replacement,
+  };
+  return true;
+}
+
+/** Return the # of misses of a new cache with *params on the n
+ *  accesses in addrs[] and is_writes[], -1 if there is no such cache.
+ */
+static long
+count_misses(const CacheParams *params, size_t n, MemAddr addrs[],
+             const bool is_writes[])
+{
+  static CacheResult results[BATCH_SIZE];
+  CacheSim *cache = new_cache_sim(params);
+  if (!cache) return -1;
+  if (params->replacement == OPT_R) cache_sim_set_future(cache, n, addrs);
+  long n_misses = 0;
+  for (size_t i = 0; i < n; i += BATCH_SIZE) {
+    size_t n_batch = (n - i < BATCH_SIZE) ? n - i : BATCH_SIZE;
+    cache_sim_results(cache, n_batch, &addrs[i], &is_writes[i], results);
+    for (size_t j = 0; j < n_batch; j++) {
+      n_misses += results[j].status != CACHE_HIT;
+    }
+  }
+  free_cache_sim(cache);
+  return n_misses;
+}
+
+/** Return the kernel name of trace path: its basename without any
+ *  extension.  Returned string is static.
+ */
+static const char *
+kernel_name(const char *path)
+{
+  static char name[64];
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  snprintf(name, sizeof(name), "%s", base);
+  char *dot = strrchr(name, '.');
+  if (dot && dot != name) *dot = '\0';
+  return name;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  Replacement replacement = LRU_R;
+  const char *specs[MAX_CONFIGS];
+  int n_configs = 0;
+  int i;
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "-c") == 0) {
+      if (n_configs == MAX_CONFIGS) usage(program, "too many configs\n");
+      specs[n_configs++] = argv[++i];
+    }
+    else if (i + 1 < argc && strcmp(argv[i], "-r") == 0) {
+      int r = parse_replacement(argv[++i]);
+      if (r < 0) usage(program, "bad REPLACEMENT\n");
+      replacement = r;
+    }
+    else {
+      usage(program, "");
+    }
+  }
+  if (i == argc) usage(program, "no TRACE\n");
+  if (n_configs == 0) {
+    n_configs = sizeof(DEFAULT_CONFIGS)/sizeof(DEFAULT_CONFIGS[0]);
+    memcpy(specs, DEFAULT_CONFIGS, sizeof(DEFAULT_CONFIGS));
+  }
+  CacheParams configs[MAX_CONFIGS];
+  for (int c = 0; c < n_configs; c++) {
+    if (!parse_config(specs[c], replacement, &configs[c])) {
+      fprintf(stderr, "bad m-s-b-E %s\n", specs[c]);
+      exit(1);
+    }
+  }
+
+  printf("%-20s %12s", "# kernel", "accesses");
+  for (int c = 0; c < n_configs; c++) printf(" %20s", specs[c]);
+  printf("\n");
+  for (; i < argc; i++) {
+    TraceReader *reader = open_binary_trace(argv[i]);
+    if (!reader) {
+      fprintf(stderr, "cannot read trace %s: %s\n", argv[i],
+              strerror(errno));
+      exit(1);
+    }
+    MemAddr *addrs;
+    bool *is_writes;
+    size_t n = trace_read_all(reader, &addrs, &is_writes);
+    close_trace(reader);
+    printf("%-20s %12zu", kernel_name(argv[i]), n);
+    for (int c = 0; c < n_configs; c++) {
+      long n_misses = count_misses(&configs[c], n, addrs, is_writes);
+      if (n_misses < 0) {
+        printf(" %20s", "-");
+      }
+      else {
+        printf(" %11ld (%5.2f%%)", n_misses, n ? 100.0*n_misses/n : 0.0);
+      }
+    }
+    printf("\n");
+    free(addrs);
+    free(is_writes);
+  }
+  return 0;
+}
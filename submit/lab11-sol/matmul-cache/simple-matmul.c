@@ -5,9 +5,9 @@ matrix_multiply(int n, long a[][n], long b[][n], long c[][n])
 {
   for (int i = 0; i < n; i++) {
     for (int j = 0; j < n; j++) {
-      c[i][j] = 0;
+      STORE(c[i][j]) = 0;
       for (int k = 0; k < n; k++) {
-	c[i][j] += a[i][k]*b[k][j];
+	STORE(c[i][j]) = LOAD(c[i][j]) + LOAD(a[i][k])*LOAD(b[k][j]);
       }
     }
   }
@@ -13,7 +13,7 @@ matrix_transpose(int n, long a[][n], long t[][n])
 {
   for (int i = 0; i < n; i++) {
     for (int j = 0; j < n; j++) {
-      t[i][j] = a[j][i];
+      STORE(t[i][j]) = LOAD(a[j][i]);
     }
   }
 }
@@ -31,9 +31,9 @@ matrix_multiply(int n, long a[][n], long b[][n], long c[][n])
   matrix_transpose(n, b, tmp);
   for (int i = 0; i < n; i++) {
     for (int j = 0; j < n; j++) {
-      c[i][j] = 0;
+      STORE(c[i][j]) = 0;
       for (int k = 0; k < n; k++) {
-        c[i][j] += a[i][k]*tmp[j][k];
+        STORE(c[i][j]) = LOAD(c[i][j]) + LOAD(a[i][k])*LOAD(tmp[j][k]);
       }
     }
   }
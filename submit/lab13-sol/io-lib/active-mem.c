@@ -113,6 +113,8 @@ typedef struct {
   const void *addr;
   size_t op_size;      //# of bytes in instruction
   size_t operand_size; //# of bytes in each operand
+  size_t mem_size;     //# of bytes of memory operand
+  bool is_sign_extend; //true for movsx and movsxd
   OpType op_type;
   int reg_n;           //source or dest reg_n; suitable to index mcontext.gregs[]
   MemVal immed;        //source immed
@@ -140,6 +142,9 @@ static OpInfo x86_op_info(const char *addr)
     ? REG_TO_MEM_OP
     : MEM_TO_REG_OP;
   op_info.op_type = op_type;
+  op_info.mem_size = operands[op_type == MEM_TO_REG_OP ? 1 : 0].size / 8;
+  op_info.is_sign_extend = instr.mnemonic == ZYDIS_MNEMONIC_MOVSX ||
+    instr.mnemonic == ZYDIS_MNEMONIC_MOVSXD;
   if (op_type == IMM_TO_MEM_OP) {
     op_info.immed = operands[1].imm.value.u;
   }
@@ -155,6 +160,8 @@ typedef struct {
   void *ctx;           //client's ctx
   MemReadFn *read_fn;  //function to be called on intercepted read
   MemWriteFn *write_fn;//function to be called on intercepted write
+  MemSizedReadFn *sized_read_fn;   //if non-NULL, called instead of read_fn
+  MemSizedWriteFn *sized_write_fn; //if non-NULL, called instead of write_fn
   void *lo_addr;       //lo address (inclusive) of allocated memory
   void *hi_addr;       //hi address (exclusive) of allocated memory
 } ActiveMemInfo;
@@ -164,6 +171,33 @@ typedef struct {
 // store ActiveMemInfo in previous page with some magic #.
 static ActiveMemInfo mem_info;
 
+/** return the value read from addr by the instruction described by
+ *  op_info.
+ */
+static MemVal read_mem(const void *addr, const OpInfo *op_info)
+{
+  if (!mem_info.sized_read_fn) return mem_info.read_fn(mem_info.ctx, addr);
+  MemVal val = mem_info.sized_read_fn(mem_info.ctx, addr, op_info->mem_size);
+  if (op_info->is_sign_extend && op_info->mem_size < sizeof(MemVal)) {
+    unsigned shift = 8*(sizeof(MemVal) - op_info->mem_size);
+    val = (MemVal)((long long)(val << shift) >> shift);
+    //writes to 32-bit registers clear the upper half
+    if (op_info->operand_size == 32) val &= 0xffffffffULL;
+  }
+  return val;
+}
+
+/** write val to addr for the instruction described by op_info */
+static void write_mem(const void *addr, const OpInfo *op_info, MemVal val)
+{
+  if (mem_info.sized_write_fn) {
+    mem_info.sized_write_fn(mem_info.ctx, addr, op_info->mem_size, val);
+  }
+  else {
+    mem_info.write_fn(mem_info.ctx, addr, val);
+  }
+}
+
 
 static void segv_handler(int sig_n, siginfo_t *info, void *uctx)
 {
@@ -183,14 +217,13 @@ static void segv_handler(int sig_n, siginfo_t *info, void *uctx)
 
   switch (op_info.op_type) {
    case MEM_TO_REG_OP:
-     mctx->gregs[op_info.reg_n] = mem_info.read_fn(mem_info.ctx, access_addr);
+     mctx->gregs[op_info.reg_n] = read_mem(access_addr, &op_info);
      break;
    case REG_TO_MEM_OP:
-     mem_info.write_fn(mem_info.ctx, access_addr,
-                       mctx->gregs[op_info.reg_n]);
+     write_mem(access_addr, &op_info, mctx->gregs[op_info.reg_n]);
      break;
    case IMM_TO_MEM_OP:
-     mem_info.write_fn(mem_info.ctx, access_addr, op_info.immed);
+     write_mem(access_addr, &op_info, op_info.immed);
      break;
    default:
      assert(0 && "unexpected opcode");
@@ -200,12 +233,10 @@ static void segv_handler(int sig_n, siginfo_t *info, void *uctx)
 }
 
 
-/** allocate n_bytes of active memory with read attempts resulting in
- *  calls to read_fn and write attempts resulting in calls to write_fn.
- *  Returns NULL on failure.
+/** map n_bytes of active memory described by info, whose lo_addr and
+ *  hi_addr are set to the mapping.  Returns NULL on failure.
  */
-void *active_mem_calloc(size_t n_bytes, void *ctx,
-                        MemReadFn *read_fn,  MemWriteFn *write_fn)
+static void *map_active_mem(size_t n_bytes, ActiveMemInfo info)
 {
   long pagesize = sysconf(_SC_PAGESIZE);
   if (pagesize < 0) return NULL;
@@ -215,11 +246,22 @@ void *active_mem_calloc(size_t n_bytes, void *ctx,
 
   void *mem = mmap(NULL, n_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
   if (mem == (void *)-1) return NULL;
-  mem_info = (ActiveMemInfo){
-    .ctx = ctx, .read_fn = read_fn, .write_fn = write_fn,
-    .lo_addr = mem, .hi_addr = mem + n_bytes,
-  };
+  info.lo_addr = mem;
+  info.hi_addr = mem + n_bytes;
+  mem_info = info;
   return mem;
+}
+
+/** allocate n_bytes of active memory with read attempts resulting in
+ *  calls to read_fn and write attempts resulting in calls to write_fn.
+ *  Returns NULL on failure.
+ */
+void *active_mem_calloc(size_t n_bytes, void *ctx,
+                        MemReadFn *read_fn,  MemWriteFn *write_fn)
+{
+  return map_active_mem(n_bytes, (ActiveMemInfo){
+      .ctx = ctx, .read_fn = read_fn, .write_fn = write_fn,
+    });
 
   /* if (!mem) return NULL; */
   /* if (posix_memalign(&mem, pagesize, n_bytes) != 0) return NULL; */
@@ -228,6 +270,15 @@ void *active_mem_calloc(size_t n_bytes, void *ctx,
   /* return mem; */
 }
 
+void *active_mem_calloc_sized(size_t n_bytes, void *ctx,
+                              MemSizedReadFn *read_fn,
+                              MemSizedWriteFn *write_fn)
+{
+  return map_active_mem(n_bytes, (ActiveMemInfo){
+      .ctx = ctx, .sized_read_fn = read_fn, .sized_write_fn = write_fn,
+    });
+}
+
 /** free previously allocated n_bytes of active memory at p.  Returns
  *  non-zero on error.
  */
@@ -22,6 +22,25 @@ void *active_mem_calloc(size_t n_bytes, void *ctx,
                         MemReadFn *read_fn,  MemWriteFn *write_Fn);
 
 
+/** callback for an attempt made to read size bytes at addr.  Returned
+ *  value, zero-extended from size bytes, is what the read should return.
+ */
+typedef MemVal MemSizedReadFn(void *ctx, const void *addr, size_t size);
+
+/** callback for an attempt made to write the low size bytes of val to
+ *  addr.
+ */
+typedef void MemSizedWriteFn(void *ctx, const void *addr, size_t size,
+                             MemVal val);
+
+/** like active_mem_calloc() but the callbacks are also passed the #
+ *  of bytes accessed, and values read by sign-extending moves are
+ *  sign-extended.
+ */
+void *active_mem_calloc_sized(size_t n_bytes, void *ctx,
+                              MemSizedReadFn *read_fn,
+                              MemSizedWriteFn *write_fn);
+
 /** free previously allocated n_bytes of active memory at p.  Returns
  *  non-zero on error.
  */
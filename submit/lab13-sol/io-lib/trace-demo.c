@@ -0,0 +1,56 @@
+//write and then read back an array in traced memory, streaming its
+//accesses into a trace ring for a concurrent cache-sim --ring NAME.
+
+#include "trace-mem.h"
+#include "trace-ring.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, const char *argv[]) {
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "usage: %s RING_NAME [N_INTS [STRIDE]]\n", argv[0]);
+    exit(1);
+  }
+  const char *name = argv[1];
+  size_t n = argc > 2 ? strtoul(argv[2], NULL, 0) : 1024;
+  size_t stride = argc > 3 ? strtoul(argv[3], NULL, 0) : 1;
+  if (n == 0 || stride == 0) {
+    fprintf(stderr, "N_INTS and STRIDE must be positive\n");
+    exit(1);
+  }
+
+  TraceRing *ring = create_trace_ring(name, TRACE_RING_DEFAULT_SIZE,
+                                      N_ADDR_BITS);
+  if (!ring) {
+    fprintf(stderr, "cannot create trace ring %s: %s\n", name,
+            strerror(errno));
+    exit(1);
+  }
+  size_t n_bytes = n*sizeof(int);
+  volatile int *a = trace_mem_calloc(n_bytes, ring);
+  if (!a) {
+    fprintf(stderr, "cannot create traced memory: %s\n", strerror(errno));
+    exit(1);
+  }
+
+  for (size_t i = 0; i < n; i++) a[i] = -(int)i;
+  long sum = 0;
+  for (size_t i0 = 0; i0 < stride; i0++) {
+    for (size_t i = i0; i < n; i += stride) {
+      int v = a[i];
+      sum += v;
+    }
+  }
+
+  if (trace_mem_free((void *)a, n_bytes) != 0) {
+    fprintf(stderr, "cannot free traced memory: %s\n", strerror(errno));
+    exit(1);
+  }
+  close_trace_ring(ring);
+  long expected = -(long)(n*(n - 1)/2);
+  printf("sum %ld; expected %ld\n", sum, expected);
+  return sum != expected;
+}
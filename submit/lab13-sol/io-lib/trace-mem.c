@@ -0,0 +1,70 @@
+#include "trace-mem.h"
+
+#include "active-mem.h"
+#include "trace-ring.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  TraceRing *ring;
+  const char *lo_addr;      //start of traced memory
+  size_t n_bytes;           //# of bytes of traced memory
+  unsigned char *backing;   //real memory behind traced memory
+} TraceMem;
+
+//active memory supports only a single region
+static TraceMem trace_mem;
+
+/** return offset of the access to size bytes at addr within the
+ *  backing buffer, reducing *size to stay within it.
+ */
+static size_t backing_offset(const TraceMem *mem, const void *addr,
+                             size_t *size)
+{
+  size_t offset = (const char *)addr - mem->lo_addr;
+  if (offset + *size > mem->n_bytes) *size = mem->n_bytes - offset;
+  return offset;
+}
+
+static MemVal trace_read(void *ctx, const void *addr, size_t size)
+{
+  TraceMem *mem = ctx;
+  trace_ring_write(mem->ring, (MemAddr)addr, false);
+  MemVal val = 0; //x86 is little-endian, so this zero-extends
+  size_t offset = backing_offset(mem, addr, &size);
+  memcpy(&val, &mem->backing[offset], size);
+  return val;
+}
+
+static void trace_write(void *ctx, const void *addr, size_t size, MemVal val)
+{
+  TraceMem *mem = ctx;
+  trace_ring_write(mem->ring, (MemAddr)addr, true);
+  size_t offset = backing_offset(mem, addr, &size);
+  memcpy(&mem->backing[offset], &val, size);
+}
+
+void *trace_mem_calloc(size_t n_bytes, TraceRing *ring)
+{
+  unsigned char *backing = calloc(n_bytes, 1);
+  if (!backing) return NULL;
+  void *mem = active_mem_calloc_sized(n_bytes, &trace_mem,
+                                      trace_read, trace_write);
+  if (!mem) {
+    free(backing);
+    return NULL;
+  }
+  trace_mem = (TraceMem) {
+    .ring = ring, .lo_addr = mem, .n_bytes = n_bytes, .backing = backing,
+  };
+  return mem;
+}
+
+int trace_mem_free(void *p, size_t n_bytes)
+{
+  free(trace_mem.backing);
+  trace_mem = (TraceMem) { .ring = NULL };
+  return active_mem_free(p, n_bytes);
+}
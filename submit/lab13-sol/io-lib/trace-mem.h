@@ -0,0 +1,23 @@
+#ifndef TRACE_MEM_H_
+#define TRACE_MEM_H_
+
+#include "trace-ring.h"
+
+#include <stddef.h>
+
+/** Allocate n_bytes of zeroed traced memory.  Each load from or store
+ *  to it is appended to the trace in ring, as an access to the address
+ *  of its first byte, and then performed on a real backing buffer, so
+ *  that a program's data structures can be placed in traced memory
+ *  while cache-sim --ring simulates their accesses.
+ *
+ *  Built on active memory: only one region may exist at a time, only
+ *  the mov-like instructions handled by active-mem.c may access it and
+ *  each access costs a signal.  Returns NULL on failure.
+ */
+void *trace_mem_calloc(size_t n_bytes, TraceRing *ring);
+
+/** free n_bytes of traced memory at p.  Returns non-zero on error. */
+int trace_mem_free(void *p, size_t n_bytes);
+
+#endif //ifndef TRACE_MEM_H_
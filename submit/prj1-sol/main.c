@@ -1,90 +1,107 @@
 #include "file-utils.h"
 #include "morse.h"
+#include "morse-stream.h"
 
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+//input is read and converted CHUNK_SIZE Bytes at a time, so memory
+//use does not depend on the size of the input
+enum { CHUNK_SIZE = 64 * 1024 };
 
-static void
-morseEncode(FILE *in, FILE *out)
+static void *
+allocBuffer(unsigned nBytes, const char *what)
 {
-  Byte *text;
-  int nChars = readFile(in, &text);
-  if (nChars < 0) {
-    fprintf(stderr, "cannot read input file\n");
+  void *buf = malloc(nBytes * sizeof(Byte));
+  if (buf == NULL) {
+    fprintf(stderr, "cannot alloc %s: %s\n", what, strerror(errno));
     exit(1);
   }
-  //worst case is text is alternating '0' words; each 0 is 5 dashes
-  //"-----".  The number of bits will be # of bits for first 4 dashes
-  //(each dash will require 3 bits for dash + 1 bit for inter-symbol
-  //marker) + # of bits for last dash (3) + # of bits for
-  //inter-word marker (7).  Hence, we will have 4*4 + 3 + 7 == 26
-  //bits.  We need space for 2 extra chars to accommodate the `AR`
-  //prosign terminator.
-  int maxNBytes = ((nChars + 2) * 26 + BITS_PER_BYTE - 1)/BITS_PER_BYTE;
-  Byte *bytes = calloc(1, maxNBytes);
-  if (bytes == NULL) {
-    fprintf(stderr, "cannot alloc bytes: %s\n", strerror(errno));
-    exit(1);
-  }
-  int nBytes = text_to_morse(text, nChars, bytes);
-  free(text);
-  if (nBytes < 0) {
-    fprintf(stderr, "cannot encode text\n");
+  return buf;
+}
+
+/** Read up to CHUNK_SIZE Bytes from in into chunk[].  Returns # of
+ *  Bytes read, 0 at end of input.
+ */
+static unsigned
+readChunk(Byte chunk[], FILE *in)
+{
+  const size_t n = fread(chunk, sizeof(Byte), CHUNK_SIZE, in);
+  if (n < CHUNK_SIZE && ferror(in)) {
+    fprintf(stderr, "cannot read input file\n");
     exit(1);
   }
-  if (writeFile(bytes, nBytes, out) != nBytes) {
+  return n;
+}
+
+static void
+writeBytes(Byte bytes[], unsigned nBytes, FILE *out)
+{
+  if (nBytes > 0 && writeFile(bytes, nBytes, out) != (int)nBytes) {
     fprintf(stderr, "cannot write output\n");
     exit(1);
   }
+}
+
+static void
+morseEncode(FILE *in, FILE *out)
+{
+  Byte *text = allocBuffer(CHUNK_SIZE, "text");
+  Byte *bytes = allocBuffer(morse_encode_size(CHUNK_SIZE), "bytes");
+  MorseEncoder enc;
+  morse_encoder_init(&enc);
+  unsigned nChars;
+  while ((nChars = readChunk(text, in)) > 0) {
+    writeBytes(bytes, morse_encode_chunk(&enc, text, nChars, bytes), out);
+  }
+  writeBytes(bytes, morse_encode_finish(&enc, bytes), out);
+  free(text);
   free(bytes);
 }
 
 static void
 morseDecode(FILE *in, FILE *out)
 {
-  Byte *bytes;
-  int nBytes = readFile(in, &bytes);
-  if (nBytes < 0) {
-    fprintf(stderr, "cannot read input file\n");
-    exit(1);
-  }
-  //worst case is text is all 'E's; each E is 1 dot which will be
-  //1 (for dot) + 3 bits (for inter-character marker) == 4
-  int maxNChars =
-    2*(nBytes * (BITS_PER_BYTE/4)) + 1; //(+ 1 for terminating '\0')
-  Byte *text = malloc(maxNChars);
-  if (text == NULL) {
-    fprintf(stderr, "cannot alloc text: %s\n", strerror(errno));
-    exit(1);
+  Byte *bytes = allocBuffer(CHUNK_SIZE, "bytes");
+  Byte *text = allocBuffer(morse_decode_size(CHUNK_SIZE), "text");
+  MorseDecoder dec;
+  morse_decoder_init(&dec);
+  //input following the AR prosign is not read
+  unsigned nBytes;
+  while (!morse_decoder_is_done(&dec) &&
+         (nBytes = readChunk(bytes, in)) > 0) {
+    const int nChars = morse_decode_chunk(&dec, bytes, nBytes, text);
+    if (nChars < 0) {
+      fprintf(stderr, "cannot decode bytes\n");
+      exit(1);
+    }
+    writeBytes(text, nChars, out);
   }
-  int nChars = morse_to_text(bytes, nBytes, text);
-  free(bytes);
+  const int nChars = morse_decode_finish(&dec, text);
   if (nChars < 0) {
     fprintf(stderr, "cannot decode bytes\n");
     exit(1);
   }
-  if (writeFile(text, nChars, out) != nChars) {
-    fprintf(stderr, "cannot write output\n");
-    exit(1);
-  }
+  writeBytes(text, nChars, out);
+  free(bytes);
   free(text);
 }
 
 int
 main(int argc, const char *argv[])
 {
-  if (argc != 2 && argc != 3) {
-    fprintf(stderr, "usage: %s SRC_FILE [DEST_FILE]\n", argv[0]);
+  if (argc > 3) {
+    fprintf(stderr, "usage: %s [SRC_FILE|- [DEST_FILE]]\n", argv[0]);
     exit(1);
   }
   const char *lastSlash = strrchr(argv[0], '/');
   const char *basename = (lastSlash == NULL) ? argv[0] : lastSlash + 1;
   const int isEncode = strcmp(basename, "morse-encode") == 0;
+  const int isStdin = argc < 2 || strcmp(argv[1], "-") == 0;
   const char *inMode = isEncode ? "r" : "rb";
-  FILE *in = fopen(argv[1], inMode);
+  FILE *in = isStdin ? stdin : fopen(argv[1], inMode);
   if (!in) {
     fprintf(stderr, "cannot read %s: %s\n", argv[1], strerror(errno));
     exit(1);
@@ -101,7 +118,7 @@ main(int argc, const char *argv[])
   else {
     morseDecode(in, out);
   }
-  if (fclose(in) != 0) {
+  if (!isStdin && fclose(in) != 0) {
     fprintf(stderr, "cannot close %s: %s\n", argv[1], strerror(errno));
     exit(1);
   }
@@ -109,5 +126,9 @@ main(int argc, const char *argv[])
     fprintf(stderr, "cannot close %s: %s\n", argv[2], strerror(errno));
     exit(1);
   }
+  if (argc < 3 && fflush(out) != 0) {
+    fprintf(stderr, "cannot write output\n");
+    exit(1);
+  }
   return 0;
 }
@@ -0,0 +1,109 @@
+#ifndef MORSE_STREAM_H_
+#define MORSE_STREAM_H_
+
+#include "morse.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Streaming versions of text_to_morse() and morse_to_text().  A
+ *  message is converted in chunks of any size, with the state needed
+ *  to continue the conversion carried between chunks in a context, so
+ *  that a message of any length can be converted using fixed size
+ *  buffers.  Splitting a message into chunks does not change its
+ *  conversion: the concatenated outputs are the same as those of the
+ *  whole-message functions.  Context fields are private to morse.c.
+ */
+
+/** Context for encoding a message */
+typedef struct {
+  uint64_t acc;           //pending bits in the low nAcc bits
+  unsigned nAcc;          //# of pending bits; always < 64
+  unsigned prevHasCode;   //true iff the last char so far had a code
+} MorseEncoder;
+
+/** Context for decoding a message */
+typedef struct {
+  unsigned key;           //code key of symbols so far; 0 before 1st code
+  unsigned runBit;        //value of the bits in the current run
+  unsigned runLength;     //# of bits so far in the current run
+  bool isDone;            //true once the AR prosign has been decoded
+  bool isBad;             //true once an error has been detected
+} MorseDecoder;
+
+enum {
+  //bits for the longest code '0' "-----" with its inter-letter gap
+  MORSE_MAX_CHAR_BITS = 5*3 + 4 + 3,
+
+  //bits for the AR prosign ".-.-." with its inter-letter gap
+  MORSE_AR_BITS = 3*1 + 2*3 + 4 + 3,
+
+  //max # of Bytes output by morse_encode_finish(): pending bits
+  //followed by the AR prosign
+  MORSE_ENCODE_FINISH_SIZE =
+    (63 + MORSE_AR_BITS + BITS_PER_BYTE - 1) / BITS_PER_BYTE,
+
+  //max # of Bytes output by morse_decode_finish(): a char and a space
+  MORSE_DECODE_FINISH_SIZE = 2,
+};
+
+/** Return max # of Bytes output by morse_encode_chunk() for a chunk
+ *  of nText chars: the longest code for each char plus < 64 bits
+ *  pending from earlier chunks.
+ */
+static inline unsigned morse_encode_size(unsigned nText) {
+  return (nText * MORSE_MAX_CHAR_BITS + 63) / BITS_PER_BYTE;
+}
+
+/** Return max # of Bytes output by morse_decode_chunk() for a chunk
+ *  of nMorse Bytes: a char and a space for each 4 bits (a dot and an
+ *  inter-letter gap) plus a char pending from earlier chunks.
+ */
+static inline unsigned morse_decode_size(unsigned nMorse) {
+  return 2 * (nMorse * BITS_PER_BYTE / 4 + 1);
+}
+
+/** Set up *enc for encoding a new message */
+void morse_encoder_init(MorseEncoder *enc);
+
+/** Encode text[nText], the next chunk of the message being encoded
+ *  by *enc, as for text_to_morse().  Only whole Bytes are output to
+ *  morse[], which must have room for morse_encode_size(nText) Bytes;
+ *  remaining bits are held in *enc.  Returns # of Bytes output.
+ */
+unsigned morse_encode_chunk(MorseEncoder *enc, const Byte text[],
+                            unsigned nText, Byte morse[]);
+
+/** End the message being encoded by *enc, outputting the pending bits
+ *  followed by the AR prosign, padded with 0's to a Byte boundary, to
+ *  morse[], which must have room for MORSE_ENCODE_FINISH_SIZE Bytes.
+ *  Returns # of Bytes output.
+ */
+unsigned morse_encode_finish(MorseEncoder *enc, Byte morse[]);
+
+/** Set up *dec for decoding a new message */
+void morse_decoder_init(MorseDecoder *dec);
+
+/** Decode morse[nMorse], the next chunk of the message being decoded
+ *  by *dec, as for morse_to_text(), into text[], which must have room
+ *  for morse_decode_size(nMorse) Bytes.  A char is output only once
+ *  the gap following its code is complete; chunks following the AR
+ *  prosign are ignored.  Returns # of Bytes output to text[], < 0 on
+ *  error in this or an earlier chunk.
+ */
+int morse_decode_chunk(MorseDecoder *dec, const Byte morse[],
+                       unsigned nMorse, Byte text[]);
+
+/** End the message being decoded by *dec, outputting any char whose
+ *  code ends the message to text[], which must have room for
+ *  MORSE_DECODE_FINISH_SIZE Bytes.  Returns # of Bytes output, < 0 on
+ *  error.
+ */
+int morse_decode_finish(MorseDecoder *dec, Byte text[]);
+
+/** Return true iff *dec has decoded the AR prosign ending a message */
+static inline bool morse_decoder_is_done(const MorseDecoder *dec) {
+  return dec->isDone;
+}
+
+#endif //ifndef MORSE_STREAM_H_
@@ -1,9 +1,12 @@
 #include "morse.h"
+#include "morse-stream.h"
 
 #include <assert.h>
 #include <ctype.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 typedef struct {
@@ -29,27 +32,97 @@ static const TextMorse char_codes[] = {
                      //<https://en.wikipedia.org/wiki/Prosigns_for_Morse_code>
 };
 
-/** Return NUL-terminated morse code string (like "..--") for char
- *  c. Returns NULL if there is no code for c.
+/** Encoding of a text char: the low len bits of bits, first bit most
+ *  significant.  For a char with a code, its morse code followed by
+ *  the inter-letter gap.  For a char without a code, the 0's which
+ *  extend a preceding inter-letter gap into an inter-word gap; these
+ *  are output only when the previous char had a code.
  */
-static const char *char_to_morse(Byte c) {
-  for (int i = 0; i < sizeof(char_codes) / sizeof(char_codes[0]); i++) {
-    if (char_codes[i].c == c)
-      return char_codes[i].code;
+typedef struct {
+  uint32_t bits;
+  uint8_t len;
+  uint8_t hasCode;
+} CharBits;
+
+enum {
+  N_CHAR_BITS = 256,
+  INTER_LETTER_ZEROS = 3,
+  //an inter-word gap follows the preceding inter-letter gap
+  EXTRA_INTER_WORD_ZEROS = 7 - INTER_LETTER_ZEROS,
+};
+
+//encodings indexed by char, lower-case letters encoded like
+//upper-case.  '\0' has no text code, so a NUL in the text separates
+//words like any other char without a code rather than ending the
+//text; char_bits[0] also encodes any char beyond the table.
+static CharBits char_bits[N_CHAR_BITS];
+
+//encoding of the AR prosign; len == 0 until the tables are set up
+static CharBits ar_bits;
+
+/** A code key is a 1 followed by a bit for each symbol of a code, 0
+ *  for a dot and 1 for a dash; so both the length and the symbols of
+ *  a code determine its key.
+ */
+enum {
+  MAX_CODE_SYMBOLS = 5,
+  N_CODE_KEYS = 1 << (MAX_CODE_SYMBOLS + 1),
+};
+
+//chars indexed by code key; -1 for keys without a char
+static signed char key_chars[N_CODE_KEYS];
+
+/** Return encoding of NUL-terminated morse code string code (like
+ *  "..--") followed by an inter-letter gap.
+ */
+static CharBits code_to_bits(const char *code) {
+  CharBits cb = { .bits = 0, .len = 0, .hasCode = 0 };
+  for (const char *p = code; *p != '\0'; p++) {
+    if (p != code) { //inter-symbol 0
+      cb.bits <<= 1;
+      cb.len++;
+    }
+    const unsigned n = (*p == '.') ? 1 : 3;
+    cb.bits = (cb.bits << n) | ((1u << n) - 1);
+    cb.len += n;
   }
-  return NULL;
+  cb.bits <<= INTER_LETTER_ZEROS;
+  cb.len += INTER_LETTER_ZEROS;
+  cb.hasCode = 1;
+  return cb;
 }
 
-/** Given a NUL-terminated morse code string (like "..--") for a
-    single char, return the corresponding char. Returns < 0 if code is
-    invalid.
- */
-static int morse_to_char(const char *code) {
+/** Return code key of NUL-terminated morse code string code */
+static unsigned code_to_key(const char *code) {
+  unsigned key = 1;
+  for (const char *p = code; *p != '\0'; p++) {
+    key = (key << 1) | (*p == '-');
+  }
+  return key;
+}
+
+/** Set up char_bits[], ar_bits and key_chars[] from char_codes[] */
+static void init_code_tables(void) {
+  for (int c = 0; c < N_CHAR_BITS; c++) {
+    char_bits[c].len = EXTRA_INTER_WORD_ZEROS;
+  }
+  memset(key_chars, -1, sizeof(key_chars));
   for (int i = 0; i < sizeof(char_codes) / sizeof(char_codes[0]); i++) {
-    if (strcmp(char_codes[i].code, code) == 0)
-      return char_codes[i].c;
+    key_chars[code_to_key(char_codes[i].code)] = char_codes[i].c;
+    const CharBits cb = code_to_bits(char_codes[i].code);
+    const Byte c = char_codes[i].c;
+    if (c == '\0') {
+      ar_bits = cb;
+    } else {
+      char_bits[c] = cb;
+      char_bits[tolower(c)] = cb;
+    }
   }
-  return -1;
+}
+
+/** Return encoding of text char c */
+static inline CharBits char_to_bits(Byte c) {
+  return char_bits[(c < N_CHAR_BITS) ? c : 0];
 }
 
 #include "inlines.h"
@@ -184,6 +257,105 @@ static inline unsigned run_length(const Byte bytes[], unsigned nBytes,
   return count;
 }
 
+/** Accumulates bits and writes them, first bit most significant, to
+ *  out[] a 64-bit word at a time.
+ */
+typedef struct {
+  Byte *start;    //start of output
+  Byte *out;      //next output Byte
+  uint64_t acc;   //pending bits in the low n bits
+  unsigned n;     //# of pending bits; always < WORD_BITS
+} BitWriter;
+
+enum {
+  WORD_BITS = 64,
+  BYTES_PER_WORD = WORD_BITS / BITS_PER_BYTE,
+};
+
+/** Write the first nBytes Bytes of word, most-significant first, to
+ *  out[].
+ */
+static inline void write_word_bytes(Byte out[], uint64_t word,
+                                    unsigned nBytes) {
+  if (BITS_PER_BYTE == 8 && nBytes == BYTES_PER_WORD &&
+      __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {
+    word = __builtin_bswap64(word);
+    memcpy(out, &word, sizeof(word));
+  } else {
+    for (unsigned i = 0; i < nBytes; i++) {
+      out[i] = (Byte)(word >> (WORD_BITS - (i + 1) * BITS_PER_BYTE));
+    }
+  }
+}
+
+/** Append the low len bits of bits to w, where len < WORD_BITS and
+ *  bits has no other bits set.
+ */
+static inline void put_bits(BitWriter *w, uint64_t bits, unsigned len) {
+  if (w->n + len < WORD_BITS) {
+    w->acc = (w->acc << len) | bits;
+    w->n += len;
+  } else {
+    //fill out a word with the leading bits; higher pending bits
+    //shift out of acc
+    const unsigned nFit = WORD_BITS - w->n;
+    const unsigned nLeft = len - nFit;
+    write_word_bytes(w->out, (w->acc << nFit) | (bits >> nLeft),
+                     BYTES_PER_WORD);
+    w->out += BYTES_PER_WORD;
+    w->acc = bits;
+    w->n = nLeft;
+  }
+}
+
+/** Write any pending bits in w padded with 0's to a Byte boundary.
+ *  Return total # of Bytes written.
+ */
+static inline unsigned finish_bits(BitWriter *w) {
+  if (w->n > 0) {
+    const unsigned nBytes = (w->n + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+    write_word_bytes(w->out, w->acc << (WORD_BITS - w->n), nBytes);
+    w->out += nBytes;
+    w->n = 0;
+  }
+  return w->out - w->start;
+}
+
+void morse_encoder_init(MorseEncoder *enc) {
+  if (ar_bits.len == 0) init_code_tables();
+  *enc = (MorseEncoder) { .acc = 0, .nAcc = 0, .prevHasCode = 0 };
+}
+
+unsigned morse_encode_chunk(MorseEncoder *enc, const Byte text[],
+                            unsigned nText, Byte morse[]) {
+  BitWriter w = { .start = morse, .out = morse,
+                  .acc = enc->acc, .n = enc->nAcc };
+
+  //a run of chars without a code becomes a single inter-word gap,
+  //output by its first char; leading runs are ignored.  Selecting the
+  //length rather than branching keeps the loop free of unpredictable
+  //branches.
+  unsigned prevHasCode = enc->prevHasCode;
+  for (unsigned textIndex = 0; textIndex < nText; textIndex++) {
+    const CharBits cb = char_to_bits(text[textIndex]);
+    const unsigned len = (prevHasCode | cb.hasCode) ? cb.len : 0;
+    put_bits(&w, cb.bits, len);
+    prevHasCode = cb.hasCode;
+  }
+
+  enc->acc = w.acc;
+  enc->nAcc = w.n;
+  enc->prevHasCode = prevHasCode;
+  return w.out - w.start;
+}
+
+unsigned morse_encode_finish(MorseEncoder *enc, Byte morse[]) {
+  BitWriter w = { .start = morse, .out = morse,
+                  .acc = enc->acc, .n = enc->nAcc };
+  put_bits(&w, ar_bits.bits, ar_bits.len);
+  return finish_bits(&w);
+}
+
 /** Convert text[nText] into a binary encoding of morse code in
  *  morse[].  It is assumed that array morse[] is initially all zero
  *  and is large enough to represent the morse code for all characters
@@ -195,66 +367,211 @@ static inline unsigned run_length(const Byte bytes[], unsigned nBytes,
  *  Returns count of number of bytes used within morse[].
  */
 int text_to_morse(const Byte text[], unsigned nText, Byte morse[]) {
-  unsigned morseBitOffset = 0;
-  unsigned textIndex = 0;
+  MorseEncoder enc;
+  morse_encoder_init(&enc);
+  const unsigned nBytes = morse_encode_chunk(&enc, text, nText, morse);
+  return (int)(nBytes + morse_encode_finish(&enc, &morse[nBytes]));
+}
 
-  while (textIndex < nText && !isalnum(text[textIndex])) {
-    textIndex++;
+/** Return the bits of morse[nMorse] starting at bitOffset, first bit
+ *  most significant, setting *nValid to the # of them within morse[];
+ *  the others are 0.  Requires bitOffset < nMorse * BITS_PER_BYTE.
+ */
+static inline uint64_t load_window(const Byte morse[], unsigned nMorse,
+                                   unsigned bitOffset, unsigned *nValid) {
+  const unsigned byteOffset = get_byte_offset(bitOffset);
+  const unsigned bitIndex = get_bit_index(bitOffset);
+  const unsigned nBytes = (nMorse - byteOffset < BYTES_PER_WORD)
+    ? nMorse - byteOffset : BYTES_PER_WORD;
+  uint64_t word = 0;
+  if (BITS_PER_BYTE == 8 && nBytes == BYTES_PER_WORD &&
+      __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) {
+    memcpy(&word, &morse[byteOffset], sizeof(word));
+    word = __builtin_bswap64(word);
+  } else {
+    for (unsigned i = 0; i < nBytes; i++) {
+      word |= (uint64_t)morse[byteOffset + i] <<
+        (WORD_BITS - (i + 1) * BITS_PER_BYTE);
+    }
   }
+  *nValid = nBytes * BITS_PER_BYTE - bitIndex;
+  return word << bitIndex;
+}
 
-  int prevWasAlnum = 0;
-  int emittedAR = 0;
+/** Return count of run of bits equal to bit starting at bitOffset in
+ *  morse[nMorse]; 0 when the bit at bitOffset differs or bitOffset is
+ *  outside morse[nMorse].
+ */
+static inline unsigned bit_run_length(const Byte morse[], unsigned nMorse,
+                                      unsigned bitOffset, unsigned bit) {
+  const unsigned maxBits = nMorse * BITS_PER_BYTE;
+  unsigned count = 0;
+  while (bitOffset + count < maxBits) {
+    unsigned nValid;
+    uint64_t window = load_window(morse, nMorse, bitOffset + count, &nValid);
+    if (bit) window = ~window;
+    //the run is the leading 0's of window
+    const unsigned n = (window == 0) ? WORD_BITS : __builtin_clzll(window);
+    if (n < nValid) return count + n;
+    count += nValid;
+  }
+  return count;
+}
 
-  while (!emittedAR) {
-    Byte c;
+/** Decode the code of a char and the run of 0's following it from
+ *  window, bits starting at the char followed by 0's beyond the valid
+ *  bits.  Returns false if the code or the 0's may continue beyond the
+ *  valid bits.  Otherwise sets *nBits to the # of bits decoded, *key
+ *  to the code key, *nZeros to the # of 0's and *isBad if the code is
+ *  invalid; nothing beyond an invalid run of 1's or a pair of 0's is
+ *  decoded.
+ *
+ *  Symbols are decoded without branching on whether they are dots or
+ *  dashes.
+ */
+static inline bool decode_code_in_window(uint64_t window, unsigned *nBits,
+                                         unsigned *key, unsigned *nZeros,
+                                         bool *isBad) {
+  unsigned n = 0, k = 1, zeros, bad = 0;
+  do {
+    //ORing in 1 keeps clz defined when window is all 1's
+    const unsigned ones = __builtin_clzll(~window | 1);
+    bad |= ((ones - 1) & ~2u) | (k >= N_CODE_KEYS / 2);
+    k = (k << 1) | ((ones >> 1) & 1);
+    window <<= ones;
+    n += ones;
+    if (window == 0) return false;
+    zeros = __builtin_clzll(window);
+    window <<= zeros;
+    n += zeros;
+  } while (zeros == 1 && !bad);
+  *nBits = n;
+  *key = k;
+  *nZeros = zeros;
+  *isBad = bad || zeros == 2;
+  return true;
+}
 
-    if (textIndex >= nText) {
-      c = '\0';
-    } else {
-      c = (Byte)toupper(text[textIndex]);
-    }
+/** Output the char with code key to text[*textIndex] followed by a
+ *  space if isWordGap, advancing *textIndex; the AR prosign instead
+ *  ends the message decoded by *dec.  Returns false for an unknown
+ *  code.
+ */
+static inline bool put_char(MorseDecoder *dec, unsigned key,
+                            unsigned isWordGap, Byte text[],
+                            unsigned *textIndex) {
+  const int ch = key_chars[key];
+  if (ch < 0) return false;
+  if (ch == '\0') {
+    dec->isDone = true;
+    return true;
+  }
+  //the space is stored first so that the char overwrites it when
+  //there is no separator
+  text[*textIndex + isWordGap] = (Byte)' ';
+  text[*textIndex] = (Byte)ch;
+  *textIndex += 1 + isWordGap;
+  return true;
+}
 
-    const char *code = char_to_morse(c);
-
-    if (code != NULL) {
-      int i = 0;
-      while (code[i] != '\0') {
-        char sym = code[i++];
-        if (sym == '.') {
-          morseBitOffset = set_bits_at_offset(morse, morseBitOffset, 1, 1);
-        } else {
-          morseBitOffset = set_bits_at_offset(morse, morseBitOffset, 1, 3);
-        }
-        
-        morseBitOffset = set_bits_at_offset(morse, morseBitOffset, 0, 1);
-      }
+/** End the current run of *dec: a run of 1's is a symbol of the
+ *  current code, a run of 0's a gap which may end the code, in which
+ *  case its char is output to text[*textIndex].  Returns false if the
+ *  run is invalid.
+ */
+static inline bool end_run(MorseDecoder *dec, Byte text[],
+                           unsigned *textIndex) {
+  const unsigned n = dec->runLength;
+  dec->runLength = 0;
+  dec->runBit = !dec->runBit;
+  if (dec->runBit == 0) {
+    if ((n != 1 && n != 3) || dec->key >= N_CODE_KEYS / 2) return false;
+    dec->key = (dec->key << 1) | (n == 3);
+    return true;
+  }
+  if (dec->key == 0) {
+    //leading 0's are ignored
+    dec->key = 1;
+    return true;
+  }
+  if (n == 1) return true;
+  if (n == 2) return false;
+
+  //a run of 7 0's is a word separator; 3 to 6 or more than 7 only
+  //end the char
+  const unsigned key = dec->key;
+  dec->key = 1;
+  return put_char(dec, key, n == 7, text, textIndex);
+}
 
-      morseBitOffset = set_bits_at_offset(morse, morseBitOffset, 0, 2);
+void morse_decoder_init(MorseDecoder *dec) {
+  if (ar_bits.len == 0) init_code_tables();
+  *dec = (MorseDecoder) {
+    .key = 0, .runBit = 0, .runLength = 0, .isDone = false, .isBad = false,
+  };
+}
 
-      if (c == '\0') {
-        emittedAR = 1;
-      } else {
-        prevWasAlnum = 1;
-        textIndex++;
+int morse_decode_chunk(MorseDecoder *dec, const Byte morse[],
+                       unsigned nMorse, Byte text[]) {
+  //work on a copy so that its fields stay in registers despite the
+  //stores to text[]
+  MorseDecoder d = *dec;
+  const unsigned maxBits = nMorse * BITS_PER_BYTE;
+  unsigned bitOffset = 0, textIndex = 0;
+
+  //bits at bitOffset, valid up to the trailing 0's shifted in as bits
+  //are decoded; reloaded only when a code runs into those 0's.  A code
+  //which may continue into the next chunk, or is followed by a long
+  //run of 0's, is decoded run by run.
+  uint64_t window = 0;
+
+  while (bitOffset < maxBits && !d.isDone && !d.isBad) {
+    if (d.key == 1 && d.runBit == 1 && d.runLength == 0) {
+      //at the start of a code
+      unsigned nBits, key, zeros;
+      bool isBad;
+      bool isDecoded =
+        decode_code_in_window(window, &nBits, &key, &zeros, &isBad);
+      if (!isDecoded) {
+        unsigned nValid;
+        window = load_window(morse, nMorse, bitOffset, &nValid);
+        isDecoded =
+          decode_code_in_window(window, &nBits, &key, &zeros, &isBad);
       }
-    } else {
-      if (prevWasAlnum) {
-        morseBitOffset = set_bits_at_offset(morse, morseBitOffset, 0, 4);
-      }
-
-      while (textIndex < nText && !isalnum(text[textIndex])) {
-        textIndex++;
+      if (isDecoded) {
+        d.isBad = isBad || !put_char(&d, key, zeros == 7, text, &textIndex);
+        window <<= nBits;
+        bitOffset += nBits;
+        continue;
       }
-      prevWasAlnum = 0;
+      window = 0;
     }
+    //a run which reaches the end of morse[] may continue in the next
+    //chunk
+    const unsigned n = bit_run_length(morse, nMorse, bitOffset, d.runBit);
+    d.runLength += n;
+    bitOffset += n;
+    if (bitOffset < maxBits) d.isBad = !end_run(&d, text, &textIndex);
   }
 
-  unsigned nBytes = morseBitOffset / BITS_PER_BYTE;
-  if (morseBitOffset % BITS_PER_BYTE != 0) {
-    nBytes++;
-  }
+  *dec = d;
+  return d.isBad ? -1 : (int)textIndex;
+}
 
-  return (int)nBytes;
+int morse_decode_finish(MorseDecoder *dec, Byte text[]) {
+  unsigned textIndex = 0;
+  if (!dec->isDone && !dec->isBad) {
+    if (dec->runBit == 1 && dec->runLength > 0) {
+      //a code ending the message without a gap
+      dec->isBad = !end_run(dec, text, &textIndex) ||
+        !put_char(dec, dec->key, 0, text, &textIndex);
+    }
+    else if (dec->runBit == 0 && dec->key > 1) {
+      //a gap ending the message; a single 0 cannot end a code
+      dec->isBad = dec->runLength == 1 || !end_run(dec, text, &textIndex);
+    }
+  }
+  return dec->isBad ? -1 : (int)textIndex;
 }
 
 /** Convert AR-prosign terminated binary Morse encoding in
@@ -266,80 +583,10 @@ int text_to_morse(const Byte text[], unsigned nText, Byte morse[]) {
  *  Returns count of number of bytes used within text[], < 0 on error.
  */
 int morse_to_text(const Byte morse[], unsigned nMorse, Byte text[]) {
-  unsigned maxBits = nMorse * BITS_PER_BYTE;
-  unsigned bitOffset = 0;
-  unsigned textIndex = 0;
-
-  while (bitOffset < maxBits && get_bit_at_offset(morse, bitOffset) == 0) {
-    bitOffset++;
-  }
-
-  char codeBuffer[16];
-
-  while (bitOffset < maxBits) {
-    int codeLen = 0;
-    int charDone = 0;
-    int wordGap = 0;
-
-    while (!charDone) {
-      if (get_bit_at_offset(morse, bitOffset) == 0) {
-        return -1;
-      }
-
-      unsigned ones = run_length(morse, nMorse, bitOffset);
-      if (ones == 1) {
-        codeBuffer[codeLen++] = '.';
-      } else if (ones == 3) {
-        codeBuffer[codeLen++] = '-';
-      } else {
-        return -1;
-      }
-      bitOffset += ones;
-
-      if (bitOffset >= maxBits) {
-        charDone = 1;
-        break;
-      }
-
-      if (get_bit_at_offset(morse, bitOffset) == 1) {
-        return -1;
-      }
-
-      unsigned zeros = run_length(morse, nMorse, bitOffset);
-
-      if (zeros == 1) {
-        bitOffset += 1;
-      } else if (zeros == 3) {
-        bitOffset += 3;
-        charDone = 1;
-      } else if (zeros == 7) {
-        bitOffset += 7;
-        charDone = 1;
-        wordGap = 1;
-      } else if (zeros > 3) {
-        bitOffset += zeros;
-        charDone = 1;
-      } else {
-        return -1;
-      }
-    }
-
-    codeBuffer[codeLen] = '\0';
-    int ch = morse_to_char(codeBuffer);
-    if (ch < 0) {
-      return -1;
-    }
-
-    if (ch == '\0') {
-      break;
-    }
-
-    text[textIndex++] = (Byte)ch;
-
-    if (wordGap) {
-      text[textIndex++] = (Byte)' ';
-    }
-  }
-
-  return (int)textIndex;
-}
\ No newline at end of file
+  MorseDecoder dec;
+  morse_decoder_init(&dec);
+  const int nText = morse_decode_chunk(&dec, morse, nMorse, text);
+  if (nText < 0) return -1;
+  const int nLast = morse_decode_finish(&dec, &text[nText]);
+  return (nLast < 0) ? -1 : nText + nLast;
+}
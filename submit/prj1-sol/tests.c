@@ -1,11 +1,13 @@
 #include <assert.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "unit-test.h"
 
 #include "morse.h"
+#include "morse-stream.h"
 #include "inlines.h"
 
 /************************** byte_bit_mask() Tests ************************/
@@ -300,6 +302,315 @@ static void morse_to_text_sos_test(void) {
   }
 }
 
+/** Check that text_to_morse() encodes text[nText] as
+ *  expected[nExpected].
+ */
+static void text_to_morse_test(const char *name, const Byte text[],
+                               unsigned nText, const Byte expected[],
+                               unsigned nExpected)
+{
+  Byte bytes[16] = { 0 };
+  assert(nExpected <= sizeof(bytes)/sizeof(bytes[0]));
+  const int actual = text_to_morse(text, nText, bytes);
+  char name1[64];
+  int n = snprintf(name1, sizeof(name1), "%s return", name);
+  assert(n < sizeof(name1));
+  UTEST_REL(name1, nExpected, ==, actual);
+  for (int i = 0; i < nExpected; i++) {
+    n = snprintf(name1, sizeof(name1), "%s byte %u", name, i);
+    assert(n < sizeof(name1));
+    UTEST_REL(name1, expected[i], ==, bytes[i]);
+  }
+}
+
+/*
+A NUL has no code, so like any other such char it separates words
+rather than ending the text:
+
+1 0 1 1 1 0 0 0   1 1 1 0 1 0 1 0   1 0 0 0 0 0 0 0    1 0 1 1 1 0 1 0
+  .     -               -     .       .   .  (NUL)       .     -   .
+        A                           B
+0xb8              0xea              0x80               0xba
+
+1 1 1 0 1 0 0 0
+    -     .
+              AR
+0xe8
+ */
+
+static void text_to_morse_nul_test(void) {
+  const Byte text[] = { 'A', 'B', '\0' };
+#if BYTE_SIZE == 2
+  const Byte expected[] = { 0xb8ea, 0x80ba, 0xe800, };
+#else
+  const Byte expected[] = { 0xb8, 0xea, 0x80, 0xba, 0xe8, };
+#endif
+  text_to_morse_test("text_to_morse_nul", text, sizeof(text)/sizeof(text[0]),
+                     expected, sizeof(expected)/sizeof(expected[0]));
+}
+
+/** Set morse[] to the bits given by the '0' and '1' chars of bits,
+ *  ignoring other chars, padded with 0's to a Byte boundary.  Returns
+ *  the # of Bytes set.
+ */
+static unsigned bits_to_morse(const char *bits, Byte morse[],
+                              unsigned maxMorse)
+{
+  unsigned offset = 0;
+  for (const char *p = bits; *p != '\0'; p++) {
+    if (*p != '0' && *p != '1') continue;
+    assert(offset < maxMorse * BITS_PER_BYTE);
+    set_bit_at_offset(morse, offset++, *p == '1');
+  }
+  const unsigned nMorse = (offset + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+  set_bits_at_offset(morse, offset, 0, nMorse * BITS_PER_BYTE - offset);
+  return nMorse;
+}
+
+/** Set bits[size] to the '0' and '1' chars of the binary encoding of
+ *  code: '.' and '-' are dots and dashes of a char, ' ' an
+ *  inter-letter gap and '/' an inter-word gap.
+ */
+static void code_to_bit_chars(const char *code, char bits[], size_t size)
+{
+  size_t n = 0;
+  for (const char *p = code; *p != '\0'; p++) {
+    const char *s = (*p == '.') ? "1" : (*p == '-') ? "111"
+                  : (*p == ' ') ? "000" : "0000000";
+    const bool isSymbol = (*p == '.' || *p == '-');
+    if (isSymbol && p != code && (p[-1] == '.' || p[-1] == '-')) {
+      s = (*p == '.') ? "01" : "0111";
+    }
+    assert(n + strlen(s) < size);
+    strcpy(&bits[n], s);
+    n += strlen(s);
+  }
+  bits[n] = '\0';
+}
+
+/** Check that morse_to_text() decodes the bits given by the '0' and
+ *  '1' chars of bits as text; NULL text when it should fail.
+ */
+static void morse_bits_to_text_test(const char *name, const char *bits,
+                                    const char *text)
+{
+  Byte morse[64] = { 0 };
+  Byte actual[64] = { 0 };
+  const unsigned nMorse =
+    bits_to_morse(bits, morse, sizeof(morse)/sizeof(morse[0]));
+  const int nActual = morse_to_text(morse, nMorse, actual);
+  char name1[64];
+  int n = snprintf(name1, sizeof(name1), "%s return", name);
+  assert(n < sizeof(name1));
+  if (!text) {
+    UTEST_REL(name1, nActual, <, 0);
+    return;
+  }
+  const unsigned nText = strlen(text);
+  UTEST_REL(name1, nActual, ==, nText);
+  for (int i = 0; i < nText; i++) {
+    n = snprintf(name1, sizeof(name1), "%s byte %u", name, i);
+    assert(n < sizeof(name1));
+    UTEST_REL(name1, (Byte)text[i], ==, actual[i]);
+  }
+}
+
+/** Check that morse_to_text() decodes the encoding of code (as for
+ *  code_to_bit_chars()) preceded by nZeros 0's as text; NULL text
+ *  when it should fail.
+ */
+static void morse_to_text_test(const char *name, unsigned nZeros,
+                               const char *code, const char *text)
+{
+  char bits[512];
+  assert(nZeros < 64);
+  memset(bits, '0', nZeros);
+  code_to_bit_chars(code, &bits[nZeros], sizeof(bits) - nZeros);
+  morse_bits_to_text_test(name, bits, text);
+}
+
+//independent of morse.c's table
+static const struct { char c; const char *code; } TEST_CODES[] = {
+  {'A', ".-"},     {'B', "-..."},  {'C', "-.-."},  {'D', "-.."},
+  {'E', "."},      {'F', "..-."},  {'G', "--."},   {'H', "...."},
+  {'I', ".."},     {'J', ".---"},  {'K', "-.-"},   {'L', ".-.."},
+  {'M', "--"},     {'N', "-."},    {'O', "---"},   {'P', ".--."},
+  {'Q', "--.-"},   {'R', ".-."},   {'S', "..."},   {'T', "-"},
+  {'U', "..-"},    {'V', "...-"},  {'W', ".--"},   {'X', "-..-"},
+  {'Y', "-.--"},   {'Z', "--.."},
+  {'1', ".----"},  {'2', "..---"}, {'3', "...--"}, {'4', "....-"},
+  {'5', "....."},  {'6', "-...."}, {'7', "--..."}, {'8', "---.."},
+  {'9', "----."},  {'0', "-----"},
+};
+
+static void morse_to_text_char_tests(void) {
+  for (int i = 0; i < sizeof(TEST_CODES)/sizeof(TEST_CODES[0]); i++) {
+    char code[16], name[32], text[2] = { TEST_CODES[i].c, '\0' };
+    int n = snprintf(code, sizeof(code), "%s .-.-. ", TEST_CODES[i].code);
+    assert(n < sizeof(code));
+    n = snprintf(name, sizeof(name), "morse_to_text char %c", text[0]);
+    assert(n < sizeof(name));
+    morse_to_text_test(name, 0, code, text);
+  }
+}
+
+static void morse_to_text_tests(void) {
+  morse_to_text_test("morse_to_text word gaps", 0,
+                     ".. .../.-/-- . .-.-. ", "IS A ME");
+  morse_to_text_test("morse_to_text trailing word gap", 0,
+                     ".../.-.-. ", "S ");
+  morse_to_text_test("morse_to_text only AR", 0, ".-.-. ", "");
+  //9 leading 0's end the AR on a Byte boundary
+  morse_to_text_test("morse_to_text AR without gap", 9, "-- .-.-.", "M");
+  morse_to_text_test("morse_to_text early AR", 0,
+                     "... .-.-. --- ... .-.-. ", "S");
+  morse_to_text_test("morse_to_text missing AR", 0, "... --- ... ", "SOS");
+  morse_to_text_test("morse_to_text missing AR and gap", 0,
+                     "... --- ...", "SOS");
+  morse_to_text_test("morse_to_text leading 0", 1, "-.- .-.-. ", "K");
+  morse_to_text_test("morse_to_text leading 0's", 21, "-.- .-.-. ", "K");
+  morse_to_text_test("morse_to_text code too long", 0,
+                     "...... .-.-. ", NULL);
+  morse_to_text_test("morse_to_text unknown code", 0, "..-- .-.-. ", NULL);
+
+  //AR is 1 0 111 0 1 0 111 0 1 000
+  morse_bits_to_text_test("morse_to_text run of 2 1's",
+                          "11 000 1011101011101000", NULL);
+  morse_bits_to_text_test("morse_to_text run of 4 1's",
+                          "1111 000 1011101011101000", NULL);
+  morse_bits_to_text_test("morse_to_text run of 2 0's",
+                          "1 00 1 000 1011101011101000", NULL);
+}
+
+/************************* Streaming Codec Tests ***********************/
+
+static const char STREAM_TEXT[] = "  Hi, SOS 42 morse!! 0123 xyz ";
+
+/** Check that encoding text[nText] in chunks of chunkSize chars
+ *  outputs the same Bytes as text_to_morse().  Since a chunk ends
+ *  wherever its last char's code ends, all chunk sizes between them
+ *  leave the pending bits at many different offsets.
+ */
+static void morse_encode_chunks_test(const Byte text[], unsigned nText,
+                                     unsigned chunkSize)
+{
+  Byte whole[256] = { 0 };
+  Byte chunked[256] = { 0 };
+  const unsigned size = sizeof(chunked)/sizeof(chunked[0]);
+  const int nWhole = text_to_morse(text, nText, whole);
+  MorseEncoder enc;
+  morse_encoder_init(&enc);
+  unsigned nChunked = 0;
+  for (unsigned i = 0; i < nText; i += chunkSize) {
+    const unsigned n = (nText - i < chunkSize) ? nText - i : chunkSize;
+    assert(nChunked + morse_encode_size(n) <= size);
+    nChunked += morse_encode_chunk(&enc, &text[i], n, &chunked[nChunked]);
+  }
+  assert(nChunked + MORSE_ENCODE_FINISH_SIZE <= size);
+  nChunked += morse_encode_finish(&enc, &chunked[nChunked]);
+
+  char name[64];
+  int n = snprintf(name, sizeof(name), "morse_encode_chunk(%u) size",
+                   chunkSize);
+  assert(n < sizeof(name));
+  UTEST_REL(name, nWhole, ==, nChunked);
+  for (int i = 0; i < nWhole; i++) {
+    n = snprintf(name, sizeof(name), "morse_encode_chunk(%u) byte %d",
+                 chunkSize, i);
+    assert(n < sizeof(name));
+    UTEST_REL(name, whole[i], ==, chunked[i]);
+  }
+}
+
+/** Check that decoding morse[nMorse] in chunks of chunkSize Bytes
+ *  outputs the same text as morse_to_text().  Tag identifies the
+ *  test.
+ */
+static void morse_decode_chunks_test(const char *tag, const Byte morse[],
+                                     unsigned nMorse, unsigned chunkSize)
+{
+  Byte whole[256] = { 0 };
+  Byte chunked[256] = { 0 };
+  const unsigned size = sizeof(chunked)/sizeof(chunked[0]);
+  const int nWhole = morse_to_text(morse, nMorse, whole);
+  MorseDecoder dec;
+  morse_decoder_init(&dec);
+  int nChunked = 0;
+  for (unsigned i = 0; i < nMorse && nChunked >= 0; i += chunkSize) {
+    const unsigned n = (nMorse - i < chunkSize) ? nMorse - i : chunkSize;
+    assert(nChunked + morse_decode_size(n) <= size);
+    const int nOut = morse_decode_chunk(&dec, &morse[i], n,
+                                        &chunked[nChunked]);
+    nChunked = (nOut < 0) ? -1 : nChunked + nOut;
+  }
+  if (nChunked >= 0) {
+    assert(nChunked + MORSE_DECODE_FINISH_SIZE <= size);
+    const int nOut = morse_decode_finish(&dec, &chunked[nChunked]);
+    nChunked = (nOut < 0) ? -1 : nChunked + nOut;
+  }
+
+  char name[64];
+  int n = snprintf(name, sizeof(name), "morse_decode_chunk(%u) %s size",
+                   chunkSize, tag);
+  assert(n < sizeof(name));
+  UTEST_REL(name, nWhole, ==, nChunked);
+  for (int i = 0; i < nWhole; i++) {
+    n = snprintf(name, sizeof(name), "morse_decode_chunk(%u) %s byte %d",
+                 chunkSize, tag, i);
+    assert(n < sizeof(name));
+    UTEST_REL(name, whole[i], ==, chunked[i]);
+  }
+}
+
+static void morse_encode_chunks_tests(void) {
+  Byte text[sizeof(STREAM_TEXT)];
+  const unsigned nText = sizeof(STREAM_TEXT) - 1;
+  for (unsigned i = 0; i < nText; i++) text[i] = STREAM_TEXT[i];
+  for (unsigned chunkSize = 1; chunkSize <= nText; chunkSize++) {
+    morse_encode_chunks_test(text, nText, chunkSize);
+  }
+}
+
+/** Decode the encoding of STREAM_TEXT preceded by 0 to BITS_PER_BYTE
+ *  - 1 leading 0's in chunks of every size, so that chunk boundaries
+ *  fall at every bit offset of the codes and gaps.
+ */
+static void morse_decode_chunks_tests(void) {
+  Byte text[sizeof(STREAM_TEXT)];
+  const unsigned nText = sizeof(STREAM_TEXT) - 1;
+  for (unsigned i = 0; i < nText; i++) text[i] = STREAM_TEXT[i];
+  Byte encoded[256] = { 0 };
+  const unsigned nEncoded = text_to_morse(text, nText, encoded);
+  for (unsigned shift = 0; shift < BITS_PER_BYTE; shift++) {
+    Byte morse[256 + 1] = { 0 };
+    for (unsigned i = 0; i < nEncoded * BITS_PER_BYTE; i++) {
+      set_bit_at_offset(morse, shift + i, get_bit_at_offset(encoded, i));
+    }
+    const unsigned nMorse = nEncoded + (shift > 0);
+    char tag[16];
+    const int n = snprintf(tag, sizeof(tag), "shift %u", shift);
+    assert(n < sizeof(tag));
+    for (unsigned chunkSize = 1; chunkSize <= nMorse; chunkSize++) {
+      morse_decode_chunks_test(tag, morse, nMorse, chunkSize);
+    }
+  }
+
+  //messages without AR and with an error end in morse_decode_finish()
+  //and a chunk respectively
+  Byte morse[64] = { 0 };
+  char bits[256];
+  code_to_bit_chars("... --- ...", bits, sizeof(bits));
+  unsigned nMorse = bits_to_morse(bits, morse, 64);
+  for (unsigned chunkSize = 1; chunkSize <= nMorse; chunkSize++) {
+    morse_decode_chunks_test("no AR", morse, nMorse, chunkSize);
+  }
+  code_to_bit_chars("... ..-- .-.-. ", bits, sizeof(bits));
+  nMorse = bits_to_morse(bits, morse, 64);
+  for (unsigned chunkSize = 1; chunkSize <= nMorse; chunkSize++) {
+    morse_decode_chunks_test("bad code", morse, nMorse, chunkSize);
+  }
+}
+
 /*************************** Main Test Function ************************/
 
 int is_verbose_unit_test = 1;
@@ -322,7 +633,13 @@ main(void)
   run_length_tests();
 
   text_to_morse_sos_test();
+  text_to_morse_nul_test();
   morse_to_text_sos_test();
+  morse_to_text_char_tests();
+  morse_to_text_tests();
+
+  morse_encode_chunks_tests();
+  morse_decode_chunks_tests();
 
   return n_fails_unit_test;
 }
@@ -0,0 +1,160 @@
+#include "cache-sim.h"
+#include "memalloc.h"
+#include "replacement.h"
+#include "trace-gen.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum { DEFAULT_LEN = 1000000 };
+enum { BATCH_SIZE = 4096 };
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s [-n LEN] [-S SEED]\n"
+          "reports the # of millions of accesses per second simulated by\n"
+          "cache_sim_results() for each cache config and replacement policy\n"
+          "on LEN-access (default %d) program, random and stride traces\n"
+          "generated in-process from SEED (default 0)\n",
+          msg, program, DEFAULT_LEN);
+  exit(1);
+}
+
+//m-s-b-E configs benchmarked
+static const CacheParams CONFIGS[] = {
+  { .n_mem_addr_bits = 32, .n_set_index_bits = 10,
+    .n_blk_offset_bits = 6, .n_lines_per_set = 1 },
+  { .n_mem_addr_bits = 32, .n_set_index_bits = 8,
+    .n_blk_offset_bits = 6, .n_lines_per_set = 4 },
+  { .n_mem_addr_bits = 32, .n_set_index_bits = 6,
+    .n_blk_offset_bits = 6, .n_lines_per_set = 16 },
+  { .n_mem_addr_bits = 48, .n_set_index_bits = 12,
+    .n_blk_offset_bits = 6, .n_lines_per_set = 8 },
+};
+
+typedef struct {
+  const char *name;
+  GenMode mode;
+  MemAddr mem;
+} TraceSpec;
+
+//memory sizes chosen so that each trace overflows the caches
+static const TraceSpec TRACES[] = {
+  { "program", PROGRAM_G, 16*1024*1024 },
+  { "random", RANDOM_G, 4*1024*1024 },
+  { "stride", STRIDE_G, 1024*1024 },
+};
+
+enum { N_TRACES = sizeof(TRACES)/sizeof(TRACES[0]) };
+
+typedef struct {
+  size_t n;
+  MemAddr *addrs;
+  bool *is_writes;
+} Trace;
+
+static void
+make_trace(const TraceSpec *spec, unsigned long len, unsigned long seed,
+           Trace *trace)
+{
+  GenParams params;
+  default_gen_params(spec->mode, &params);
+  params.len = len;
+  params.mem = spec->mem;
+  params.seed = seed;
+  params.stride = 64;
+  TraceGen *gen = new_trace_gen(&params);
+  trace->addrs = malloc_chk(len * sizeof(MemAddr));
+  trace->is_writes = malloc_chk(len * sizeof(bool));
+  trace->n = trace_gen_read(gen, len, trace->addrs, trace->is_writes);
+  free_trace_gen(gen);
+}
+
+static double
+now_secs(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec*1e-9;
+}
+
+/** Return the # of millions of accesses per second simulated by a new
+ *  cache with parameters *params over trace, NAN if there is no such
+ *  cache.
+ */
+static double
+bench_cache(const CacheParams *params, const Trace *trace)
+{
+  static CacheResult results[BATCH_SIZE];
+  CacheSim *cache = new_cache_sim(params);
+  if (!cache) return NAN;
+  double start = now_secs();
+  if (params->replacement == OPT_R) {
+    cache_sim_set_future(cache, trace->n, trace->addrs);
+  }
+  for (size_t i = 0; i < trace->n; i += BATCH_SIZE) {
+    size_t n = (trace->n - i < BATCH_SIZE) ? trace->n - i : BATCH_SIZE;
+    cache_sim_results(cache, n, &trace->addrs[i], &trace->is_writes[i],
+                      results);
+  }
+  double secs = now_secs() - start;
+  free_cache_sim(cache);
+  return trace->n/secs/1e6;
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  unsigned long len = DEFAULT_LEN, seed = 0;
+  for (int i = 1; i < argc; i++) {
+    char *p;
+    if (i + 1 < argc && strcmp(argv[i], "-n") == 0) {
+      len = strtoul(argv[++i], &p, 10);
+      if (*p != '\0' || len == 0) usage(program, "bad LEN\n");
+    }
+    else if (i + 1 < argc && strcmp(argv[i], "-S") == 0) {
+      seed = strtoul(argv[++i], &p, 10);
+      if (*p != '\0') usage(program, "bad SEED\n");
+    }
+    else {
+      usage(program, "");
+    }
+  }
+  Trace traces[N_TRACES];
+  for (int t = 0; t < N_TRACES; t++) {
+    make_trace(&TRACES[t], len, seed, &traces[t]);
+  }
+  printf("# Maccesses/s for %lu accesses per trace, seed %lu\n", len, seed);
+  printf("%-12s %-6s", "# m-s-b-E", "repl");
+  for (int t = 0; t < N_TRACES; t++) printf(" %9s", TRACES[t].name);
+  printf("\n");
+  for (int c = 0; c < sizeof(CONFIGS)/sizeof(CONFIGS[0]); c++) {
+    const CacheParams *config = &CONFIGS[c];
+    char spec[32];
+    snprintf(spec, sizeof(spec), "%u-%u-%u-%u", config->n_mem_addr_bits,
+             config->n_set_index_bits, config->n_blk_offset_bits,
+             config->n_lines_per_set);
+    for (int r = 0; r < N_REPLACEMENTS; r++) {
+      CacheParams params = *config;
+      params.replacement = r;
+      params.seed = seed;
+      printf("%-12s %-6s", spec, get_replacement_policy(r)->name);
+      for (int t = 0; t < N_TRACES; t++) {
+        printf(" %9.2f", bench_cache(&params, &traces[t]));
+      }
+      printf("\n");
+      fflush(stdout);
+    }
+  }
+  for (int t = 0; t < N_TRACES; t++) {
+    free(traces[t].addrs);
+    free(traces[t].is_writes);
+  }
+  return 0;
+}
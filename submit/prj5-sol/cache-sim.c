@@ -1,29 +1,152 @@
 #include "cache-sim.h"
+#include "hash-map.h"
 #include "memalloc.h"
+#include "prefetch.h"
+#include "replacement.h"
+#include "replacement-ops.h"
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 /************************** Type Definitions  **************************/
 
+/** All set state lives in a single arena aligned to a host cache
+ *  line, set i occupying the set_size bytes at arena[i*set_size]:
+ *
+ *    valid[n_mask_words]        uint64_t masks, way w in bit w%64 of
+ *    dirty[n_mask_words]        word w/64
+ *    prefetched[n_mask_words]   only with a prefetcher: lines filled
+ *                               by prefetches not yet demanded
+ *    sector_valid[E]            only with sectors: uint64_t masks,
+ *    sector_dirty[E]            sector i of way w in bit i of word w
+ *    replacement metadata       meta_size bytes, 8-byte aligned
+ *    tags[E]                    tag_bytes each: the fewest of 1, 2, 4
+ *                               or 8 bytes holding m - s - b bits, or
+ *                               the largest tag accessed if wider
+ *
+ *  set_size is a power of 2 if that is at most HOST_LINE_SIZE and a
+ *  multiple of HOST_LINE_SIZE otherwise, so that small sets never
+ *  straddle host cache lines and large ones start on one.  With a
+ *  prefetcher, prefetch_times[i*E + w] is the time at which way w of
+ *  set i was prefetched.  next_uses[i] is the index of the next access
+ *  to the block of access i, for the first n_future accesses.
+ *
+ *  kernel simulates batches of accesses; it is specialized for the
+ *  policy and E where a specialization exists.
+ */
+
+/** A fully associative victim cache of n_lines lines: line i, if its
+ *  bit is set in valid, holds the block at blocks[i], inserted at
+ *  clock stamps[i].  Since a hit removes a block, the least recently
+ *  inserted block is also the least recently used.
+ */
 typedef struct {
-	bool valid;
-	bool dirty;
-	unsigned long tag;
-	long time;
-} CacheLine;
+	unsigned n_lines;
+	uint64_t valid;
+	uint64_t dirty;
+	MemAddr *blocks;  //NULL when n_lines is 0
+	long *stamps;
+} VictimCache;
+
+typedef void ResultsKernel(CacheSim *cache, size_t n,
+                           const MemAddr access_addrs[],
+                           const bool is_writes[], CacheResult results[]);
 
 struct CacheSimImpl {
 	CacheParams params;
+	unsigned blk_bits;         // shifts and masks precomputed from params
+	unsigned tag_shift;
+	unsigned long set_mask;
+	unsigned sector_bits;      // log2 of sector size; blk_bits if unsectored
+	unsigned n_sectors;        // 1 if unsectored
 	long clock;
-	CacheLine **sets;
+	const ReplacementPolicy *policy;
+	ResultsKernel *kernel;
+	ReplState repl_state;
+	unsigned n_mask_words;
+	unsigned tag_bytes;
+	unsigned long max_tag;     // largest tag which fits in tag_bytes
+	size_t meta_size;
+	size_t set_size;
+	size_t dirty_offset;       // offsets of set components within a set
+	size_t prefetched_offset;
+	size_t sectors_offset;
+	size_t meta_offset;
+	size_t tags_offset;
+	size_t arena_size;
+	unsigned char *arena;      // HOST_LINE_SIZE aligned
+	void *arena_alloc;         // allocation containing arena
+	Prefetcher *prefetcher;    // NULL if no prefetching
+	long *prefetch_times;
+	unsigned long *next_uses;  // NULL until cache_sim_set_future()
+	size_t n_future;
+	CacheTraffic traffic;
+	VictimCache victim;
 };
 
+enum { MASK_BITS = 64, HOST_LINE_SIZE = 64 };
+
+static ResultsKernel *select_kernel(const CacheParams *params);
+
 /******************** Creation / Destruction Routines ******************/
 
+/** Return the # of bytes needed to hold n_bits bit tags */
+static unsigned
+tag_bytes_for(unsigned n_bits)
+{
+	if (n_bits <= 8) return 1;
+	if (n_bits <= 16) return 2;
+	if (n_bits <= 32) return 4;
+	return 8;
+}
+
+/** Return n rounded up to a power of 2 if <= HOST_LINE_SIZE, to a
+ *  multiple of HOST_LINE_SIZE otherwise.
+ */
+static size_t
+round_set_size(size_t n)
+{
+	if (n > HOST_LINE_SIZE) {
+		return (n + HOST_LINE_SIZE - 1) / HOST_LINE_SIZE * HOST_LINE_SIZE;
+	}
+	size_t size = 8;
+	while (size < n) size *= 2;
+	return size;
+}
+
+/** Set the tag_bytes dependent fields of cache and allocate a zeroed
+ *  arena for them.
+ */
+static void
+alloc_arena(CacheSim *cache)
+{
+	size_t n_sets = (size_t)1 << cache->params.n_set_index_bits;
+	size_t E = cache->params.n_lines_per_set;
+	cache->max_tag = (cache->tag_bytes == sizeof(unsigned long))
+		? ~0UL
+		: (1UL << 8*cache->tag_bytes) - 1;
+	cache->set_size = round_set_size(cache->tags_offset + E * cache->tag_bytes);
+	cache->arena_size = n_sets * cache->set_size;
+	cache->arena_alloc = calloc_chk(1, cache->arena_size + HOST_LINE_SIZE - 1);
+	uintptr_t base = (uintptr_t)cache->arena_alloc;
+	cache->arena = (unsigned char *)
+		((base + HOST_LINE_SIZE - 1) & ~(uintptr_t)(HOST_LINE_SIZE - 1));
+}
+
 /** Create and return a new cache-simulation structure for a
  *  cache for main memory with the specified cache parameters params.
  *  No requirement that *params remains valid after this call.
@@ -31,16 +154,74 @@ struct CacheSimImpl {
 CacheSim *
 new_cache_sim(const CacheParams *params)
 {
+	const ReplacementPolicy *policy = get_replacement_policy(params->replacement);
+	if (!policy->is_supported(params->n_lines_per_set)) return NULL;
+	const PrefetchParams *prefetch = &params->prefetch;
+	if (prefetch->kind != NO_PF &&
+	    (prefetch->degree == 0 || prefetch->degree > PREFETCH_MAX_DEGREE ||
+	     policy->needs_future || params->n_victim_lines > 0)) {
+		//the future of prefetched blocks is unknown
+		return NULL;
+	}
+	if (params->n_victim_lines > VICTIM_MAX_LINES) return NULL;
+	unsigned n_sectors = (params->n_sectors == 0) ? 1 : params->n_sectors;
+	if ((n_sectors & (n_sectors - 1)) != 0 || n_sectors > SECTOR_MAX ||
+	    n_sectors > (1UL << params->n_blk_offset_bits) ||
+	    (n_sectors > 1 &&
+	     (prefetch->kind != NO_PF || params->n_victim_lines > 0))) {
+		return NULL;
+	}
+
 	CacheSim *cache = malloc_chk(sizeof(CacheSim));
 	cache->params = *params;
+	cache->blk_bits = params->n_blk_offset_bits;
+	cache->tag_shift = params->n_blk_offset_bits + params->n_set_index_bits;
+	cache->set_mask = ((unsigned long)1 << params->n_set_index_bits) - 1;
+	cache->n_sectors = n_sectors;
+	cache->sector_bits = params->n_blk_offset_bits - __builtin_ctz(n_sectors);
 	cache->clock = 0;
+	cache->policy = policy;
+	cache->kernel = select_kernel(params);
+	init_repl_state(&cache->repl_state, params->seed);
 
-	int n_sets = 1 << params->n_set_index_bits;
-	int E = params->n_lines_per_set;
+	size_t n_sets = (size_t)1 << params->n_set_index_bits;
+	size_t E = params->n_lines_per_set;
+	size_t mask_size = (E + MASK_BITS - 1)/MASK_BITS * sizeof(uint64_t);
+	cache->n_mask_words = mask_size / sizeof(uint64_t);
+	cache->tag_bytes = tag_bytes_for(params->n_mem_addr_bits -
+	                                 params->n_set_index_bits -
+	                                 params->n_blk_offset_bits);
+	//keep each set's metadata 8-byte aligned
+	cache->meta_size = (policy->meta_size(E) + 7) & ~(size_t)7;
 
-	cache->sets = malloc_chk(n_sets * sizeof(CacheLine *));
-	for (int i = 0; i < n_sets; i++) {
-		cache->sets[i] = calloc_chk(E, sizeof(CacheLine));
+	cache->dirty_offset = mask_size;
+	cache->prefetched_offset = 2 * mask_size;
+	cache->sectors_offset =
+		cache->prefetched_offset + (prefetch->kind != NO_PF ? mask_size : 0);
+	cache->meta_offset = cache->sectors_offset +
+		(n_sectors > 1 ? 2 * E * sizeof(uint64_t) : 0);
+	cache->tags_offset = cache->meta_offset + cache->meta_size;
+	alloc_arena(cache);
+	for (size_t i = 0; i < n_sets; i++) {
+		policy->init(&cache->arena[i*cache->set_size + cache->meta_offset], E);
+	}
+
+	cache->prefetcher = NULL;
+	cache->prefetch_times = NULL;
+	cache->next_uses = NULL;
+	cache->n_future = 0;
+	memset(&cache->traffic, 0, sizeof(cache->traffic));
+	memset(&cache->victim, 0, sizeof(cache->victim));
+	cache->victim.n_lines = params->n_victim_lines;
+	if (params->n_victim_lines > 0) {
+		cache->victim.blocks =
+			malloc_chk(params->n_victim_lines * sizeof(MemAddr));
+		cache->victim.stamps =
+			malloc_chk(params->n_victim_lines * sizeof(long));
+	}
+	if (prefetch->kind != NO_PF) {
+		cache->prefetcher = new_prefetcher(prefetch, params->n_blk_offset_bits);
+		cache->prefetch_times = calloc_chk(n_sets * E, sizeof(long));
 	}
 
 	return cache;
@@ -51,98 +232,1078 @@ void
 free_cache_sim(CacheSim *cache)
 {
 	if (!cache) return;
-	int n_sets = 1 << cache->params.n_set_index_bits;
-	for (int i = 0; i < n_sets; i++) {
-		free(cache->sets[i]);
-	}
-	free(cache->sets);
+	free(cache->arena_alloc);
+	free_prefetcher(cache->prefetcher);
+	free(cache->prefetch_times);
+	free(cache->next_uses);
+	free(cache->victim.blocks);
+	free(cache->victim.stamps);
 	free(cache);
 }
 
+size_t
+cache_sim_memory_size(const CacheSim *cache)
+{
+	size_t size = sizeof(CacheSim) + cache->arena_size + HOST_LINE_SIZE - 1;
+	if (cache->prefetcher) {
+		size += ((size_t)1 << cache->params.n_set_index_bits) *
+			cache->params.n_lines_per_set * sizeof(long);
+	}
+	size += cache->victim.n_lines * (sizeof(MemAddr) + sizeof(long));
+	return size + cache->n_future * sizeof(unsigned long);
+}
+
+size_t
+cache_sim_set_size(const CacheSim *cache)
+{
+	return cache->set_size;
+}
+
 /************************* Simulation Routine **************************/
 
-static unsigned long
-get_tag(CacheSim *cache, unsigned long addr)
+static inline unsigned long
+get_tag(const CacheSim *cache, unsigned long addr)
+{
+	return addr >> cache->tag_shift;
+}
+
+static inline unsigned long
+get_set_index(const CacheSim *cache, unsigned long addr)
 {
-	int shift = cache->params.n_blk_offset_bits + cache->params.n_set_index_bits;
-	return addr >> shift;
+	return (addr >> cache->blk_bits) & cache->set_mask;
 }
 
-static unsigned long
-get_set_index(CacheSim *cache, unsigned long addr)
+static inline unsigned long
+get_block_addr(const CacheSim *cache, unsigned long tag, unsigned long set_idx)
 {
-	unsigned long mask = ((unsigned long)1 << cache->params.n_set_index_bits) - 1;
-	return (addr >> cache->params.n_blk_offset_bits) & mask;
+	return (tag << cache->tag_shift) | (set_idx << cache->blk_bits);
 }
 
-static unsigned long
-get_block_addr(CacheSim *cache, unsigned long tag, unsigned long set_idx)
+static inline unsigned char *
+get_set(const CacheSim *cache, unsigned long set_idx)
 {
-	int shift = cache->params.n_blk_offset_bits + cache->params.n_set_index_bits;
-	return (tag << shift) | (set_idx << cache->params.n_blk_offset_bits);
+	return &cache->arena[set_idx * cache->set_size];
 }
 
-static int
-get_victim(CacheSim *cache, int set_idx)
+static inline uint64_t *
+get_valid(const CacheSim *cache, unsigned long set_idx)
 {
-	CacheLine *set = cache->sets[set_idx];
-	int E = cache->params.n_lines_per_set;
+	return (uint64_t *)get_set(cache, set_idx);
+}
 
-	if (cache->params.replacement == RANDOM_R)
-		return rand() % E;
+static inline uint64_t *
+get_dirty(const CacheSim *cache, unsigned long set_idx)
+{
+	return (uint64_t *)(get_set(cache, set_idx) + cache->dirty_offset);
+}
 
-	int victim = 0;
-	for (int w = 1; w < E; w++) {
-		if (cache->params.replacement == LRU_R && set[w].time < set[victim].time)
-			victim = w;
-		else if (cache->params.replacement == MRU_R && set[w].time > set[victim].time)
-			victim = w;
+static inline uint64_t *
+get_prefetched(const CacheSim *cache, unsigned long set_idx)
+{
+	return (uint64_t *)(get_set(cache, set_idx) + cache->prefetched_offset);
+}
+
+static inline uint64_t *
+get_sector_valid(const CacheSim *cache, unsigned long set_idx)
+{
+	return (uint64_t *)(get_set(cache, set_idx) + cache->sectors_offset);
+}
+
+static inline uint64_t *
+get_sector_dirty(const CacheSim *cache, unsigned long set_idx)
+{
+	return get_sector_valid(cache, set_idx) + cache->params.n_lines_per_set;
+}
+
+static inline void *
+get_meta(const CacheSim *cache, unsigned long set_idx)
+{
+	return get_set(cache, set_idx) + cache->meta_offset;
+}
+
+static inline void *
+get_tags(const CacheSim *cache, unsigned long set_idx)
+{
+	return get_set(cache, set_idx) + cache->tags_offset;
+}
+
+/** Return the tag of way w of set set_idx */
+static inline unsigned long
+load_tag(const CacheSim *cache, unsigned long set_idx, unsigned w)
+{
+	const void *tags = get_tags(cache, set_idx);
+	switch (cache->tag_bytes) {
+	case 1: return ((const uint8_t *)tags)[w];
+	case 2: return ((const uint16_t *)tags)[w];
+	case 4: return ((const uint32_t *)tags)[w];
+	default: return ((const uint64_t *)tags)[w];
 	}
-	return victim;
 }
 
-/** Return result for reading (is_write == false) or writing (is_write == true)
- *  access_addr from cache
+static inline void
+store_tag(CacheSim *cache, unsigned long set_idx, unsigned w, unsigned long tag)
+{
+	void *tags = get_tags(cache, set_idx);
+	switch (cache->tag_bytes) {
+	case 1: ((uint8_t *)tags)[w] = tag; break;
+	case 2: ((uint16_t *)tags)[w] = tag; break;
+	case 4: ((uint32_t *)tags)[w] = tag; break;
+	default: ((uint64_t *)tags)[w] = tag; break;
+	}
+}
+
+/** Move cache to an arena with tags wide enough for tag, which is
+ *  larger than cache->max_tag.
  */
-CacheResult
-cache_sim_result(CacheSim *cache, MemAddr access_addr, bool is_write)
+static void
+widen_tags(CacheSim *cache, unsigned long tag)
+{
+	CacheSim old = *cache;
+	cache->tag_bytes = tag_bytes_for(64 - __builtin_clzl(tag));
+	alloc_arena(cache);
+	size_t n_sets = (size_t)1 << cache->params.n_set_index_bits;
+	unsigned E = cache->params.n_lines_per_set;
+	for (size_t i = 0; i < n_sets; i++) {
+		//everything but the tags is independent of the tag width
+		memcpy(get_set(cache, i), get_set(&old, i), old.tags_offset);
+		for (unsigned w = 0; w < E; w++) {
+			store_tag(cache, i, w, load_tag(&old, i, w));
+		}
+	}
+	free(old.arena_alloc);
+}
+
+/** The match_tagsN() functions return a mask with bit i set iff
+ *  tags[i] == tag for 0 <= i < n, where n <= MASK_BITS.
+ */
+
+static inline uint64_t
+match_tags8(const uint8_t *tags, unsigned n, uint8_t tag)
+{
+	uint64_t match = 0;
+	unsigned i = 0;
+#if defined(__AVX2__)
+	__m256i key32 = _mm256_set1_epi8((char)tag);
+	for (; i + 32 <= n; i += 32) {
+		__m256i t = _mm256_loadu_si256((const __m256i *)&tags[i]);
+		uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(t, key32));
+		match |= (uint64_t)eq << i;
+	}
+#endif
+#if defined(__SSE2__)
+	__m128i key16 = _mm_set1_epi8((char)tag);
+	for (; i + 16 <= n; i += 16) {
+		__m128i t = _mm_loadu_si128((const __m128i *)&tags[i]);
+		match |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(t, key16)) << i;
+	}
+#endif
+	for (; i < n; i++) {
+		match |= (uint64_t)(tags[i] == tag) << i;
+	}
+	return match;
+}
+
+static inline uint64_t
+match_tags16(const uint16_t *tags, unsigned n, uint16_t tag)
+{
+	uint64_t match = 0;
+	unsigned i = 0;
+#if defined(__SSE2__)
+	//pack the 16-bit compare results to bytes to get 1 mask bit per lane
+	__m128i key8 = _mm_set1_epi16((short)tag);
+	for (; i + 8 <= n; i += 8) {
+		__m128i t = _mm_loadu_si128((const __m128i *)&tags[i]);
+		__m128i eq = _mm_packs_epi16(_mm_cmpeq_epi16(t, key8), _mm_setzero_si128());
+		match |= (uint64_t)(_mm_movemask_epi8(eq) & 0xff) << i;
+	}
+#endif
+	for (; i < n; i++) {
+		match |= (uint64_t)(tags[i] == tag) << i;
+	}
+	return match;
+}
+
+static inline uint64_t
+match_tags32(const uint32_t *tags, unsigned n, uint32_t tag)
+{
+	uint64_t match = 0;
+	unsigned i = 0;
+#if defined(__AVX2__)
+	__m256i key8 = _mm256_set1_epi32((int)tag);
+	for (; i + 8 <= n; i += 8) {
+		__m256i t = _mm256_loadu_si256((const __m256i *)&tags[i]);
+		__m256i eq = _mm256_cmpeq_epi32(t, key8);
+		match |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(eq)) << i;
+	}
+#endif
+#if defined(__SSE2__)
+	__m128i key4 = _mm_set1_epi32((int)tag);
+	for (; i + 4 <= n; i += 4) {
+		__m128i t = _mm_loadu_si128((const __m128i *)&tags[i]);
+		__m128i eq = _mm_cmpeq_epi32(t, key4);
+		match |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+	}
+#endif
+	for (; i < n; i++) {
+		match |= (uint64_t)(tags[i] == tag) << i;
+	}
+	return match;
+}
+
+static inline uint64_t
+match_tags64(const uint64_t *tags, unsigned n, uint64_t tag)
+{
+	uint64_t match = 0;
+	unsigned i = 0;
+#if defined(__AVX2__)
+	__m256i key4 = _mm256_set1_epi64x((long long)tag);
+	for (; i + 4 <= n; i += 4) {
+		__m256i t = _mm256_loadu_si256((const __m256i *)&tags[i]);
+		__m256i eq = _mm256_cmpeq_epi64(t, key4);
+		match |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+	}
+#endif
+#if defined(__SSE2__)
+	//SSE2 has no 64-bit compare: compare 32-bit halves and require
+	//both halves of a lane to be equal
+	__m128i key2 = _mm_set1_epi64x((long long)tag);
+	for (; i + 2 <= n; i += 2) {
+		__m128i t = _mm_loadu_si128((const __m128i *)&tags[i]);
+		__m128i eq32 = _mm_cmpeq_epi32(t, key2);
+		__m128i eq = _mm_and_si128(eq32,
+		                           _mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+		match |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+	}
+#endif
+	for (; i < n; i++) {
+		match |= (uint64_t)(tags[i] == tag) << i;
+	}
+	return match;
+}
+
+/** Return a mask with bit i set iff way base + i of set set_idx holds
+ *  tag for 0 <= i < n, where n <= MASK_BITS.
+ */
+static inline uint64_t
+match_tags(const CacheSim *cache, unsigned long set_idx, unsigned base,
+           unsigned n, unsigned long tag)
+{
+	const void *tags = get_tags(cache, set_idx);
+	switch (cache->tag_bytes) {
+	case 1: return match_tags8(&((const uint8_t *)tags)[base], n, tag);
+	case 2: return match_tags16(&((const uint16_t *)tags)[base], n, tag);
+	case 4: return match_tags32(&((const uint32_t *)tags)[base], n, tag);
+	default: return match_tags64(&((const uint64_t *)tags)[base], n, tag);
+	}
+}
+
+/** Return the way in set set_idx of E ways, held in n_words mask
+ *  words, which holds tag, -1 if none.
+ */
+static inline int
+find_way_in(const CacheSim *cache, unsigned long set_idx, unsigned long tag,
+            unsigned E, unsigned n_words)
+{
+	if (tag > cache->max_tag) return -1;  //wider than any stored tag
+	const uint64_t *valid = get_valid(cache, set_idx);
+	for (unsigned k = 0; k < n_words; k++) {
+		unsigned base = k * MASK_BITS;
+		unsigned n = (E - base < MASK_BITS) ? E - base : MASK_BITS;
+		uint64_t hits = match_tags(cache, set_idx, base, n, tag) & valid[k];
+		if (hits) return base + __builtin_ctzll(hits);
+	}
+	return -1;
+}
+
+/** Return the way in set set_idx which holds tag, -1 if none */
+static inline int
+find_way(const CacheSim *cache, unsigned long set_idx, unsigned long tag)
+{
+	return find_way_in(cache, set_idx, tag, cache->params.n_lines_per_set,
+	                   cache->n_mask_words);
+}
+
+/** Return the first invalid way in set set_idx of E ways, held in
+ *  n_words mask words, -1 if all are valid.
+ */
+static inline int
+find_invalid_way_in(const CacheSim *cache, unsigned long set_idx, unsigned E,
+                    unsigned n_words)
+{
+	const uint64_t *valid = get_valid(cache, set_idx);
+	for (unsigned k = 0; k < n_words; k++) {
+		uint64_t invalid = ~valid[k];
+		if (invalid) {
+			unsigned w = k * MASK_BITS + __builtin_ctzll(invalid);
+			return (w < E) ? (int)w : -1;
+		}
+	}
+	return -1;
+}
+
+static inline int
+find_invalid_way(const CacheSim *cache, unsigned long set_idx)
+{
+	return find_invalid_way_in(cache, set_idx, cache->params.n_lines_per_set,
+	                           cache->n_mask_words);
+}
+
+static inline void
+set_bit(uint64_t *mask, unsigned w, bool value)
+{
+	uint64_t bit = (uint64_t)1 << (w % MASK_BITS);
+	if (value) {
+		mask[w / MASK_BITS] |= bit;
+	}
+	else {
+		mask[w / MASK_BITS] &= ~bit;
+	}
+}
+
+static inline bool
+get_bit(const uint64_t *mask, unsigned w)
+{
+	return (mask[w / MASK_BITS] >> (w % MASK_BITS)) & 1;
+}
+
+/*************************** Memory Traffic ****************************/
+
+/** Account for reading n_bytes of a block from memory */
+static inline void
+read_memory(CacheSim *cache, unsigned long n_bytes)
+{
+	cache->traffic.block_reads++;
+	cache->traffic.bytes_fetched += n_bytes;
+}
+
+/** Account for writing n_bytes of a dirty block back to memory */
+static inline void
+write_back(CacheSim *cache, unsigned long n_bytes)
+{
+	cache->traffic.block_writes++;
+	cache->traffic.bytes_written_back += n_bytes;
+}
+
+/***************************** Prefetching *****************************/
+
+/** Clear the prefetched tag of way w of set set_idx, returning true if
+ *  it was set.
+ */
+static bool
+untag_prefetched(CacheSim *cache, unsigned long set_idx, unsigned w)
+{
+	uint64_t *prefetched = get_prefetched(cache, set_idx);
+	if (!get_bit(prefetched, w)) return false;
+	set_bit(prefetched, w, false);
+	return true;
+}
+
+/** Bring the block containing addr into cache as a tagged prefetch
+ *  unless it is already present.
+ */
+static void
+prefetch_fill(CacheSim *cache, MemAddr addr)
+{
+	unsigned m = cache->params.n_mem_addr_bits;
+	if (m < 8*sizeof(MemAddr) && (addr >> m) != 0) return;
+	unsigned long set_idx = get_set_index(cache, addr);
+	unsigned long tag = get_tag(cache, addr);
+	if (find_way(cache, set_idx, tag) >= 0) return;
+
+	unsigned E = cache->params.n_lines_per_set;
+	uint64_t *dirty = get_dirty(cache, set_idx);
+	void *meta = get_meta(cache, set_idx);
+	PrefetchStats *stats = prefetcher_stats(cache->prefetcher);
+	int w = find_invalid_way(cache, set_idx);
+	if (w >= 0) {
+		set_bit(get_valid(cache, set_idx), w, true);
+	}
+	else {
+		w = cache->policy->victim(meta, E, &cache->repl_state);
+		if (untag_prefetched(cache, set_idx, w)) {
+			stats->useless++;
+		}
+		else {
+			MemAddr victim =
+				get_block_addr(cache, load_tag(cache, set_idx, w), set_idx);
+			prefetcher_note_eviction(cache->prefetcher, victim);
+		}
+		if (get_bit(dirty, w)) {
+			stats->dirty_evictions++;
+			write_back(cache, 1UL << cache->blk_bits);
+		}
+	}
+	store_tag(cache, set_idx, w, tag);
+	set_bit(dirty, w, false);
+	set_bit(get_prefetched(cache, set_idx), w, true);
+	cache->prefetch_times[set_idx*E + w] = cache->clock;
+	cache->policy->fill(meta, E, w, &cache->repl_state);
+	stats->issued++;
+	read_memory(cache, 1UL << cache->blk_bits);
+}
+
+/** Train the prefetcher on a demand access to addr and perform the
+ *  resulting prefetches.
+ */
+static void
+run_prefetcher(CacheSim *cache, MemAddr addr, bool is_miss,
+               bool is_prefetch_hit)
+{
+	MemAddr addrs[PREFETCH_MAX_DEGREE];
+	unsigned n =
+		prefetcher_train(cache->prefetcher, addr, is_miss, is_prefetch_hit, addrs);
+	for (unsigned i = 0; i < n; i++) {
+		prefetch_fill(cache, addrs[i]);
+	}
+}
+
+/** Count a demand hit on way w of set set_idx against the prefetch
+ *  which filled it, if any.  Return true if it did.
+ */
+static bool
+prefetch_hit(CacheSim *cache, unsigned long set_idx, unsigned w)
+{
+	if (!untag_prefetched(cache, set_idx, w)) return false;
+	PrefetchStats *stats = prefetcher_stats(cache->prefetcher);
+	stats->useful++;
+	long issued = cache->prefetch_times[set_idx * cache->params.n_lines_per_set + w];
+	if (prefetcher_is_late(cache->prefetcher, issued, cache->clock)) {
+		stats->late++;
+	}
+	return true;
+}
+
+/**************************** Victim Cache *****************************/
+
+/** Remove the block at block_addr from the victim cache of cache,
+ *  returning true and setting *is_dirty if it was there.
+ */
+static bool
+victim_take(CacheSim *cache, MemAddr block_addr, bool *is_dirty)
+{
+	VictimCache *victim = &cache->victim;
+	for (uint64_t v = victim->valid; v != 0; v &= v - 1) {
+		unsigned i = __builtin_ctzll(v);
+		if (victim->blocks[i] == block_addr) {
+			uint64_t bit = (uint64_t)1 << i;
+			*is_dirty = (victim->dirty & bit) != 0;
+			victim->valid &= ~bit;
+			return true;
+		}
+	}
+	return false;
+}
+
+/** Put the block at block_addr evicted from cache into its victim
+ *  cache, writing back the least recently used victim if it is dirty
+ *  and there is no free line.
+ */
+static void
+victim_put(CacheSim *cache, MemAddr block_addr, bool is_dirty)
+{
+	VictimCache *victim = &cache->victim;
+	uint64_t all = (victim->n_lines == MASK_BITS)
+		? ~(uint64_t)0
+		: ((uint64_t)1 << victim->n_lines) - 1;
+	uint64_t free_lines = all & ~victim->valid;
+	unsigned i;
+	if (free_lines != 0) {
+		i = __builtin_ctzll(free_lines);
+	}
+	else {
+		i = 0;
+		for (unsigned k = 1; k < victim->n_lines; k++) {
+			if (victim->stamps[k] < victim->stamps[i]) i = k;
+		}
+		if ((victim->dirty >> i) & 1) write_back(cache, 1UL << cache->blk_bits);
+	}
+	uint64_t bit = (uint64_t)1 << i;
+	victim->blocks[i] = block_addr;
+	victim->stamps[i] = cache->clock;
+	victim->valid |= bit;
+	if (is_dirty) {
+		victim->dirty |= bit;
+	}
+	else {
+		victim->dirty &= ~bit;
+	}
+}
+
+/** Account for the eviction of the block at block_addr from cache,
+ *  with n_dirty_bytes dirty bytes.
+ */
+static inline void
+evict_block(CacheSim *cache, MemAddr block_addr, unsigned long n_dirty_bytes)
+{
+	if (cache->victim.n_lines > 0) {
+		victim_put(cache, block_addr, n_dirty_bytes > 0);
+	}
+	else if (n_dirty_bytes > 0) {
+		write_back(cache, n_dirty_bytes);
+	}
+}
+
+/*************************** Demand Accesses ***************************/
+
+/** The access routines below take a replacement and an E which are
+ *  compile-time constants in the specialized kernels, so that policy
+ *  operations are inlined and loops over ways unrolled.  ANY_R and
+ *  ANY_E select the generic path, which calls the policy through
+ *  cache->policy and reads E from cache->params.
+ */
+enum { ANY_R = -1, ANY_E = 0 };
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+static ALWAYS_INLINE void
+policy_touch(CacheSim *cache, int repl, void *meta, unsigned E, unsigned w)
+{
+	if (repl == ANY_R) {
+		cache->policy->touch(meta, E, w, &cache->repl_state);
+	}
+	else {
+		repl_touch(repl, meta, E, w, &cache->repl_state);
+	}
+}
+
+static ALWAYS_INLINE void
+policy_fill(CacheSim *cache, int repl, void *meta, unsigned E, unsigned w)
+{
+	if (repl == ANY_R) {
+		cache->policy->fill(meta, E, w, &cache->repl_state);
+	}
+	else {
+		repl_fill(repl, meta, E, w, &cache->repl_state);
+	}
+}
+
+static ALWAYS_INLINE unsigned
+policy_victim(CacheSim *cache, int repl, void *meta, unsigned E)
+{
+	return (repl == ANY_R)
+		? cache->policy->victim(meta, E, &cache->repl_state)
+		: repl_victim(repl, meta, E, &cache->repl_state);
+}
+
+/** Simulate an access with replacement repl (or ANY_R) in a cache with
+ *  fixed_E ways (or ANY_E).  Specialized kernels are only used without
+ *  a prefetcher.
+ */
+static ALWAYS_INLINE CacheResult
+sim_access(CacheSim *cache, MemAddr access_addr, bool is_write, int repl,
+           unsigned fixed_E)
 {
-	long tick = ++cache->clock;
+	++cache->clock;
 	unsigned long set_idx = get_set_index(cache, access_addr);
 	unsigned long tag = get_tag(cache, access_addr);
-	CacheLine *set = cache->sets[set_idx];
-	int E = cache->params.n_lines_per_set;
+	if (__builtin_expect(tag > cache->max_tag, 0)) widen_tags(cache, tag);
+	if ((repl == ANY_R || repl == OPT_R) && cache->next_uses) {
+		size_t i = cache->clock - 1;
+		cache->repl_state.next_use =
+			(i < cache->n_future) ? cache->next_uses[i] : ULONG_MAX;
+	}
+	unsigned E = (fixed_E == ANY_E) ? cache->params.n_lines_per_set : fixed_E;
+	unsigned n_words = (fixed_E == ANY_E) ? cache->n_mask_words : 1;
+	Prefetcher *prefetcher = (repl == ANY_R) ? cache->prefetcher : NULL;
+	uint64_t *dirty = get_dirty(cache, set_idx);
+	void *meta = get_meta(cache, set_idx);
 
 	CacheResult result = { .access_addr = access_addr };
 
-	for (int w = 0; w < E; w++) {
-		if (set[w].valid && set[w].tag == tag) {
-			set[w].time = tick;
-			if (is_write) set[w].dirty = true;
-			result.status = CACHE_HIT;
-			return result;
+	bool is_write_back = cache->params.write_policy == WRITE_BACK_W;
+	bool is_no_allocate =
+		cache->params.allocate_policy == NO_WRITE_ALLOCATE_A;
+	bool is_sectored = cache->n_sectors > 1;
+	uint64_t sector_bit = (uint64_t)1 <<
+		((access_addr >> cache->sector_bits) & (cache->n_sectors - 1));
+	int w = find_way_in(cache, set_idx, tag, E, n_words);
+	if (w >= 0) {
+		policy_touch(cache, repl, meta, E, w);
+		result.status = CACHE_HIT;
+		if (is_sectored) {
+			uint64_t *sector_valid = get_sector_valid(cache, set_idx);
+			if (!(sector_valid[w] & sector_bit)) {
+				result.status = CACHE_MISS_WITHOUT_REPLACE;
+				if (is_write && is_no_allocate) {
+					cache->traffic.word_writes++;
+					return result;
+				}
+				sector_valid[w] |= sector_bit;
+				read_memory(cache, 1UL << cache->sector_bits);
+			}
+		}
+		if (is_write) {
+			if (is_write_back) {
+				set_bit(dirty, w, true);
+				if (is_sectored) get_sector_dirty(cache, set_idx)[w] |= sector_bit;
+			}
+			else {
+				cache->traffic.word_writes++;
+			}
+		}
+		if (prefetcher) {
+			run_prefetcher(cache, access_addr, false,
+			               prefetch_hit(cache, set_idx, w));
 		}
+		return result;
 	}
 
-	for (int w = 0; w < E; w++) {
-		if (!set[w].valid) {
-			set[w].valid = true;
-			set[w].dirty = is_write;
-			set[w].tag = tag;
-			set[w].time = tick;
-			result.status = CACHE_MISS_WITHOUT_REPLACE;
-			return result;
+	if (prefetcher) {
+		prefetcher_note_miss(prefetcher, access_addr);
+		prefetcher_stream_hit(prefetcher, access_addr, cache->clock);
+	}
+
+	MemAddr block_addr = access_addr & ~(((MemAddr)1 << cache->blk_bits) - 1);
+	bool is_victim_dirty = false;
+	bool is_victim_hit = cache->victim.n_lines > 0 &&
+		victim_take(cache, block_addr, &is_victim_dirty);
+	if (is_write && !is_victim_hit && is_no_allocate) {
+		cache->traffic.word_writes++;
+		result.status = CACHE_MISS_WITHOUT_REPLACE;
+		if (prefetcher) run_prefetcher(cache, access_addr, true, false);
+		return result;
+	}
+
+	w = find_invalid_way_in(cache, set_idx, E, n_words);
+	if (w >= 0) {
+		set_bit(get_valid(cache, set_idx), w, true);
+		result.status = CACHE_MISS_WITHOUT_REPLACE;
+	}
+	else {
+		w = policy_victim(cache, repl, meta, E);
+		result.status = CACHE_MISS_WITH_REPLACE;
+		result.replace_addr =
+			get_block_addr(cache, load_tag(cache, set_idx, w), set_idx);
+		result.is_dirty = get_bit(dirty, w);
+		unsigned long n_dirty_bytes = !result.is_dirty
+			? 0
+			: is_sectored
+			? __builtin_popcountll(get_sector_dirty(cache, set_idx)[w]) *
+			  (1UL << cache->sector_bits)
+			: 1UL << cache->blk_bits;
+		evict_block(cache, result.replace_addr, n_dirty_bytes);
+		if (prefetcher && untag_prefetched(cache, set_idx, w)) {
+			prefetcher_stats(prefetcher)->useless++;
+		}
+	}
+	if (is_victim_hit) {
+		cache->traffic.victim_hits++;
+	}
+	else {
+		read_memory(cache, 1UL << cache->sector_bits);
+	}
+	store_tag(cache, set_idx, w, tag);
+	set_bit(dirty, w, is_victim_dirty || (is_write && is_write_back));
+	if (is_sectored) {
+		get_sector_valid(cache, set_idx)[w] = sector_bit;
+		get_sector_dirty(cache, set_idx)[w] =
+			(is_write && is_write_back) ? sector_bit : 0;
+	}
+	if (is_write && !is_write_back) cache->traffic.word_writes++;
+	policy_fill(cache, repl, meta, E, w);
+
+	if (prefetcher) run_prefetcher(cache, access_addr, true, false);
+	return result;
+}
+
+static ALWAYS_INLINE void
+sim_accesses(CacheSim *cache, size_t n, const MemAddr access_addrs[],
+             const bool is_writes[], CacheResult results[], int repl,
+             unsigned fixed_E)
+{
+	enum { PREFETCH_DIST = 4 };
+	for (size_t i = 0; i < n; i++) {
+		if (i + PREFETCH_DIST < n) {
+			//pull in the set for a later access while this one is simulated
+			unsigned long s = get_set_index(cache, access_addrs[i + PREFETCH_DIST]);
+			const unsigned char *set = get_set(cache, s);
+			__builtin_prefetch(set);
+			if (cache->set_size > HOST_LINE_SIZE) {
+				__builtin_prefetch(set + cache->tags_offset);
+			}
 		}
+		results[i] =
+			sim_access(cache, access_addrs[i], is_writes[i], repl, fixed_E);
 	}
+}
 
-	int v = get_victim(cache, set_idx);
-	result.status = CACHE_MISS_WITH_REPLACE;
-	result.replace_addr = get_block_addr(cache, set[v].tag, set_idx);
-	result.is_dirty = set[v].dirty;
+/***************************** Kernels *********************************/
 
-	set[v].tag = tag;
-	set[v].dirty = is_write;
-	set[v].time = tick;
+static void
+generic_kernel(CacheSim *cache, size_t n, const MemAddr access_addrs[],
+               const bool is_writes[], CacheResult results[])
+{
+	sim_accesses(cache, n, access_addrs, is_writes, results, ANY_R, ANY_E);
+}
+
+/** Define kernel_R_E() for replacement R and E ways */
+#define DEFINE_KERNEL(R, E) \
+	static void \
+	kernel_##R##_##E(CacheSim *cache, size_t n, const MemAddr access_addrs[], \
+	                 const bool is_writes[], CacheResult results[]) \
+	{ \
+		sim_accesses(cache, n, access_addrs, is_writes, results, R, E); \
+	}
 
+//the specialized E's are 1 << i for 0 <= i < N_KERNEL_WAYS
+enum { N_KERNEL_WAYS = 5 };
+
+#define DEFINE_KERNELS(R) \
+	DEFINE_KERNEL(R, 1) DEFINE_KERNEL(R, 2) DEFINE_KERNEL(R, 4) \
+	DEFINE_KERNEL(R, 8) DEFINE_KERNEL(R, 16)
+
+#define KERNELS_ROW(R) \
+	[R] = { kernel_##R##_1, kernel_##R##_2, kernel_##R##_4, \
+	        kernel_##R##_8, kernel_##R##_16 }
+
+DEFINE_KERNELS(LRU_R)
+DEFINE_KERNELS(MRU_R)
+DEFINE_KERNELS(RANDOM_R)
+DEFINE_KERNELS(PLRU_R)
+DEFINE_KERNELS(SRRIP_R)
+DEFINE_KERNELS(BRRIP_R)
+DEFINE_KERNELS(LFU_R)
+DEFINE_KERNELS(OPT_R)
+
+static ResultsKernel *const KERNELS[][N_KERNEL_WAYS] = {
+	KERNELS_ROW(LRU_R),
+	KERNELS_ROW(MRU_R),
+	KERNELS_ROW(RANDOM_R),
+	KERNELS_ROW(PLRU_R),
+	KERNELS_ROW(SRRIP_R),
+	KERNELS_ROW(BRRIP_R),
+	KERNELS_ROW(LFU_R),
+	KERNELS_ROW(OPT_R),
+};
+
+/** Return the kernel specialized for *params, the generic kernel if
+ *  there is none.
+ */
+static ResultsKernel *
+select_kernel(const CacheParams *params)
+{
+	unsigned E = params->n_lines_per_set;
+	bool is_kernel_E =
+		E > 0 && (E & (E - 1)) == 0 && E < (1U << N_KERNEL_WAYS);
+	if (params->prefetch.kind != NO_PF || !is_kernel_E ||
+	    params->replacement >= sizeof(KERNELS)/sizeof(KERNELS[0])) {
+		return generic_kernel;
+	}
+	return KERNELS[params->replacement][__builtin_ctz(E)];
+}
+
+void
+cache_sim_set_future(CacheSim *cache, size_t n, const MemAddr access_addrs[])
+{
+	assert(cache->clock == 0);
+	free(cache->next_uses);
+	cache->next_uses = malloc_chk((n ? n : 1) * sizeof(unsigned long));
+	cache->n_future = n;
+	//backward pass, with next_access holding the index of the next
+	//access to each block seen so far
+	unsigned blk_bits = cache->params.n_blk_offset_bits;
+	HashMap *next_access = new_hash_map(1024);
+	for (size_t i = n; i-- > 0; ) {
+		bool is_new;
+		unsigned long *next =
+			hash_map_put(next_access, access_addrs[i] >> blk_bits, &is_new);
+		cache->next_uses[i] = is_new ? ULONG_MAX : *next;
+		*next = i;
+	}
+	free_hash_map(next_access);
+}
+
+/** Return result for reading (is_write == false) or writing (is_write == true)
+ *  access_addr from cache
+ */
+CacheResult
+cache_sim_result(CacheSim *cache, MemAddr access_addr, bool is_write)
+{
+	CacheResult result;
+	cache->kernel(cache, 1, &access_addr, &is_write, &result);
 	return result;
-}
\ No newline at end of file
+}
+
+/** Batched version of cache_sim_result(): for 0 <= i < n, set
+ *  results[i] to the result of accessing access_addrs[i] for
+ *  writing if is_writes[i] is true, for reading otherwise.
+ */
+void
+cache_sim_results(CacheSim *cache, size_t n,
+                  const MemAddr access_addrs[], const bool is_writes[],
+                  CacheResult results[])
+{
+	cache->kernel(cache, n, access_addrs, is_writes, results);
+}
+
+unsigned long
+cache_sim_set_index(const CacheSim *cache, MemAddr addr)
+{
+	return get_set_index(cache, addr);
+}
+
+bool
+cache_sim_probe(CacheSim *cache, MemAddr addr, bool *is_dirty)
+{
+	unsigned long set_idx = get_set_index(cache, addr);
+	int w = find_way(cache, set_idx, get_tag(cache, addr));
+	if (w < 0) return false;
+	if (is_dirty) *is_dirty = get_bit(get_dirty(cache, set_idx), w);
+	return true;
+}
+
+bool
+cache_sim_invalidate(CacheSim *cache, MemAddr addr, bool *is_dirty)
+{
+	unsigned long set_idx = get_set_index(cache, addr);
+	int w = find_way(cache, set_idx, get_tag(cache, addr));
+	if (w < 0) return false;
+	uint64_t *dirty = get_dirty(cache, set_idx);
+	if (is_dirty) *is_dirty = get_bit(dirty, w);
+	set_bit(dirty, w, false);
+	set_bit(get_valid(cache, set_idx), w, false);
+	if (cache->prefetcher && untag_prefetched(cache, set_idx, w)) {
+		prefetcher_stats(cache->prefetcher)->useless++;
+	}
+	cache->policy->remove(get_meta(cache, set_idx),
+	                      cache->params.n_lines_per_set, w);
+	return true;
+}
+
+bool
+cache_sim_clean(CacheSim *cache, MemAddr addr)
+{
+	unsigned long set_idx = get_set_index(cache, addr);
+	int w = find_way(cache, set_idx, get_tag(cache, addr));
+	if (w < 0) return false;
+	uint64_t *dirty = get_dirty(cache, set_idx);
+	bool is_dirty = get_bit(dirty, w);
+	set_bit(dirty, w, false);
+	if (cache->n_sectors > 1) get_sector_dirty(cache, set_idx)[w] = 0;
+	return is_dirty;
+}
+
+void
+cache_sim_prefetch_stats(const CacheSim *cache, PrefetchStats *stats)
+{
+	if (cache->prefetcher) {
+		*stats = *prefetcher_stats(cache->prefetcher);
+	}
+	else {
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
+void
+cache_sim_traffic(const CacheSim *cache, CacheTraffic *traffic)
+{
+	*traffic = cache->traffic;
+}
+
+/************************** Saving / Loading ***************************/
+
+/** A saved state is a StateHeader followed by the CacheSim itself,
+ *  whose pointers are ignored on loading, its arena, the blocks and
+ *  stamps of its victim cache, and with a prefetcher its
+ *  prefetch_times[] and the prefetcher_save() state.
+ */
+static const char STATE_MAGIC[4] = { 'C', 'S', 'S', 'T' };
+
+enum { STATE_VERSION = 1 };
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint64_t impl_size;        // sizeof(CacheSim) of the saving build
+	uint64_t size;             // # of bytes in the file
+} StateHeader;
+
+/** Return the # of bytes of the saved state of cache */
+static size_t
+state_size(const CacheSim *cache)
+{
+	size_t size = sizeof(StateHeader) + sizeof(CacheSim) + cache->arena_size +
+		cache->victim.n_lines * (sizeof(MemAddr) + sizeof(long));
+	if (cache->prefetcher) {
+		size += ((size_t)1 << cache->params.n_set_index_bits) *
+			cache->params.n_lines_per_set * sizeof(long);
+		size += prefetcher_save_size(cache->prefetcher);
+	}
+	return size;
+}
+
+/** Copy the n bytes at src to p, returning the end of the copy */
+static unsigned char *
+put_bytes(unsigned char *p, const void *src, size_t n)
+{
+	if (n > 0) memcpy(p, src, n);
+	return p + n;
+}
+
+/** Copy the n bytes at p to dest, returning the end of the source */
+static const unsigned char *
+get_bytes(const unsigned char *p, void *dest, size_t n)
+{
+	if (n > 0) memcpy(dest, p, n);
+	return p + n;
+}
+
+bool
+cache_sim_save(const CacheSim *cache, const char *path)
+{
+	if (cache->policy->needs_future) {
+		errno = EINVAL;
+		return false;
+	}
+	size_t size = state_size(cache);
+	unsigned char *buf = malloc_chk(size);
+	StateHeader header = {
+		.version = STATE_VERSION, .impl_size = sizeof(CacheSim), .size = size,
+	};
+	memcpy(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+	unsigned char *p = put_bytes(buf, &header, sizeof(header));
+	p = put_bytes(p, cache, sizeof(CacheSim));
+	p = put_bytes(p, cache->arena, cache->arena_size);
+	const VictimCache *victim = &cache->victim;
+	p = put_bytes(p, victim->blocks, victim->n_lines * sizeof(MemAddr));
+	p = put_bytes(p, victim->stamps, victim->n_lines * sizeof(long));
+	if (cache->prefetcher) {
+		size_t n_lines = ((size_t)1 << cache->params.n_set_index_bits) *
+			cache->params.n_lines_per_set;
+		p = put_bytes(p, cache->prefetch_times, n_lines * sizeof(long));
+		prefetcher_save(cache->prefetcher, p);
+	}
+
+	bool is_ok = false;
+	int fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	if (fd >= 0) {
+		const unsigned char *q = buf;
+		size_t n_left = size;
+		while (n_left > 0) {
+			ssize_t n = write(fd, q, n_left);
+			if (n < 0 && errno == EINTR) continue;
+			if (n < 0) break;
+			q += n;
+			n_left -= n;
+		}
+		is_ok = (n_left == 0);
+		int err = errno;
+		if (close(fd) != 0 && is_ok) {
+			is_ok = false;
+			err = errno;
+		}
+		errno = err;
+	}
+	free(buf);
+	return is_ok;
+}
+
+/** Return true iff a and b specify the same cache, apart from their
+ *  seeds.
+ */
+static bool
+is_same_cache(const CacheParams *a, const CacheParams *b)
+{
+	unsigned a_sectors = (a->n_sectors == 0) ? 1 : a->n_sectors;
+	unsigned b_sectors = (b->n_sectors == 0) ? 1 : b->n_sectors;
+	bool is_same_prefetch = a->prefetch.kind == b->prefetch.kind &&
+		(a->prefetch.kind == NO_PF ||
+		 (a->prefetch.degree == b->prefetch.degree &&
+		  a->prefetch.latency == b->prefetch.latency));
+	return a->n_mem_addr_bits == b->n_mem_addr_bits &&
+		a->n_set_index_bits == b->n_set_index_bits &&
+		a->n_blk_offset_bits == b->n_blk_offset_bits &&
+		a->n_lines_per_set == b->n_lines_per_set &&
+		a->replacement == b->replacement && is_same_prefetch &&
+		a->write_policy == b->write_policy &&
+		a->allocate_policy == b->allocate_policy &&
+		a->n_victim_lines == b->n_victim_lines && a_sectors == b_sectors;
+}
+
+/** Restore into cache, a new cache with the parameters of saved, the
+ *  state in the size bytes at map whose CacheSim is saved.  Returns
+ *  false if the saved tag size or size does not match.
+ */
+static bool
+restore_state(CacheSim *cache, const CacheSim *saved,
+              const unsigned char *map, size_t size)
+{
+	//tags only ever widen, to a size returned by tag_bytes_for()
+	unsigned tag_bytes = saved->tag_bytes;
+	bool is_tag_size = tag_bytes == 1 || tag_bytes == 2 ||
+		tag_bytes == 4 || tag_bytes == 8;
+	if (!is_tag_size || tag_bytes < cache->tag_bytes) return false;
+	if (saved->tag_bytes != cache->tag_bytes) {
+		//the saved cache had widened its tags
+		free(cache->arena_alloc);
+		cache->tag_bytes = saved->tag_bytes;
+		alloc_arena(cache);
+	}
+	if (cache->arena_size != saved->arena_size ||
+	    state_size(cache) != size) {
+		return false;
+	}
+	cache->clock = saved->clock;
+	cache->repl_state = saved->repl_state;
+	VictimCache *victim = &cache->victim;
+	victim->valid = saved->victim.valid;
+	victim->dirty = saved->victim.dirty;
+	const unsigned char *p = map + sizeof(StateHeader) + sizeof(CacheSim);
+	p = get_bytes(p, cache->arena, cache->arena_size);
+	p = get_bytes(p, victim->blocks, victim->n_lines * sizeof(MemAddr));
+	p = get_bytes(p, victim->stamps, victim->n_lines * sizeof(long));
+	if (cache->prefetcher) {
+		size_t n_lines = ((size_t)1 << cache->params.n_set_index_bits) *
+			cache->params.n_lines_per_set;
+		p = get_bytes(p, cache->prefetch_times, n_lines * sizeof(long));
+		prefetcher_load(cache->prefetcher, p);
+	}
+	return true;
+}
+
+CacheSim *
+cache_sim_load(const char *path, const CacheParams *params)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	size_t size = st.st_size;
+	if (size < sizeof(StateHeader) + sizeof(CacheSim)) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	const unsigned char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int err = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		errno = err;
+		return NULL;
+	}
+
+	StateHeader header;
+	CacheSim saved;
+	memcpy(&header, map, sizeof(header));
+	memcpy(&saved, map + sizeof(header), sizeof(saved));
+	CacheSim *cache = NULL;
+	if (memcmp(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC)) == 0 &&
+	    header.version == STATE_VERSION &&
+	    header.impl_size == sizeof(CacheSim) && header.size == size &&
+	    is_same_cache(&saved.params, params)) {
+		cache = new_cache_sim(params);
+	}
+	if (cache && (cache->policy->needs_future ||
+	              !restore_state(cache, &saved, map, size))) {
+		free_cache_sim(cache);
+		cache = NULL;
+	}
+	munmap((void *)map, size);
+	if (!cache) errno = EINVAL;
+	return cache;
+}
@@ -2,6 +2,7 @@
 #define CACHE_SIM_
 
 #include <stdbool.h>
+#include <stddef.h>
 
 /** Opaque implementation */
 typedef struct CacheSimImpl CacheSim;
@@ -10,15 +11,61 @@ typedef struct CacheSimImpl CacheSim;
 typedef enum {
   LRU_R,         /** Least Recently Used */
   MRU_R,         /** Most Recently Used */
-  RANDOM_R       /** Random replacement */
+  RANDOM_R,      /** Random replacement */
+  PLRU_R,        /** Tree pseudo-LRU; E must be a power of 2 */
+  SRRIP_R,       /** Static re-reference interval prediction */
+  BRRIP_R,       /** Bimodal re-reference interval prediction */
+  LFU_R,         /** Least Frequently Used, ties broken by LRU */
+  OPT_R,         /** Belady's optimal: replace the block next accessed
+                     furthest in the future; see cache_sim_set_future() */
 } Replacement;
 
 /** A primary memory address */
 typedef unsigned long MemAddr;
 
+/** Hardware prefetcher */
+typedef enum {
+  NO_PF,         /** no prefetching */
+  NEXT_LINE_PF,  /** on a miss or a first hit on a prefetched line,
+                     prefetch the next degree blocks */
+  STRIDE_PF,     /** detect constant strides between accesses to the
+                     same 4K region and prefetch degree strides ahead */
+  STREAM_PF,     /** stream buffers of degree blocks each, allocated on
+                     misses and probed on later misses; prefetched
+                     blocks are held outside the cache */
+} PrefetchKind;
+
+/** Prefetcher parameters; all 0 for no prefetching */
+typedef struct {
+  PrefetchKind kind;
+  unsigned degree;            // # of blocks prefetched at a time; must
+                              // be <= PREFETCH_MAX_DEGREE
+  unsigned latency;           // # of accesses after which a prefetch
+                              // issued by an access has completed
+} PrefetchParams;
+
+enum { PREFETCH_MAX_DEGREE = 16 };
+
+/** Handling of writes which hit */
+typedef enum {
+  WRITE_BACK_W,      /** mark the line dirty; written to memory when
+                         evicted */
+  WRITE_THROUGH_W,   /** also write to memory; lines are never dirty */
+} WritePolicy;
+
+/** Handling of writes which miss */
+typedef enum {
+  WRITE_ALLOCATE_A,    /** fill the block, then write it as on a hit */
+  NO_WRITE_ALLOCATE_A, /** write to memory without filling the block */
+} AllocatePolicy;
+
+enum { VICTIM_MAX_LINES = 64 };
+enum { SECTOR_MAX = 64 };
+
 /** Parameters which specify a cache.
  *  Must have n_set_index_bits + n_blk_offset_bits < n_mem_addr_bits and
- *  2 <= n_blk_offset_bits.
+ *  2 <= n_blk_offset_bits.  Tags are stored in as few bytes as
+ *  n_mem_addr_bits allows, widened if a larger address is accessed.
  */
 typedef struct {
   unsigned n_mem_addr_bits;   // slides notation: m; # of bits in mem
@@ -28,18 +75,39 @@ typedef struct {
                               // within a block; blk-size is 2**this
   unsigned n_lines_per_set;   // Slides notation: E; # of cache lines/set
   Replacement replacement;    // replacement strategy
+  unsigned long seed;         // seed for randomized replacement
+  PrefetchParams prefetch;
+  WritePolicy write_policy;
+  AllocatePolicy allocate_policy;
+  unsigned n_victim_lines;    // # of lines in a fully associative LRU
+                              // victim cache of blocks evicted from the
+                              // cache, <= VICTIM_MAX_LINES; 0 for none
+  unsigned n_sectors;         // # of sectors per block, each with its
+                              // own valid and dirty bits; a power of 2
+                              // <= SECTOR_MAX and <= blk-size; 0 or 1
+                              // for unsectored blocks
 } CacheParams;
 
 
 /** Create and return a new cache-simulation structure for a
  *  cache for main memory with the specified cache parameters params.
  *  No requirement that *params remains valid after this call.
+ *  Returns NULL if the replacement strategy cannot handle
+ *  n_lines_per_set, the prefetch degree, n_victim_lines or n_sectors
+ *  is out of range or more than one of a victim cache, prefetching
+ *  and sectors is requested.
  */
 CacheSim *new_cache_sim(const CacheParams *params);
 
 /** Free all resources used by cache-simulation structure *cache */
 void free_cache_sim(CacheSim *cache);
 
+/** Return the # of bytes of memory used by cache */
+size_t cache_sim_memory_size(const CacheSim *cache);
+
+/** Return the # of bytes of memory used by each set of cache */
+size_t cache_sim_set_size(const CacheSim *cache);
+
 typedef enum {
   CACHE_HIT,                     // address found in cache
   CACHE_MISS_WITHOUT_REPLACE,    // cache miss, no line replaced
@@ -47,6 +115,12 @@ typedef enum {
   CACHE_N_STATUS                 // dummy value: # of status values possible
 } CacheStatus;
 
+/** A miss supplied by the victim cache is still a miss; the block it
+ *  replaces, if any, moves to the victim cache.  A write miss which is
+ *  not allocated is a CACHE_MISS_WITHOUT_REPLACE, as is an access to
+ *  an invalid sector of a block in the cache, which fetches only that
+ *  sector.
+ */
 typedef struct {
   MemAddr access_addr;  // address which was accessed.
   CacheStatus status;   // status of requested address
@@ -61,4 +135,102 @@ typedef struct {
 CacheResult cache_sim_result(CacheSim *cache, MemAddr access_addr,
                              bool is_write);
 
+/** Batched version of cache_sim_result(): for 0 <= i < n, set
+ *  results[i] to the result of accessing access_addrs[i] for
+ *  writing if is_writes[i] is true, for reading otherwise.  Accesses
+ *  are simulated in array order, so the results are identical to
+ *  those obtained from n successive calls to cache_sim_result().
+ */
+void cache_sim_results(CacheSim *cache, size_t n,
+                       const MemAddr access_addrs[], const bool is_writes[],
+                       CacheResult results[]);
+
+/** Give cache the n accesses to access_addrs[] which it will be asked
+ *  to simulate next, as needed by OPT_R replacement.  Must be called
+ *  before the first access; blocks accessed beyond the n are treated
+ *  as never accessed again.  Takes O(n) expected time.
+ */
+void cache_sim_set_future(CacheSim *cache, size_t n,
+                          const MemAddr access_addrs[]);
+
+/** Return the index of the set of cache to which addr maps */
+unsigned long cache_sim_set_index(const CacheSim *cache, MemAddr addr);
+
+/** Return true iff the block containing addr is in cache, setting
+ *  *is_dirty (if non-NULL) to its dirty bit.  Does not change the
+ *  cache state, including the replacement state.
+ */
+bool cache_sim_probe(CacheSim *cache, MemAddr addr, bool *is_dirty);
+
+/** If the block containing addr is in cache, remove it, set
+ *  *is_dirty (if non-NULL) to its dirty bit and return true; return
+ *  false otherwise.
+ */
+bool cache_sim_invalidate(CacheSim *cache, MemAddr addr, bool *is_dirty);
+
+/** If the block containing addr is in cache, clear its dirty bit and
+ *  return its previous value; return false otherwise.  Does not change
+ *  the replacement state.
+ */
+bool cache_sim_clean(CacheSim *cache, MemAddr addr);
+
+/** Prefetch counts.  Prefetched lines are tagged until their first
+ *  demand access, so prefetches never change the CacheResult of a
+ *  demand access other than by the lines they fill and evict.
+ */
+typedef struct {
+  unsigned long issued;     // blocks brought into the cache or a stream
+                            // buffer by prefetches
+  unsigned long useful;     // prefetched blocks later demanded
+  unsigned long buffer_hits; // useful prefetches which supplied a demand
+                             // miss from a stream buffer
+  unsigned long late;       // useful prefetches demanded before they
+                            // completed
+  unsigned long useless;    // prefetched blocks evicted or flushed
+                            // without being demanded
+  unsigned long pollution;  // demand misses on blocks which had been
+                            // evicted by prefetch fills
+  unsigned long dirty_evictions; // dirty lines evicted by prefetch fills
+} PrefetchStats;
+
+/** Set *stats to the prefetch counts of cache so far; all 0 if cache
+ *  has no prefetcher.
+ */
+void cache_sim_prefetch_stats(const CacheSim *cache, PrefetchStats *stats);
+
+/** Traffic between a cache and memory, and victim-cache counts */
+typedef struct {
+  unsigned long block_reads;  // blocks, or sectors of sectored blocks,
+                              // read from memory, including prefetches
+  unsigned long block_writes; // dirty blocks written back to memory
+  unsigned long word_writes;  // writes sent to memory by write-through
+                              // or no-write-allocate
+  unsigned long victim_hits;  // misses supplied by the victim cache
+  unsigned long bytes_fetched;      // bytes of block_reads
+  unsigned long bytes_written_back; // bytes of the dirty sectors, or
+                                    // whole blocks, of block_writes
+} CacheTraffic;
+
+/** Set *traffic to the counts of cache so far.  Blocks removed by
+ *  cache_sim_invalidate() are not counted.
+ */
+void cache_sim_traffic(const CacheSim *cache, CacheTraffic *traffic);
+
+/** Save the state of cache (its lines, replacement and prefetcher
+ *  state, victim cache and clock) to a new file at path.  The file
+ *  holds host-order binary data for this build and version of the
+ *  simulator only.  Returns false with errno set on error, EINVAL if
+ *  cache uses a policy which needs the future.
+ */
+bool cache_sim_save(const CacheSim *cache, const char *path);
+
+/** Return a new cache with the state saved by cache_sim_save() in
+ *  the file at path, which must be that of a cache with parameters
+ *  *params, apart from its seed.  The counts returned by
+ *  cache_sim_prefetch_stats() and cache_sim_traffic() start at 0.
+ *  Returns NULL with errno set on error, EINVAL if the file is not
+ *  such a saved state.
+ */
+CacheSim *cache_sim_load(const char *path, const CacheParams *params);
+
 #endif //ifndef CACHE_SIM_
@@ -0,0 +1,137 @@
+#include "classify.h"
+#include "hash-map.h"
+#include "memalloc.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/************************** Type Definitions  **************************/
+
+enum { INITIAL_MAP_CAPACITY = 1024 };
+
+/** Marks a link to no node and a seen block which is not in the
+ *  shadow cache.
+ */
+#define NONE SIZE_MAX
+
+/** The shadow cache is a recency list of n_nodes <= n_lines nodes,
+ *  node i holding blocks[i] with links prev[i] (more recent) and
+ *  next[i] (less recent).  A single map serves as both the set of
+ *  seen blocks and the index of the shadow cache: it maps every block
+ *  number accessed so far to its node, or to NONE if the block is not
+ *  in the shadow cache.
+ */
+struct MissClassifierImpl {
+	unsigned blk_bits;
+	size_t n_lines;
+	size_t n_nodes;
+	size_t head;               // most recently used node
+	size_t tail;               // least recently used node
+	MemAddr *blocks;
+	size_t *prev;
+	size_t *next;
+	HashMap *nodes;
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+MissClassifier *
+new_miss_classifier(const CacheParams *params)
+{
+	MissClassifier *classifier = malloc_chk(sizeof(MissClassifier));
+	size_t n_lines = ((size_t)1 << params->n_set_index_bits) *
+		params->n_lines_per_set;
+	classifier->blk_bits = params->n_blk_offset_bits;
+	classifier->n_lines = n_lines;
+	classifier->n_nodes = 0;
+	classifier->head = classifier->tail = NONE;
+	classifier->blocks = malloc_chk(n_lines * sizeof(MemAddr));
+	classifier->prev = malloc_chk(n_lines * sizeof(size_t));
+	classifier->next = malloc_chk(n_lines * sizeof(size_t));
+	classifier->nodes = new_hash_map(INITIAL_MAP_CAPACITY);
+	return classifier;
+}
+
+void
+free_miss_classifier(MissClassifier *classifier)
+{
+	if (!classifier) return;
+	free(classifier->blocks);
+	free(classifier->prev);
+	free(classifier->next);
+	free_hash_map(classifier->nodes);
+	free(classifier);
+}
+
+/************************** Shadow LRU Cache ***************************/
+
+static void
+unlink_node(MissClassifier *classifier, size_t node)
+{
+	size_t p = classifier->prev[node], n = classifier->next[node];
+	if (p == NONE) {
+		classifier->head = n;
+	}
+	else {
+		classifier->next[p] = n;
+	}
+	if (n == NONE) {
+		classifier->tail = p;
+	}
+	else {
+		classifier->prev[n] = p;
+	}
+}
+
+static void
+push_node(MissClassifier *classifier, size_t node)
+{
+	classifier->prev[node] = NONE;
+	classifier->next[node] = classifier->head;
+	if (classifier->head == NONE) {
+		classifier->tail = node;
+	}
+	else {
+		classifier->prev[classifier->head] = node;
+	}
+	classifier->head = node;
+}
+
+/** Return a node for a block entering the shadow cache, evicting the
+ *  least recently used block if the cache is full.
+ */
+static size_t
+alloc_node(MissClassifier *classifier)
+{
+	if (classifier->n_nodes < classifier->n_lines) {
+		return classifier->n_nodes++;
+	}
+	size_t node = classifier->tail;
+	unlink_node(classifier, node);
+	*hash_map_get(classifier->nodes, classifier->blocks[node]) = NONE;
+	return node;
+}
+
+MissClass
+classify_access(MissClassifier *classifier, MemAddr addr, bool is_miss)
+{
+	MemAddr blk = addr >> classifier->blk_bits;
+	bool is_new;
+	unsigned long *node = hash_map_put(classifier->nodes, blk, &is_new);
+	if (is_new) *node = NONE;
+	bool is_shadow_hit = *node != NONE;
+	if (is_shadow_hit) {
+		unlink_node(classifier, *node);
+	}
+	else {
+		//alloc_node() does not add to the map, so node stays valid
+		*node = alloc_node(classifier);
+		classifier->blocks[*node] = blk;
+	}
+	push_node(classifier, *node);
+
+	if (!is_miss) return NOT_MISS_C;
+	if (is_new) return COMPULSORY_C;
+	return is_shadow_hit ? CONFLICT_C : CAPACITY_C;
+}
@@ -0,0 +1,39 @@
+#ifndef CLASSIFY_H_
+#define CLASSIFY_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+
+/** Classifies the misses of a cache into the 3Cs by running a shadow
+ *  fully-associative LRU cache with the same # of lines alongside it:
+ *  a miss is compulsory if its block was never accessed before,
+ *  capacity if it also misses the shadow cache and conflict otherwise.
+ */
+typedef struct MissClassifierImpl MissClassifier;
+
+typedef enum {
+  NOT_MISS_C,      /** the access hit */
+  COMPULSORY_C,    /** first access to the block */
+  CAPACITY_C,      /** would miss even with full associativity */
+  CONFLICT_C,      /** would hit with full associativity */
+  N_MISS_CLASSES   /** dummy value: # of MissClass values */
+} MissClass;
+
+/** Return a new classifier for the misses of the cache specified by
+ *  *params.  No requirement that *params remains valid after this
+ *  call.
+ */
+MissClassifier *new_miss_classifier(const CacheParams *params);
+
+/** Free all resources used by *classifier */
+void free_miss_classifier(MissClassifier *classifier);
+
+/** Record an access to addr which missed the cache if is_miss and
+ *  return its class.  Must be called for every access of the cache in
+ *  trace order.
+ */
+MissClass classify_access(MissClassifier *classifier, MemAddr addr,
+                          bool is_miss);
+
+#endif //ifndef CLASSIFY_H_
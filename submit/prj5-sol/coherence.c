@@ -0,0 +1,294 @@
+#include "coherence.h"
+#include "hash-map.h"
+#include "memalloc.h"
+#include "replacement.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/************************** Type Definitions  **************************/
+
+/** The directory maps each block held by some L1, or lost by some L1
+ *  to an invalidation, to an entry packed into the map value:
+ *
+ *    bits [0, 16)    sharers: core c holds the block iff bit c is set
+ *    bits [16, 32)   invalidated: core c's copy was invalidated and it
+ *                    has not missed on the block since
+ *    bit 32          exclusive: the only sharer may hold it E or M
+ *
+ *  Entries with no sharers and no invalidated cores are removed.
+ */
+enum {
+	INVALIDATED_SHIFT = COHERENT_MAX_CORES,
+	EXCLUSIVE_SHIFT = 2 * COHERENT_MAX_CORES,
+};
+
+static const unsigned long CORES_MASK = (1UL << COHERENT_MAX_CORES) - 1;
+static const unsigned long EXCLUSIVE_BIT = 1UL << EXCLUSIVE_SHIFT;
+
+struct CoherentSimImpl {
+	unsigned n_cores;
+	unsigned blk_bits;         // L1 block offset bits
+	CacheSim **l1s;            // [n_cores]
+	CacheSim *l2;              // NULL if none
+	HashMap *directory;        // block address -> entry
+	CoreStats *stats;          // [n_cores]
+	unsigned long l2_stats[CACHE_N_STATUS + 1];
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+CoherentSim *
+new_coherent_sim(const CacheParams *l1_params, unsigned n_cores,
+                 const CacheParams *l2_params)
+{
+	if (n_cores == 0 || n_cores > COHERENT_MAX_CORES) return NULL;
+	const ReplacementPolicy *policy =
+		get_replacement_policy(l1_params->replacement);
+	//an L1 line must be present whenever the directory records the
+	//core as a sharer, and be written back only by MESI
+	if (policy->needs_future || l1_params->prefetch.kind != NO_PF ||
+	    l1_params->write_policy != WRITE_BACK_W ||
+	    l1_params->allocate_policy != WRITE_ALLOCATE_A ||
+	    l1_params->n_victim_lines > 0 || l1_params->n_sectors > 1) {
+		return NULL;
+	}
+	CoherentSim *sim = calloc_chk(1, sizeof(CoherentSim));
+	sim->n_cores = n_cores;
+	sim->blk_bits = l1_params->n_blk_offset_bits;
+	sim->l1s = calloc_chk(n_cores, sizeof(CacheSim *));
+	sim->stats = calloc_chk(n_cores, sizeof(CoreStats));
+	sim->directory = new_hash_map(1024);
+	for (unsigned c = 0; c < n_cores; c++) {
+		sim->l1s[c] = new_cache_sim(l1_params);
+		if (!sim->l1s[c]) {
+			free_coherent_sim(sim);
+			return NULL;
+		}
+	}
+	if (l2_params) {
+		sim->l2 = new_cache_sim(l2_params);
+		if (!sim->l2) {
+			free_coherent_sim(sim);
+			return NULL;
+		}
+	}
+	return sim;
+}
+
+void
+free_coherent_sim(CoherentSim *sim)
+{
+	if (!sim) return;
+	for (unsigned c = 0; c < sim->n_cores; c++) free_cache_sim(sim->l1s[c]);
+	free(sim->l1s);
+	free_cache_sim(sim->l2);
+	free_hash_map(sim->directory);
+	free(sim->stats);
+	free(sim);
+}
+
+size_t
+coherent_sim_memory_size(const CoherentSim *sim)
+{
+	size_t size = sizeof(CoherentSim) + sim->n_cores * sizeof(CoreStats);
+	for (unsigned c = 0; c < sim->n_cores; c++) {
+		size += cache_sim_memory_size(sim->l1s[c]);
+	}
+	if (sim->l2) size += cache_sim_memory_size(sim->l2);
+	return size;
+}
+
+/***************************** Coherence *******************************/
+
+static inline unsigned long
+sharers_of(unsigned long entry)
+{
+	return entry & CORES_MASK;
+}
+
+static inline unsigned long
+invalidated_of(unsigned long entry)
+{
+	return (entry >> INVALIDATED_SHIFT) & CORES_MASK;
+}
+
+static void
+l2_access(CoherentSim *sim, MemAddr addr, bool is_write)
+{
+	if (!sim->l2) return;
+	CacheResult result = cache_sim_result(sim->l2, addr, is_write);
+	sim->l2_stats[result.status]++;
+	sim->l2_stats[CACHE_N_STATUS] +=
+		(result.status == CACHE_MISS_WITH_REPLACE) & result.is_dirty;
+}
+
+/** Remove the entry for blk if it no longer records anything */
+static void
+trim_entry(CoherentSim *sim, MemAddr blk, unsigned long entry)
+{
+	if (sharers_of(entry) == 0 && invalidated_of(entry) == 0) {
+		hash_map_remove(sim->directory, blk);
+	}
+}
+
+/** Update the directory for the eviction of the block at addr from
+ *  core's L1, writing it to the L2 if is_dirty.
+ */
+static void
+evict(CoherentSim *sim, unsigned core, MemAddr addr, bool is_dirty)
+{
+	MemAddr blk = addr >> sim->blk_bits;
+	unsigned long *entry = hash_map_get(sim->directory, blk);
+	assert(entry && (*entry & (1UL << core)));
+	*entry &= ~(1UL << core);
+	if (sharers_of(*entry) == 0) *entry &= ~EXCLUSIVE_BIT;
+	if (is_dirty) {
+		sim->stats[core].writebacks++;
+		l2_access(sim, addr, true);
+	}
+	trim_entry(sim, blk, *entry);
+}
+
+/** Invalidate addr in the L1s of the cores in mask, returning true if
+ *  one of them held it dirty and so supplied the block.  Updates
+ *  *entry, which must not move during the call.
+ */
+static bool
+invalidate_sharers(CoherentSim *sim, unsigned long mask, MemAddr addr,
+                   unsigned long *entry)
+{
+	bool is_supplied = false;
+	while (mask) {
+		unsigned c = __builtin_ctzl(mask);
+		mask &= mask - 1;
+		bool is_dirty;
+		bool is_present = cache_sim_invalidate(sim->l1s[c], addr, &is_dirty);
+		assert(is_present);
+		(void)is_present;
+		sim->stats[c].invalidations++;
+		if (is_dirty) {
+			sim->stats[c].interventions++;
+			is_supplied = true;
+		}
+		*entry &= ~(1UL << c);
+		*entry |= 1UL << (c + INVALIDATED_SHIFT);
+	}
+	return is_supplied;
+}
+
+/** Handle a write hit by core on a clean line: silent for Exclusive,
+ *  an upgrade invalidating all other sharers for Shared.
+ */
+static void
+write_clean_hit(CoherentSim *sim, unsigned core, MemAddr addr)
+{
+	unsigned long *entry = hash_map_get(sim->directory, addr >> sim->blk_bits);
+	assert(entry && (*entry & (1UL << core)));
+	if (*entry & EXCLUSIVE_BIT) return;
+	sim->stats[core].upgrades++;
+	invalidate_sharers(sim, sharers_of(*entry) & ~(1UL << core), addr, entry);
+	*entry |= EXCLUSIVE_BIT;
+}
+
+/** Handle a miss by core on addr after its L1 has been filled */
+static void
+miss(CoherentSim *sim, unsigned core, MemAddr addr, bool is_write)
+{
+	CoreStats *stats = &sim->stats[core];
+	unsigned long core_bit = 1UL << core;
+	unsigned long *entry =
+		hash_map_put(sim->directory, addr >> sim->blk_bits, NULL);
+	if (*entry & (core_bit << INVALIDATED_SHIFT)) {
+		stats->coherence_misses++;
+		*entry &= ~(core_bit << INVALIDATED_SHIFT);
+	}
+	unsigned long others = sharers_of(*entry);
+	bool is_supplied = false;
+	if (is_write) {
+		is_supplied = invalidate_sharers(sim, others, addr, entry);
+		*entry |= core_bit | EXCLUSIVE_BIT;
+	}
+	else {
+		if ((*entry & EXCLUSIVE_BIT) && others) {
+			//the owner drops to Shared, writing back a Modified line
+			unsigned owner = __builtin_ctzl(others);
+			if (cache_sim_clean(sim->l1s[owner], addr)) {
+				sim->stats[owner].interventions++;
+				sim->stats[owner].writebacks++;
+				l2_access(sim, addr, true);
+				is_supplied = true;
+			}
+		}
+		*entry &= ~EXCLUSIVE_BIT;
+		if (!others) *entry |= EXCLUSIVE_BIT;
+		*entry |= core_bit;
+	}
+	if (!is_supplied) l2_access(sim, addr, false);
+}
+
+static inline CacheResult
+core_access(CoherentSim *sim, unsigned core, MemAddr addr, bool is_write)
+{
+	CacheSim *l1 = sim->l1s[core];
+	CoreStats *stats = &sim->stats[core];
+	stats->accesses++;
+	//a write hit needs coherence actions only for a clean line
+	bool is_clean_write = false;
+	if (is_write) {
+		bool is_dirty;
+		is_clean_write = cache_sim_probe(l1, addr, &is_dirty) && !is_dirty;
+	}
+	CacheResult result = cache_sim_result(l1, addr, is_write);
+	if (result.status == CACHE_HIT) {
+		stats->hits++;
+		if (is_clean_write) write_clean_hit(sim, core, addr);
+		return result;
+	}
+	stats->misses++;
+	if (result.status == CACHE_MISS_WITH_REPLACE) {
+		evict(sim, core, result.replace_addr, result.is_dirty);
+	}
+	miss(sim, core, addr, is_write);
+	return result;
+}
+
+void
+coherent_sim_accesses(CoherentSim *sim, size_t n, const unsigned cores[],
+                      const MemAddr access_addrs[], const bool is_writes[],
+                      CacheResult results[])
+{
+	for (size_t i = 0; i < n; i++) {
+		assert(cores[i] < sim->n_cores);
+		results[i] = core_access(sim, cores[i], access_addrs[i], is_writes[i]);
+	}
+}
+
+/***************************** Inspection ******************************/
+
+MesiState
+coherent_sim_state(const CoherentSim *sim, unsigned core, MemAddr addr)
+{
+	bool is_dirty;
+	if (!cache_sim_probe(sim->l1s[core], addr, &is_dirty)) return INVALID_M;
+	if (is_dirty) return MODIFIED_M;
+	const unsigned long *entry =
+		hash_map_get(sim->directory, addr >> sim->blk_bits);
+	return (*entry & EXCLUSIVE_BIT) ? EXCLUSIVE_M : SHARED_M;
+}
+
+void
+coherent_sim_core_stats(const CoherentSim *sim, unsigned core,
+                        CoreStats *stats)
+{
+	*stats = sim->stats[core];
+}
+
+void
+coherent_sim_l2_stats(const CoherentSim *sim,
+                      unsigned long stats[CACHE_N_STATUS + 1])
+{
+	for (int i = 0; i < CACHE_N_STATUS + 1; i++) stats[i] = sim->l2_stats[i];
+}
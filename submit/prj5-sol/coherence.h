@@ -0,0 +1,86 @@
+#ifndef COHERENCE_H_
+#define COHERENCE_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** A multi-core system: each core has a private L1 cache whose lines
+ *  are kept coherent with the MESI protocol by a directory, and L1
+ *  misses and writebacks go to an optional shared L2.  The state of a
+ *  valid L1 line is Modified if it is dirty, otherwise Exclusive if
+ *  the directory records its core as the exclusive holder of the
+ *  block and Shared if not.
+ */
+typedef struct CoherentSimImpl CoherentSim;
+
+enum { COHERENT_MAX_CORES = 16 };
+
+/** MESI state of an L1 line */
+typedef enum {
+  INVALID_M,
+  SHARED_M,
+  EXCLUSIVE_M,
+  MODIFIED_M,
+} MesiState;
+
+/** Per-core counts */
+typedef struct {
+  unsigned long accesses;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long coherence_misses;  // misses to blocks whose line was
+                                   // invalidated by another core's write
+  unsigned long upgrades;          // writes hitting Shared lines
+  unsigned long invalidations;     // lines invalidated by other cores'
+                                   // writes
+  unsigned long interventions;     // dirty lines supplied to another
+                                   // core's miss
+  unsigned long writebacks;        // dirty lines written to the L2 by
+                                   // evictions and interventions
+} CoreStats;
+
+/** Return a new system of n_cores cores, each with an L1 having
+ *  parameters *l1_params, sharing an L2 with parameters *l2_params
+ *  (no L2 if NULL).  Returns NULL if 1 <= n_cores <=
+ *  COHERENT_MAX_CORES does not hold, if new_cache_sim() rejects
+ *  either params or if the L1s prefetch, use OPT_R replacement,
+ *  write-through, no-write-allocate, a victim cache or sectors.
+ *  No requirement that the params remain valid after this call.
+ */
+CoherentSim *new_coherent_sim(const CacheParams *l1_params, unsigned n_cores,
+                              const CacheParams *l2_params);
+
+/** Free all resources used by *sim */
+void free_coherent_sim(CoherentSim *sim);
+
+/** Return the # of bytes of memory used by the caches of sim; the
+ *  directory grows with the # of blocks cached.
+ */
+size_t coherent_sim_memory_size(const CoherentSim *sim);
+
+/** Simulate n accesses in array order: access i is by core cores[i]
+ *  to access_addrs[i] for writing iff is_writes[i].  Sets results[i]
+ *  to the result of the access in that core's L1.
+ */
+void coherent_sim_accesses(CoherentSim *sim, size_t n, const unsigned cores[],
+                           const MemAddr access_addrs[],
+                           const bool is_writes[], CacheResult results[]);
+
+/** Return the state of the line holding addr in core's L1 */
+MesiState coherent_sim_state(const CoherentSim *sim, unsigned core,
+                             MemAddr addr);
+
+/** Set *stats to the counts for core */
+void coherent_sim_core_stats(const CoherentSim *sim, unsigned core,
+                             CoreStats *stats);
+
+/** Set stats[] to the counts of the statuses of L2 accesses, with
+ *  stats[CACHE_N_STATUS] the # of dirty L2 evictions.  All 0 without
+ *  an L2.
+ */
+void coherent_sim_l2_stats(const CoherentSim *sim,
+                           unsigned long stats[CACHE_N_STATUS + 1]);
+
+#endif //ifndef COHERENCE_H_
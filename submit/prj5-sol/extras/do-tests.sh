@@ -23,16 +23,32 @@ for t in $tests
 do
     test_dir=`dirname $t`
     b=`basename $t .test`
-    echo $b | grep -P '([lm]ru|rand)_\d+-\d+-\d+-\d+' > /dev/null 
-    if [ $? -ne 0 ]
+    #an optional "#args: ARGS" line in the test gives the cache-sim
+    #arguments, with @DIR@ standing for the test directory; otherwise
+    #they come from the test basename
+    args=`sed -n "s|^#args: *||p" $t | head -n 1 | sed "s|@DIR@|$test_dir|g"`
+    if [ -z "$args" ]
     then
-	echo "test basename must be of the form [lm]ru-D-D-D-D"
-	exit 1
+	echo $b | \
+	    grep -P '^(lru|mru|rand|plru|srrip|brrip|lfu|opt)_\d+-\d+-\d+-\d+' \
+		 > /dev/null
+	if [ $? -ne 0 ]
+	then
+	    echo "test basename must be of the form REPLACE_D-D-D-D" \
+		 "or test must have an #args: line"
+	    exit 1
+	fi
+	replace=`echo $b |cut -d_ -f1`
+	cache_spec=`echo $b |cut -d_ -f2`
+	args="-r $replace $cache_spec"
     fi
-    replace=`echo $b |cut -d_ -f1`
-    cache_spec=`echo $b |cut -d_ -f2`
+    #an optional "#pre-args: ARGS" line gives the arguments of a run on
+    #the test before each tested run, such as one saving cache state to
+    #$b.state for the tested run to load
+    pre_args=`sed -n 's/^#pre-args: *//p' $t | head -n 1`
     out_file="$b.out";	
-    $exec -r $replace $cache_spec < $t > $out_file
+    [ -n "$pre_args" ] && $exec $pre_args < $t > /dev/null 2>&1
+    $exec $args < $t > $out_file
     gold_file="$test_dir/$b.gold"
     if diff $gold_file $out_file
     then
@@ -43,8 +59,9 @@ do
 	     "actual output in $out_file"
     fi
     valgrind_file="$b.valgrind"
+    [ -n "$pre_args" ] && $exec $pre_args < $t > /dev/null 2>&1
     valgrind --error-exitcode=1 -s --leak-check=full \
-	     $exec -r $replace $cache_spec < $t 2> $valgrind_file >/dev/null
+	     $exec $args < $t 2> $valgrind_file >/dev/null
     if [ $? -eq 0 ]
     then
 	rm $valgrind_file
@@ -52,4 +69,5 @@ do
     else
 	echo "*** FAIL valgrind $b; valgrind output in $valgrind_file"
     fi
+    rm -f $b.state
 done
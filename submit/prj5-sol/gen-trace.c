@@ -0,0 +1,198 @@
+#include "trace-gen.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s MODE OPTIONS...\n"
+          "MODE is either program or random or stride or test.\n"
+          "  General Options:\n"
+          "    --len | -n:       # of address traces; default 100\n"
+          "    --lo-addr | -l:   low base address in hex; default 0x1000\n"
+          "    --mem | -m:       total memory size; optional suffix k, m, g;"
+          " default 64k\n"
+          "    --seed | -S:      seed for the random streams; default 0\n"
+          "  MODE stride: generate trace with specific stride through memory;"
+          " Options:\n"
+          "    --stride | -r:    # of bytes over which to stride; default 4\n"
+          "    --write | -w:     probability of a write access; default 0.4\n"
+          "  MODE program: generate read-only typical program trace;"
+          " Options:\n"
+          "    --jump-prob | -j: probability of taking intra-function jump;"
+          " default 0.1\n"
+          "    --call-prob | -c: probability of call/return; default 0.04\n"
+          "  MODE random: generate random trace; Options:\n"
+          "    --write | -w:     probability of a write access; default 0.2\n"
+          "  MODE test: generate test trace for systematically testing cache;"
+          " Options:\n"
+          "    --blk | -b:       # of bits in block offset; default 4\n"
+          "    --set | -s:       # of bits in set index; default 4\n"
+          "    --ways | -E:      # of ways in set; default 2\n",
+          msg, program);
+  exit(1);
+}
+
+typedef struct {
+  const char *name;
+  GenMode mode;
+} ModeName;
+
+static ModeName MODES[] = {
+  { "program", PROGRAM_G },
+  { "random", RANDOM_G },
+  { "stride", STRIDE_G },
+  { "test", TEST_G },
+};
+
+/** Translate from name to GenMode enum.  Return < 0 on error */
+static int
+get_mode(const char *name) {
+  for (int i = 0; i < sizeof(MODES)/sizeof(MODES[0]); i++) {
+    if (strcmp(name, MODES[i].name) == 0) return MODES[i].mode;
+  }
+  return -1;
+}
+
+typedef enum { INT_F, HEX_F, MEM_SIZE_F, PROBABILITY_F } OptionFormat;
+
+typedef struct {
+  const char *long_name;
+  char short_name;
+  int mode;                 // < 0 for general options
+  OptionFormat format;
+} OptionInfo;
+
+static OptionInfo OPTIONS[] = {
+  { "len", 'n', -1, INT_F },
+  { "lo-addr", 'l', -1, HEX_F },
+  { "mem", 'm', -1, MEM_SIZE_F },
+  { "seed", 'S', -1, INT_F },
+  { "stride", 'r', STRIDE_G, INT_F },
+  { "write", 'w', STRIDE_G, PROBABILITY_F },
+  { "jump-prob", 'j', PROGRAM_G, PROBABILITY_F },
+  { "call-prob", 'c', PROGRAM_G, PROBABILITY_F },
+  { "write", 'w', RANDOM_G, PROBABILITY_F },
+  { "blk", 'b', TEST_G, INT_F },
+  { "set", 's', TEST_G, INT_F },
+  { "ways", 'E', TEST_G, INT_F },
+};
+
+/** Return the info for option arg -X or --NAME in mode, NULL if none */
+static const OptionInfo *
+find_option(const char *arg, GenMode mode)
+{
+  bool is_long = arg[1] == '-';
+  for (int i = 0; i < sizeof(OPTIONS)/sizeof(OPTIONS[0]); i++) {
+    const OptionInfo *info = &OPTIONS[i];
+    if (info->mode >= 0 && info->mode != mode) continue;
+    if (is_long ? strcmp(&arg[2], info->long_name) == 0
+                : arg[1] == info->short_name) {
+      return info;
+    }
+  }
+  return NULL;
+}
+
+/** Parse val as specified by info->format into *result, a double so
+ *  as to hold probabilities.  Returns false on error.
+ */
+static bool
+parse_option_value(const OptionInfo *info, const char *val, double *result)
+{
+  char *p;
+  switch (info->format) {
+  case HEX_F:
+    *result = strtoul(val, &p, 16);
+    return p != val && *p == '\0';
+  case MEM_SIZE_F: {
+    if (val[0] < '0' || val[0] > '9') return false;
+    unsigned long size = strtoul(val, &p, 10);
+    const char *suffixes = "kmg";
+    if (*p != '\0') {
+      const char *suffix = strchr(suffixes, *p);
+      if (!suffix || p[1] != '\0') return false;
+      for (int i = 0; i <= suffix - suffixes; i++) size *= 1024;
+    }
+    *result = size;
+    return true;
+  }
+  case PROBABILITY_F:
+    *result = strtod(val, &p);
+    return p != val && *p == '\0' && 0 <= *result && *result <= 1;
+  default:
+    if (val[0] < '0' || val[0] > '9') return false;
+    *result = strtoul(val, &p, 10);
+    return *p == '\0';
+  }
+}
+
+/** Set *params from the args after the mode, exiting on error */
+static void
+get_params(const char *program, int argc, const char *argv[],
+           GenParams *params)
+{
+  int mode = get_mode(argv[1]);
+  if (mode < 0) usage(program, "");
+  default_gen_params(mode, params);
+  for (int i = 2; i < argc; i++) {
+    const char *arg = argv[i];
+    if (arg[0] != '-' || arg[1] == '\0') {
+      fprintf(stderr, "\"%s\" is not an option\n", arg);
+      usage(program, "");
+    }
+    const OptionInfo *info = find_option(arg, mode);
+    if (!info) {
+      fprintf(stderr, "unknown option arg \"%s\"\n", arg);
+      usage(program, "");
+    }
+    const char *val = (arg[1] != '-' && arg[2] != '\0') ? &arg[2] : argv[++i];
+    double value;
+    if (!val || !parse_option_value(info, val, &value)) {
+      fprintf(stderr, "bad value for option %s\n", info->long_name);
+      usage(program, "");
+    }
+    switch (info->short_name) {
+    case 'n': params->len = value; break;
+    case 'l': params->lo_addr = value; break;
+    case 'm': params->mem = value; break;
+    case 'S': params->seed = value; break;
+    case 'r': params->stride = value; break;
+    case 'w': params->write_prob = value; break;
+    case 'j': params->jump_prob = value; break;
+    case 'c': params->call_prob = value; break;
+    case 'b': params->blk = value; break;
+    case 's': params->set = value; break;
+    case 'E': params->ways = value; break;
+    }
+  }
+}
+
+enum { BATCH_SIZE = 4096 };
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  if (argc < 2) usage(program, "");
+  GenParams params;
+  get_params(program, argc, argv, &params);
+  TraceGen *gen = new_trace_gen(&params);
+  if (!gen) usage(program, "lo-addr must not exceed mem\n");
+  int addr_width = floor((log2(params.mem) + 3)/4);
+  MemAddr addrs[BATCH_SIZE];
+  bool is_writes[BATCH_SIZE];
+  size_t n;
+  do {
+    n = trace_gen_read(gen, BATCH_SIZE, addrs, is_writes);
+    for (size_t i = 0; i < n; i++) {
+      printf("0x%0*lx %c\n", addr_width, addrs[i], is_writes[i] ? 'w' : 'r');
+    }
+  } while (n == BATCH_SIZE);
+  free_trace_gen(gen);
+  return 0;
+}
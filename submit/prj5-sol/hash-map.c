@@ -0,0 +1,148 @@
+#include "hash-map.h"
+#include "memalloc.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/************************** Type Definitions  **************************/
+
+enum { MIN_CAPACITY = 16 };
+
+/** Slot i holds keys[i] and values[i] iff is_used[i].  capacity is a
+ *  power of 2 and size is kept at most 3/4 of capacity.
+ */
+struct HashMapImpl {
+	size_t capacity;
+	size_t size;
+	MemAddr *keys;
+	unsigned long *values;
+	bool *is_used;
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+static void
+alloc_slots(HashMap *map, size_t capacity)
+{
+	map->capacity = capacity;
+	map->keys = malloc_chk(capacity * sizeof(MemAddr));
+	map->values = malloc_chk(capacity * sizeof(unsigned long));
+	map->is_used = calloc_chk(capacity, sizeof(bool));
+}
+
+HashMap *
+new_hash_map(size_t capacity)
+{
+	size_t n_slots = MIN_CAPACITY;
+	while (n_slots/4*3 < capacity) n_slots *= 2;
+	HashMap *map = malloc_chk(sizeof(HashMap));
+	map->size = 0;
+	alloc_slots(map, n_slots);
+	return map;
+}
+
+void
+free_hash_map(HashMap *map)
+{
+	if (!map) return;
+	free(map->keys);
+	free(map->values);
+	free(map->is_used);
+	free(map);
+}
+
+/***************************** Operations ******************************/
+
+static inline size_t
+hash_slot(const HashMap *map, MemAddr key)
+{
+	return hash_mem_addr(key) & (map->capacity - 1);
+}
+
+/** Return the slot holding key, or the empty slot ending its probe
+ *  sequence.
+ */
+static inline size_t
+find_slot(const HashMap *map, MemAddr key)
+{
+	size_t mask = map->capacity - 1;
+	size_t i = hash_slot(map, key);
+	while (map->is_used[i] && map->keys[i] != key) i = (i + 1) & mask;
+	return i;
+}
+
+static void
+grow(HashMap *map)
+{
+	size_t old_capacity = map->capacity;
+	MemAddr *old_keys = map->keys;
+	unsigned long *old_values = map->values;
+	bool *old_is_used = map->is_used;
+	alloc_slots(map, 2 * old_capacity);
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (!old_is_used[i]) continue;
+		size_t j = find_slot(map, old_keys[i]);
+		map->keys[j] = old_keys[i];
+		map->values[j] = old_values[i];
+		map->is_used[j] = true;
+	}
+	free(old_keys);
+	free(old_values);
+	free(old_is_used);
+}
+
+unsigned long *
+hash_map_get(const HashMap *map, MemAddr key)
+{
+	size_t i = find_slot(map, key);
+	return map->is_used[i] ? &map->values[i] : NULL;
+}
+
+unsigned long *
+hash_map_put(HashMap *map, MemAddr key, bool *is_new)
+{
+	size_t i = find_slot(map, key);
+	if (is_new) *is_new = !map->is_used[i];
+	if (map->is_used[i]) return &map->values[i];
+	if ((map->size + 1) * 4 > map->capacity * 3) {
+		grow(map);
+		i = find_slot(map, key);
+	}
+	map->keys[i] = key;
+	map->values[i] = 0;
+	map->is_used[i] = true;
+	map->size++;
+	return &map->values[i];
+}
+
+bool
+hash_map_remove(HashMap *map, MemAddr key)
+{
+	size_t mask = map->capacity - 1;
+	size_t i = find_slot(map, key);
+	if (!map->is_used[i]) return false;
+	//backward-shift deletion: move later entries of the probe run into
+	//the hole unless that would put them before their home slot
+	size_t j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (!map->is_used[j]) break;
+		size_t home = hash_slot(map, map->keys[j]);
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			map->keys[i] = map->keys[j];
+			map->values[i] = map->values[j];
+			i = j;
+		}
+	}
+	map->is_used[i] = false;
+	map->size--;
+	return true;
+}
+
+size_t
+hash_map_size(const HashMap *map)
+{
+	return map->size;
+}
@@ -0,0 +1,52 @@
+#ifndef HASH_MAP_H_
+#define HASH_MAP_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** A map from MemAddr keys to unsigned long values using open
+ *  addressing with linear probing.  The table doubles when it becomes
+ *  too full, so pointers returned by hash_map_get() and hash_map_put()
+ *  are only valid until the next hash_map_put() or hash_map_remove().
+ */
+typedef struct HashMapImpl HashMap;
+
+/** Return a well-mixed hash of addr (splitmix64 finalizer), since
+ *  block addresses often differ only in a few middle bits.
+ */
+static inline uint64_t
+hash_mem_addr(MemAddr addr)
+{
+  uint64_t z = addr;
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/** Return a new empty map with room for about capacity entries
+ *  before it needs to grow.
+ */
+HashMap *new_hash_map(size_t capacity);
+
+/** Free all resources used by *map */
+void free_hash_map(HashMap *map);
+
+/** Return a pointer to the value for key, NULL if key is not in map */
+unsigned long *hash_map_get(const HashMap *map, MemAddr key);
+
+/** Return a pointer to the value for key, first adding key with value
+ *  0 if it is not in map.  Set *is_new (if non-NULL) to true iff key
+ *  was added.
+ */
+unsigned long *hash_map_put(HashMap *map, MemAddr key, bool *is_new);
+
+/** Remove key from map, returning true iff it was present */
+bool hash_map_remove(HashMap *map, MemAddr key);
+
+/** Return the # of keys in map */
+size_t hash_map_size(const HashMap *map);
+
+#endif //ifndef HASH_MAP_H_
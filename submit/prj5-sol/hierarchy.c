@@ -0,0 +1,227 @@
+#include "hierarchy.h"
+#include "memalloc.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/************************** Type Definitions  **************************/
+
+struct CacheHierarchyImpl {
+	Inclusion inclusion;
+	unsigned n_levels;
+	CacheParams *params;       // [n_levels]
+	CacheSim **caches;         // [n_levels]
+	LevelStats *stats;         // [n_levels + 1]; last is main memory
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+CacheHierarchy *
+new_cache_hierarchy(const CacheParams params[], unsigned n_levels,
+                    Inclusion inclusion)
+{
+	assert(n_levels > 0);
+	if (inclusion == EXCLUSIVE_H) {
+		for (unsigned i = 1; i < n_levels; i++) {
+			if (params[i].n_blk_offset_bits != params[0].n_blk_offset_bits) {
+				return NULL;
+			}
+		}
+	}
+	CacheHierarchy *hierarchy = malloc_chk(sizeof(CacheHierarchy));
+	hierarchy->inclusion = inclusion;
+	hierarchy->n_levels = n_levels;
+	hierarchy->params = malloc_chk(n_levels * sizeof(CacheParams));
+	hierarchy->caches = malloc_chk(n_levels * sizeof(CacheSim *));
+	hierarchy->stats = calloc_chk(n_levels + 1, sizeof(LevelStats));
+	for (unsigned i = 0; i < n_levels; i++) {
+		hierarchy->params[i] = params[i];
+		hierarchy->caches[i] = new_cache_sim(&params[i]);
+		if (!hierarchy->caches[i]) {
+			hierarchy->n_levels = i;
+			free_cache_hierarchy(hierarchy);
+			return NULL;
+		}
+	}
+	return hierarchy;
+}
+
+void
+free_cache_hierarchy(CacheHierarchy *hierarchy)
+{
+	if (!hierarchy) return;
+	for (unsigned i = 0; i < hierarchy->n_levels; i++) {
+		free_cache_sim(hierarchy->caches[i]);
+	}
+	free(hierarchy->params);
+	free(hierarchy->caches);
+	free(hierarchy->stats);
+	free(hierarchy);
+}
+
+size_t
+cache_hierarchy_memory_size(const CacheHierarchy *hierarchy)
+{
+	size_t size = 0;
+	for (unsigned i = 0; i < hierarchy->n_levels; i++) {
+		size += cache_sim_memory_size(hierarchy->caches[i]);
+	}
+	return size;
+}
+
+/****************** Inclusive and Non-Inclusive Levels *****************/
+
+static void handle_victim(CacheHierarchy *hierarchy, unsigned level,
+                          const CacheResult *result);
+
+/** Write back block addr from level - 1 into level */
+static void
+write_back(CacheHierarchy *hierarchy, unsigned level, MemAddr addr)
+{
+	hierarchy->stats[level].writebacks++;
+	if (level == hierarchy->n_levels) return;
+	CacheResult result = cache_sim_result(hierarchy->caches[level], addr, true);
+	handle_victim(hierarchy, level, &result);
+}
+
+/** Invalidate all copies of the level block containing addr in the
+ *  levels above level.  Return true if any copy was dirty.
+ */
+static bool
+back_invalidate(CacheHierarchy *hierarchy, unsigned level, MemAddr addr)
+{
+	unsigned blk_bits = hierarchy->params[level].n_blk_offset_bits;
+	MemAddr lo = addr >> blk_bits << blk_bits;
+	MemAddr hi = lo + ((MemAddr)1 << blk_bits);
+	bool is_any_dirty = false;
+	for (unsigned i = 0; i < level; i++) {
+		unsigned upper_bits = hierarchy->params[i].n_blk_offset_bits;
+		MemAddr step = (MemAddr)1 << (upper_bits < blk_bits ? upper_bits : blk_bits);
+		for (MemAddr a = lo; a < hi; a += step) {
+			bool is_dirty;
+			if (cache_sim_invalidate(hierarchy->caches[i], a, &is_dirty)) {
+				hierarchy->stats[i].back_invalidations++;
+				is_any_dirty |= is_dirty;
+			}
+		}
+	}
+	return is_any_dirty;
+}
+
+/** Handle the line (if any) replaced in level by the access which
+ *  produced result.
+ */
+static void
+handle_victim(CacheHierarchy *hierarchy, unsigned level,
+              const CacheResult *result)
+{
+	if (result->status != CACHE_MISS_WITH_REPLACE) return;
+	bool is_dirty = result->is_dirty;
+	if (hierarchy->inclusion == INCLUSIVE_H) {
+		is_dirty |= back_invalidate(hierarchy, level, result->replace_addr);
+	}
+	if (is_dirty) write_back(hierarchy, level + 1, result->replace_addr);
+}
+
+/** Satisfy a demand read of addr arriving at level; return the level
+ *  which supplied the block.
+ */
+static unsigned
+fetch(CacheHierarchy *hierarchy, unsigned level, MemAddr addr, bool is_write)
+{
+	LevelStats *stats = &hierarchy->stats[level];
+	stats->accesses++;
+	if (level == hierarchy->n_levels) return level;
+	CacheResult result =
+		cache_sim_result(hierarchy->caches[level], addr, is_write);
+	if (result.status == CACHE_HIT) {
+		stats->hits++;
+		return level;
+	}
+	stats->misses++;
+	handle_victim(hierarchy, level, &result);
+	return fetch(hierarchy, level + 1, addr, false);
+}
+
+/************************** Exclusive Levels ***************************/
+
+/** Insert victim addr from level - 1 into level */
+static void
+insert_victim(CacheHierarchy *hierarchy, unsigned level, MemAddr addr,
+              bool is_dirty)
+{
+	if (level == hierarchy->n_levels) {
+		if (is_dirty) hierarchy->stats[level].writebacks++;
+		return;
+	}
+	hierarchy->stats[level].writebacks++;
+	CacheResult result =
+		cache_sim_result(hierarchy->caches[level], addr, is_dirty);
+	if (result.status == CACHE_MISS_WITH_REPLACE) {
+		insert_victim(hierarchy, level + 1, result.replace_addr, result.is_dirty);
+	}
+}
+
+static unsigned
+exclusive_access(CacheHierarchy *hierarchy, MemAddr addr, bool is_write)
+{
+	CacheSim *l1 = hierarchy->caches[0];
+	hierarchy->stats[0].accesses++;
+	if (cache_sim_probe(l1, addr, NULL)) {
+		hierarchy->stats[0].hits++;
+		cache_sim_result(l1, addr, is_write);
+		return 0;
+	}
+	hierarchy->stats[0].misses++;
+
+	//move the block up from the first level holding it
+	unsigned src;
+	bool is_dirty = false;
+	for (src = 1; src < hierarchy->n_levels; src++) {
+		LevelStats *stats = &hierarchy->stats[src];
+		stats->accesses++;
+		if (cache_sim_invalidate(hierarchy->caches[src], addr, &is_dirty)) {
+			stats->hits++;
+			break;
+		}
+		stats->misses++;
+	}
+	if (src == hierarchy->n_levels) hierarchy->stats[src].accesses++;
+
+	CacheResult result = cache_sim_result(l1, addr, is_write || is_dirty);
+	if (result.status == CACHE_MISS_WITH_REPLACE) {
+		insert_victim(hierarchy, 1, result.replace_addr, result.is_dirty);
+	}
+	return src;
+}
+
+/*************************** Access Routines ***************************/
+
+unsigned
+cache_hierarchy_access(CacheHierarchy *hierarchy, MemAddr addr, bool is_write)
+{
+	return (hierarchy->inclusion == EXCLUSIVE_H)
+		? exclusive_access(hierarchy, addr, is_write)
+		: fetch(hierarchy, 0, addr, is_write);
+}
+
+void
+cache_hierarchy_stats(const CacheHierarchy *hierarchy, unsigned level,
+                      LevelStats *stats)
+{
+	assert(level <= hierarchy->n_levels);
+	*stats = hierarchy->stats[level];
+}
+
+double
+cache_hierarchy_amat(const CacheHierarchy *hierarchy,
+                     const unsigned latencies[])
+{
+	unsigned long n = hierarchy->stats[0].accesses;
+	if (n == 0) return 0.0;
+	double total = 0.0;
+	for (unsigned i = 0; i <= hierarchy->n_levels; i++) {
+		total += (double)latencies[i] * hierarchy->stats[i].accesses;
+	}
+	return total / n;
+}
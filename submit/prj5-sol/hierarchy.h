@@ -0,0 +1,75 @@
+#ifndef HIERARCHY_H_
+#define HIERARCHY_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** A multi-level cache hierarchy: level 0 (L1) is accessed by the
+ *  trace, each level's misses are requests to the next level, and
+ *  the last level's misses are reads of main memory.
+ */
+typedef struct CacheHierarchyImpl CacheHierarchy;
+
+/** Content relationship between the levels of a hierarchy */
+typedef enum {
+  INCLUSIVE_H,   /** every level contains the blocks of the levels above;
+                     lower-level evictions back-invalidate upper levels */
+  EXCLUSIVE_H,   /** a block is in at most one level; lower levels are
+                     filled only by victims from the level above */
+  NINE_H         /** non-inclusive non-exclusive: levels are filled on
+                     misses and evict independently */
+} Inclusion;
+
+/** Per-level counts.  For the pseudo-level representing main memory,
+ *  accesses are memory reads and writebacks memory writes.
+ */
+typedef struct {
+  unsigned long accesses;    // demand requests reaching this level
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long writebacks;  // lines written into this level by the level
+                             // above: dirty victims, or all victims
+                             // for EXCLUSIVE_H
+  unsigned long back_invalidations; // lines invalidated to maintain
+                                    // inclusion
+} LevelStats;
+
+/** Return a new hierarchy with n_levels levels where level i has
+ *  parameters params[i].  Returns NULL if new_cache_sim() rejects any
+ *  params[i] or they cannot be used for inclusion: EXCLUSIVE_H
+ *  requires the same block size at every level.  No requirement that
+ *  params[] remains valid after this call.
+ */
+CacheHierarchy *new_cache_hierarchy(const CacheParams params[],
+                                    unsigned n_levels, Inclusion inclusion);
+
+/** Free all resources used by *hierarchy */
+void free_cache_hierarchy(CacheHierarchy *hierarchy);
+
+/** Return the # of bytes of memory used by the caches of hierarchy */
+size_t cache_hierarchy_memory_size(const CacheHierarchy *hierarchy);
+
+/** Simulate an access to addr by the level-0 cache, propagating misses
+ *  and evictions down the hierarchy.  Return the level which supplied
+ *  the block: 0 for an L1 hit, n_levels for main memory.
+ */
+unsigned cache_hierarchy_access(CacheHierarchy *hierarchy, MemAddr addr,
+                                bool is_write);
+
+/** Set *stats to the counts for level (0 <= level <= n_levels, with
+ *  level n_levels being main memory).
+ */
+void cache_hierarchy_stats(const CacheHierarchy *hierarchy, unsigned level,
+                           LevelStats *stats);
+
+/** Return the average memory access time for the accesses so far, given
+ *  latencies[level] for 0 <= level <= n_levels (latencies[n_levels]
+ *  being main memory): each demand request costs the latency of every
+ *  level it reaches.
+ */
+double cache_hierarchy_amat(const CacheHierarchy *hierarchy,
+                            const unsigned latencies[]);
+
+#endif //ifndef HIERARCHY_H_
@@ -0,0 +1,28 @@
+#include "hyperloglog.h"
+#include <math.h>
+#include <string.h>
+
+void
+clear_hll(HyperLogLog *hll)
+{
+	memset(hll->registers, 0, sizeof(hll->registers));
+}
+
+double
+hll_estimate(const HyperLogLog *hll)
+{
+	const double m = HLL_N_REGISTERS;
+	double sum = 0.0;
+	unsigned n_zeros = 0;
+	for (unsigned i = 0; i < HLL_N_REGISTERS; i++) {
+		sum += ldexp(1.0, -hll->registers[i]);
+		n_zeros += (hll->registers[i] == 0);
+	}
+	double alpha = 0.7213 / (1.0 + 1.079 / m);
+	double estimate = alpha * m * m / sum;
+	//linear counting is more accurate while many registers are empty
+	if (estimate <= 2.5 * m && n_zeros > 0) {
+		estimate = m * log(m / n_zeros);
+	}
+	return estimate;
+}
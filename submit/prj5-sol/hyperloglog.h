@@ -0,0 +1,37 @@
+#ifndef HYPERLOGLOG_H_
+#define HYPERLOGLOG_H_
+
+#include "cache-sim.h"
+#include "hash-map.h"
+
+#include <stdint.h>
+
+/** A HyperLogLog estimate of the # of distinct addresses added, in a
+ *  fixed HLL_N_REGISTERS bytes with a standard error of about 1.6%.
+ */
+enum { HLL_INDEX_BITS = 12, HLL_N_REGISTERS = 1 << HLL_INDEX_BITS };
+
+typedef struct {
+  uint8_t registers[HLL_N_REGISTERS];
+} HyperLogLog;
+
+/** Make *hll empty */
+void clear_hll(HyperLogLog *hll);
+
+/** Add addr to *hll */
+static inline void
+hll_add(HyperLogLog *hll, MemAddr addr)
+{
+  uint64_t h = hash_mem_addr(addr);
+  unsigned i = h >> (64 - HLL_INDEX_BITS);
+  //rank of the first 1 bit in the remaining bits; the sentinel bit
+  //bounds it when they are all 0
+  uint64_t rest = (h << HLL_INDEX_BITS) | ((uint64_t)1 << (HLL_INDEX_BITS - 1));
+  uint8_t rank = __builtin_clzll(rest) + 1;
+  if (rank > hll->registers[i]) hll->registers[i] = rank;
+}
+
+/** Return the estimated # of distinct addresses added to *hll */
+double hll_estimate(const HyperLogLog *hll);
+
+#endif //ifndef HYPERLOGLOG_H_
@@ -1,72 +1,321 @@
 #include "cache-sim.h"
+#include "classify.h"
+#include "coherence.h"
+#include "hierarchy.h"
+#include "hyperloglog.h"
+#include "memalloc.h"
+#include "replacement.h"
+#include "result-writer.h"
+#include "sample.h"
+#include "sharded.h"
+#include "sweep.h"
+#include "tlb.h"
+#include "trace.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+enum { SWEEP_DEFAULT_MEM_ADDR_BITS = 64 };
+enum { MAX_LEVELS = 8 };
+
+#define REPLACEMENT_NAMES "lru|mru|rand|plru|srrip|brrip|lfu|opt"
+#define PREFETCH_NAMES "next|stride|stream"
+
+//default per-level latencies in cycles; memory latency is last
+static const unsigned DEFAULT_LATENCIES[] = { 4, 12, 40, 200 };
 
 static void
 usage(const char *program, const char *msg)
 {
-  fprintf(stderr, "%susage: %s [-r lru|mru|rand] [-s seed] [-q] m-s-b-E\n"
+  fprintf(stderr, "%susage: %s [-r REPLACE] [-s seed] [-q] [-t TRACE] [-j N]\n"
+          "          [-p PREFETCH] [-c] [--interval N [--interval-out PATH]]\n"
+          "          [--tlb ENTRIES-WAYS-4k|2m] [--sample K]\n"
+          "          [--results-out PATH] [-w back|through]\n"
+          "          [-a alloc|noalloc] [-V N] [--sectors N] [--load-state PATH]\n"
+          "          [--save-state PATH] m-s-b-E\n"
+          "       %s [-r REPLACE] [-s seed] [-q] [-t TRACE]\n"
+          "          [-i incl|excl|nine] [-l LATENCY,...] m-s-b-E m-s-b-E...\n"
+          "       %s [-r REPLACE] [-s seed] [-q] -C TRACE,TRACE...\n"
+          "          m-s-b-E [m-s-b-E]\n"
+          "       %s [-t TRACE] --sweep [m=M] s=VALUES b=VALUES E=VALUES\n"
           "where m-s-b-E specified cache parameters:\n"
           "  m: total # of bits used to address memory\n"
           "  s: # of bits in address used to specify set index\n"
           "  b: # of bits in address used to specify offset in cache block\n"
           "  E: # of cache lines per set\n"
-          "  must have all non-negative and 2 <= b and b + s < m\n",
-          msg, program);
+          "  must have all non-negative and 2 <= b and b + s < m\n"
+          "REPLACE is one of " REPLACEMENT_NAMES " (default lru)\n"
+          "plru requires E to be a power of 2\n"
+          "-s seeds rand and brrip replacement\n"
+          "opt replacement reads the whole trace before simulating it\n"
+          "(not with -j, -p or a hierarchy)\n"
+          "-j simulates the sets of the cache on N threads (not for rand,\n"
+          "brrip, opt or a hierarchy)\n"
+          "-p PREFETCH is " PREFETCH_NAMES " optionally followed by\n"
+          ":DEGREE and :LATENCY in accesses (not with -j or a hierarchy)\n"
+          "-c classifies misses as compulsory, capacity or conflict\n"
+          "(not with -j or a hierarchy)\n"
+          "--interval outputs a CSV record of the counts and an estimate\n"
+          "of the # of distinct blocks for every N accesses to PATH\n"
+          "(default stdout) (not with -j or a hierarchy)\n"
+          "--tlb looks up each access in an LRU TLB of ENTRIES entries\n"
+          "and WAYS ways for 4K or 2M pages, reading the page-table entries\n"
+          "of a walk through the cache on each TLB miss (not with -j, -c,\n"
+          "opt or a hierarchy)\n"
+          "--sample simulates only about 1 in K sets and outputs counts\n"
+          "extrapolated from them with a 95%% confidence interval for the\n"
+          "miss rate; no per-access output (only with -r, -s, -q and -t)\n"
+          "--results-out also writes a binary stream of the status and\n"
+          "replace address of each access to PATH (not with -j, --sample\n"
+          "or a hierarchy)\n"
+          "-w selects write-back (default) or write-through, -a\n"
+          "write-allocate (default) or no-write-allocate and -V adds a\n"
+          "fully associative LRU victim cache of N <= %d lines; any of\n"
+          "them outputs memory traffic counts (not with -j, -p, --sample\n"
+          "or a hierarchy)\n"
+          "--sectors splits each block into N sectors, a power of 2 <= %d,\n"
+          "with their own valid and dirty bits, fetching only the sectors\n"
+          "accessed; outputs memory traffic counts like -w (not with -V)\n"
+          "--load-state starts from the cache state saved by --save-state\n"
+          "for the same m-s-b-E and options instead of an empty cache;\n"
+          "--save-state saves the state after the trace (not with -j,\n"
+          "--sample, opt or a hierarchy)\n"
+          "-t reads the binary TRACE produced by trace-conv instead of\n"
+          "a text trace from stdin; --ring NAME instead reads the binary\n"
+          "trace written to the shared-memory trace ring NAME by a running\n"
+          "program, waiting for it to be created (see trace-ring.h)\n"
+          "multiple m-s-b-E specs simulate a hierarchy L1, L2, ... with\n"
+          "inclusion policy -i (default nine) and one -l latency per level\n"
+          "followed by the memory latency (default 4,12,40 and 200)\n"
+          "-C simulates one core per text or binary TRACE, each with a\n"
+          "private MESI-coherent L1 given by the first m-s-b-E and sharing\n"
+          "the L2 given by the optional second m-s-b-E (at most %d cores)\n"
+          "--sweep simulates LRU caches for all combinations of VALUES in a\n"
+          "single pass; VALUES is a comma-separated list of N or LO..HI;\n"
+          "m defaults to %d\n",
+          msg, program, program, program, program, VICTIM_MAX_LINES,
+          SECTOR_MAX, COHERENT_MAX_CORES,
+          SWEEP_DEFAULT_MEM_ADDR_BITS);
     exit(1);
 }
 
 typedef struct {
   const char *name;
-  Replacement replacement;
-} ReplacementName;
+  PrefetchKind kind;
+  unsigned degree;         // default degree
+} PrefetchName;
 
-static ReplacementName REPLACEMENTS[] = {
-  { "lru", LRU_R },
-  { "mru", MRU_R },
-  { "rand", RANDOM_R },
+static PrefetchName PREFETCHES[] = {
+  { "next", NEXT_LINE_PF, 1 },
+  { "stride", STRIDE_PF, 2 },
+  { "stream", STREAM_PF, 4 },
 };
 
-/** Translate from name to Replacement enum.  Return < 0 on error */
+enum { DEFAULT_PREFETCH_LATENCY = 8 };
+
+/** Parse KIND[:DEGREE[:LATENCY]] spec into *params.  Returns false on
+ *  error.
+ */
+static bool
+parse_prefetch(const char *spec, PrefetchParams *params)
+{
+  size_t len = strcspn(spec, ":");
+  const PrefetchName *name = NULL;
+  for (int i = 0; i < sizeof(PREFETCHES)/sizeof(PREFETCHES[0]); i++) {
+    if (strlen(PREFETCHES[i].name) == len &&
+        strncmp(spec, PREFETCHES[i].name, len) == 0) {
+      name = &PREFETCHES[i];
+    }
+  }
+  if (!name) return false;
+  params->kind = name->kind;
+  params->degree = name->degree;
+  params->latency = DEFAULT_PREFETCH_LATENCY;
+  unsigned *values[] = { &params->degree, &params->latency };
+  const char *p = &spec[len];
+  for (int i = 0; i < 2 && *p == ':'; i++) {
+    char *end;
+    unsigned long value = strtoul(++p, &end, 10);
+    if (end == p || !isdigit(*p)) return false;
+    *values[i] = value;
+    p = end;
+  }
+  return *p == '\0' && 0 < params->degree &&
+    params->degree <= PREFETCH_MAX_DEGREE;
+}
+
+/** Parse ENTRIES-WAYS-4k|2m from spec into *params.  Returns false on
+ *  error.
+ */
+static bool
+parse_tlb(const char *spec, TlbParams *params)
+{
+  unsigned *values[] = { &params->n_entries, &params->n_ways };
+  const char *p = spec;
+  for (int i = 0; i < 2; i++) {
+    char *end;
+    unsigned long value = strtoul(p, &end, 10);
+    if (end == p || !isdigit(*p) || *end != '-' || value == 0) return false;
+    *values[i] = value;
+    p = end + 1;
+  }
+  if (strcmp(p, "4k") == 0) {
+    params->page_bits = 12;
+  }
+  else if (strcmp(p, "2m") == 0) {
+    params->page_bits = 21;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+typedef struct {
+  const char *name;
+  Inclusion inclusion;
+} InclusionName;
+
+static InclusionName INCLUSIONS[] = {
+  { "incl", INCLUSIVE_H },
+  { "excl", EXCLUSIVE_H },
+  { "nine", NINE_H },
+};
+
+/** Translate from name to Inclusion enum.  Return < 0 on error */
 static int
-get_replacement(const char *name) {
-  for (int i = 0; i < sizeof(REPLACEMENTS)/sizeof(REPLACEMENTS[0]); i++) {
-    if (strcmp(name, REPLACEMENTS[i].name) == 0) {
-      return REPLACEMENTS[i].replacement;
+get_inclusion(const char *name) {
+  for (int i = 0; i < sizeof(INCLUSIONS)/sizeof(INCLUSIONS[0]); i++) {
+    if (strcmp(name, INCLUSIONS[i].name) == 0) {
+      return INCLUSIONS[i].inclusion;
     }
   }
   return -1;
 }
 
+/** Parse m-s-b-E params_spec into *params.  Returns false on error. */
+static bool
+parse_cache_params(const char *params_spec, Replacement replacement,
+                   unsigned long seed, CacheParams *params)
+{
+  *params = (CacheParams) { .replacement = replacement, .seed = seed };
+  if (sscanf(params_spec, "%u-%u-%u-%u",
+             &params->n_mem_addr_bits, &params->n_set_index_bits,
+             &params->n_blk_offset_bits, &params->n_lines_per_set) != 4) {
+    return false;
+  }
+  bool is_sum_ok =
+    params->n_set_index_bits + params->n_blk_offset_bits < params->n_mem_addr_bits;
+  return is_sum_ok && 2 <= params->n_blk_offset_bits;
+}
+
+/** Write handling, victim cache and sector options for make_cache_sim() */
+typedef struct {
+  WritePolicy write_policy;
+  AllocatePolicy allocate_policy;
+  unsigned n_victim_lines;
+  unsigned n_sectors;
+} WriteOptions;
+
 /** Somewhat non-elegant allocation here to force new_cache_sim() to
- *  make copies of *params.  Sets *n_mem_addr_bits which is used for
- *  verbose formatting in do_cache_sim().  Returns NULL on error.
+ *  make copies of *params.  Sets *params which is used for verbose
+ *  formatting in do_cache_sim() and for miss classification.  If
+ *  state_path is non-NULL, loads the cache from the state saved there,
+ *  exiting if that fails.  Returns NULL on error.
  */
 static CacheSim *
 make_cache_sim(const char *params_spec, Replacement replacement,
-               unsigned *n_mem_addr_bits)
+               unsigned long seed, const PrefetchParams *prefetch,
+               const WriteOptions *writes, const char *state_path,
+               CacheParams *params)
 {
-  CacheParams params;
-  params.replacement = replacement;
-  if (sscanf(params_spec, "%u-%u-%u-%u",
-             &params.n_mem_addr_bits, &params.n_set_index_bits,
-             &params.n_blk_offset_bits, &params.n_lines_per_set) != 4) {
+  if (!parse_cache_params(params_spec, replacement, seed, params)) {
     return NULL;
   }
-  *n_mem_addr_bits = params.n_mem_addr_bits;
-  bool is_sum_ok =
-    params.n_set_index_bits + params.n_blk_offset_bits < params.n_mem_addr_bits;
-  return (is_sum_ok && 2 <= params.n_blk_offset_bits)
-         ? new_cache_sim(&params)
-         : NULL;
+  params->prefetch = *prefetch;
+  params->write_policy = writes->write_policy;
+  params->allocate_policy = writes->allocate_policy;
+  params->n_victim_lines = writes->n_victim_lines;
+  params->n_sectors = writes->n_sectors;
+  if (!state_path) return new_cache_sim(params);
+  CacheSim *cache = cache_sim_load(state_path, params);
+  if (!cache) {
+    fprintf(stderr, "cannot load cache state %s: %s\n", state_path,
+            (errno == EINVAL)
+            ? "not a saved state of this cache"
+            : strerror(errno));
+    exit(1);
+  }
+  return cache;
+}
+
+/** Split the comma-separated trace paths in spec into paths[], which
+ *  has room for COHERENT_MAX_CORES paths.  Returns the # of paths, 0
+ *  on error.  The paths point into a copy of spec returned in *copy,
+ *  which the caller must free().
+ */
+static unsigned
+parse_core_paths(const char *spec, const char *paths[], char **copy)
+{
+  *copy = malloc_chk(strlen(spec) + 1);
+  strcpy(*copy, spec);
+  unsigned n = 0;
+  for (char *p = *copy; ; p++) {
+    if (n == COHERENT_MAX_CORES) return 0;
+    paths[n++] = p;
+    p = strchr(p, ',');
+    if (!p) break;
+    *p = '\0';
+  }
+  for (unsigned k = 0; k < n; k++) {
+    if (*paths[k] == '\0') return 0;
+  }
+  return n;
 }
 
+/** Parse comma-separated latencies into latencies[], returning the
+ *  # of latencies; < 0 on error.
+ */
+static int
+parse_latencies(const char *spec, unsigned latencies[], int max)
+{
+  int n = 0;
+  const char *p = spec;
+  while (n < max) {
+    char *end;
+    unsigned long latency = strtoul(p, &end, 10);
+    if (end == p || !isdigit(*p)) return -1;
+    latencies[n++] = latency;
+    if (*end == '\0') return n;
+    if (*end != ',') return -1;
+    p = end + 1;
+  }
+  return -1;
+}
+
+/** Report the memory used for cache state on stderr */
+static void
+out_memory_size(const char *program, size_t n_bytes, size_t set_size)
+{
+  fprintf(stderr, "%s: %zu bytes of cache state", program, n_bytes);
+  if (set_size > 0) fprintf(stderr, " (%zu bytes per set)", set_size);
+  fprintf(stderr, "\n");
+}
+
+/** Output the counts stats[] of nTotal accesses, followed by the bytes
+ *  moved to and from memory if traffic is non-NULL.
+ */
 static void
-out_cache_stats(unsigned long stats[], unsigned long nTotal, FILE *out)
+out_cache_stats(unsigned long stats[], unsigned long nTotal,
+                const CacheTraffic *traffic, FILE *out)
 {
   enum { W = 30 };
   for (int i = 0; i < CACHE_N_STATUS + 1; i++) {
@@ -87,6 +336,55 @@ out_cache_stats(unsigned long stats[], unsigned long nTotal, FILE *out)
     fprintf(out, " %lu/%lu (%.2f%%)\n", stats[i], nTotal,
           (nTotal == 0) ? 0 : stats[i] * 100.0/nTotal);
   }
+  if (traffic) {
+    fprintf(out, "%-*s %lu\n", W, "# bytes fetched:", traffic->bytes_fetched);
+    fprintf(out, "%-*s %lu\n", W, "# bytes written back:",
+            traffic->bytes_written_back);
+  }
+}
+
+static void
+out_count(const char *label, unsigned long count, unsigned long n_total,
+          FILE *out)
+{
+  enum { W = 30 };
+  fprintf(out, "%-*s %lu/%lu (%.2f%%)\n", W, label, count, n_total,
+          (n_total == 0) ? 0 : count * 100.0/n_total);
+}
+
+static void
+out_prefetch_stats(const PrefetchStats *stats, unsigned long n_misses,
+                   FILE *out)
+{
+  enum { W = 30 };
+  fprintf(out, "%-*s %lu\n", W, "# prefetches issued:", stats->issued);
+  out_count("# useful prefetches:", stats->useful, stats->issued, out);
+  out_count("# late prefetches:", stats->late, stats->useful, out);
+  out_count("# useless prefetches:", stats->useless, stats->issued, out);
+  //misses supplied by stream buffers are still cache misses
+  out_count("# prefetch coverage:", stats->useful,
+            stats->useful + n_misses - stats->buffer_hits, out);
+  fprintf(out, "%-*s %lu\n", W, "# pollution evictions:", stats->pollution);
+  fprintf(out, "%-*s %lu\n", W, "# prefetch dirty evictions:",
+          stats->dirty_evictions);
+}
+
+/** Output the memory traffic of a cache with n_misses misses, with the
+ *  victim-cache hits if is_victim.
+ */
+static void
+out_traffic_stats(const CacheTraffic *traffic, unsigned long n_misses,
+                  bool is_victim, FILE *out)
+{
+  enum { W = 30 };
+  fprintf(out, "%-*s %lu\n", W, "# memory block reads:", traffic->block_reads);
+  fprintf(out, "%-*s %lu\n", W, "# memory block writes:",
+          traffic->block_writes);
+  fprintf(out, "%-*s %lu\n", W, "# memory word writes:",
+          traffic->word_writes);
+  if (is_victim) {
+    out_count("# victim-cache hits:", traffic->victim_hits, n_misses, out);
+  }
 }
 
 //must be in sync with CACHE_STATUS enum
@@ -94,73 +392,606 @@ static const char *STATUS_STRS[] = {
   "h", "m", "M"
 };
 
+//must be in sync with MissClass enum
+static const char *MISS_CLASS_STRS[] = {
+  "", "compulsory", "capacity", "conflict"
+};
+
+static void
+out_miss_classes(const unsigned long counts[N_MISS_CLASSES],
+                 unsigned long n_misses, FILE *out)
+{
+  char label[32];
+  for (int c = COMPULSORY_C; c < N_MISS_CLASSES; c++) {
+    snprintf(label, sizeof(label), "# %s misses:", MISS_CLASS_STRS[c]);
+    out_count(label, counts[c], n_misses, out);
+  }
+}
+
+/** Output result of an access; a non-NULL note is appended in [] */
+static void
+out_result(const CacheResult *result, bool is_write, unsigned addr_width,
+           const char *note, FILE *out)
+{
+  fprintf(out, "0x%0*lx %c: %s", addr_width, result->access_addr,
+          is_write ? 'w' : 'r', STATUS_STRS[result->status]);
+  if (result->status == CACHE_MISS_WITH_REPLACE) {
+    fprintf(out, " 0x%0*lx%s", addr_width, result->replace_addr,
+            result->is_dirty ? " w" : "");
+  }
+  if (note) fprintf(out, " [%s]", note);
+  fprintf(out, "\n");
+}
+
+/** Options for do_cache_sim() */
+typedef struct {
+  bool is_quiet;
+  bool is_prefetch;             // output prefetch stats
+  bool is_traffic;              // output memory traffic stats
+  MissClassifier *classifier;   // classify misses unless NULL
+  unsigned long interval;       // if non-zero, output stats for every
+                                // interval accesses to interval_out
+  FILE *interval_out;
+  Tlb *tlb;                     // translate through tlb unless NULL
+  const char *tlb_spec;
+  SetSampler *sampler;          // simulate only sampled sets unless NULL
+  ResultWriter *results_out;    // write binary results unless NULL
+} SimOptions;
+
+/** Add the counts of results[0..n-1] to stats[], accumulating in
+ *  locals and updating stats[] once.
+ */
+static void
+count_results(const CacheResult results[], size_t n,
+              unsigned long stats[CACHE_N_STATUS + 1])
+{
+  unsigned long n_hits = 0, n_no_replace = 0, n_dirty = 0;
+  for (size_t i = 0; i < n; i++) {
+    CacheStatus status = results[i].status;
+    n_hits += (status == CACHE_HIT);
+    n_no_replace += (status == CACHE_MISS_WITHOUT_REPLACE);
+    n_dirty += (status == CACHE_MISS_WITH_REPLACE) & results[i].is_dirty;
+  }
+  stats[CACHE_HIT] += n_hits;
+  stats[CACHE_MISS_WITHOUT_REPLACE] += n_no_replace;
+  stats[CACHE_MISS_WITH_REPLACE] += n - n_hits - n_no_replace;
+  stats[CACHE_N_STATUS] += n_dirty;
+}
+
+/** Counts for the current interval of an --interval run */
 typedef struct {
-  enum { OK_READ, SKIP_READ, ERR_READ } status;
-  MemAddr addr;
-  char rw;
-} AddrRead;
+  unsigned long index;
+  unsigned long n_accesses;
+  unsigned long stats[CACHE_N_STATUS + 1];
+  HyperLogLog blocks;           // distinct blocks accessed
+} Interval;
+
+static void
+out_interval_header(FILE *out)
+{
+  fprintf(out, "interval,accesses,hits,misses,replaces,dirty_writes,"
+          "distinct_blocks\n");
+}
 
-static AddrRead
-parse_access(const char *line)
+/** Output the CSV record for *interval, add its counts to stats[] and
+ *  start the next interval.
+ */
+static void
+flush_interval(Interval *interval, unsigned long stats[CACHE_N_STATUS + 1],
+               FILE *out)
 {
-  AddrRead read;
-  char *p;
-  for (p = (char *)line; isspace(*p); p++) {
-    //skip space
+  unsigned long *counts = interval->stats;
+  fprintf(out, "%lu,%lu,%lu,%lu,%lu,%lu,%.0f\n", interval->index,
+          interval->n_accesses, counts[CACHE_HIT],
+          counts[CACHE_MISS_WITHOUT_REPLACE] + counts[CACHE_MISS_WITH_REPLACE],
+          counts[CACHE_MISS_WITH_REPLACE], counts[CACHE_N_STATUS],
+          hll_estimate(&interval->blocks));
+  for (int i = 0; i < CACHE_N_STATUS + 1; i++) {
+    stats[i] += counts[i];
+    counts[i] = 0;
   }
-  if (*p == '#' || *p == '\0') { read.status = SKIP_READ; return read; }
-  if (*p != '0' || (p[1] != 'x' && p[1] != 'X')) {
-    read.status = ERR_READ; return read;
+  interval->index++;
+  interval->n_accesses = 0;
+  clear_hll(&interval->blocks);
+}
+
+/** Output the TLB counts, with the page walks' shares of the cache
+ *  accesses and misses given the n_data accesses and n_data_misses
+ *  misses of the trace itself.
+ */
+static void
+out_tlb_stats(const Tlb *tlb, const char *spec, unsigned long n_data,
+              unsigned long n_data_misses, FILE *out)
+{
+  enum { W = 30 };
+  TlbStats stats;
+  tlb_stats(tlb, &stats);
+  fprintf(out, "## TLB %s (%u-level page walks)\n", spec, tlb_n_levels(tlb));
+  out_count("# TLB hits:", stats.hits, stats.accesses, out);
+  out_count("# TLB misses:", stats.misses, stats.accesses, out);
+  out_count("# walk cache accesses:", stats.walk_reads,
+            stats.walk_reads + n_data, out);
+  out_count("# walk cache misses:", stats.walk_misses,
+            stats.walk_misses + n_data_misses, out);
+}
+
+/** Output the counts stats[] of the sampled accesses extrapolated to
+ *  the whole trace, followed by the sample and the confidence
+ *  interval for the miss rate.
+ */
+static void
+out_sample_estimate(const SetSampler *sampler,
+                    const unsigned long stats[CACHE_N_STATUS + 1], FILE *out)
+{
+  enum { W = 30 };
+  SampleEstimate estimate;
+  set_sampler_estimate(sampler, &estimate);
+  double scale = (estimate.n_sampled_accesses == 0)
+    ? 0.0
+    : (double)estimate.n_accesses / estimate.n_sampled_accesses;
+  unsigned long scaled[CACHE_N_STATUS + 1];
+  for (int i = 0; i < CACHE_N_STATUS + 1; i++) {
+    scaled[i] = (unsigned long)(stats[i] * scale + 0.5);
+  }
+  out_cache_stats(scaled, estimate.n_accesses, NULL, out);
+  fprintf(out, "## estimated from a sample of sets\n");
+  out_count("# sampled sets:", estimate.n_sampled_sets, estimate.n_sets, out);
+  out_count("# sampled accesses:", estimate.n_sampled_accesses,
+            estimate.n_accesses, out);
+  if (isnan(estimate.miss_rate_error)) {
+    fprintf(out, "%-*s %.2f%% (no interval: too few sets)\n", W,
+            "# miss rate 95% CI:", estimate.miss_rate * 100.0);
+  }
+  else {
+    fprintf(out, "%-*s %.2f%% +/- %.2f%%\n", W, "# miss rate 95% CI:",
+            estimate.miss_rate * 100.0, estimate.miss_rate_error * 100.0);
   }
-  read.addr = strtol(line, &p, 0);
-  if (p == line) { read.status = ERR_READ; return read; }
-  char rw = 'r';
-  sscanf(p, " %c", &rw);
-  if (rw == '#') { read.rw = 'r'; return read; }
-  if (rw != 'r' && rw != 'w') { read.status = ERR_READ; return read; };
-  read.status = OK_READ;
-  read.rw = rw;
-  return read;
 }
 
+/** Flush and free writer, exiting on a write error */
 static void
-do_cache_sim(CacheSim *cache, bool is_quiet,
-             unsigned n_mem_addr_bits, FILE *in, FILE *out)
+finish_result_writer(ResultWriter *writer)
 {
+  if (!free_result_writer(writer)) {
+    fprintf(stderr, "error writing results: %s\n", strerror(errno));
+    exit(1);
+  }
+}
+
+/** Simulate the trace on in with cache having parameters *params */
+static void
+do_cache_sim(CacheSim *cache, const CacheParams *params,
+             const SimOptions *opts, TraceReader *in, FILE *out)
+{
+  enum { BATCH_SIZE = 4096 };
+  MemAddr addrs[BATCH_SIZE];
+  bool is_writes[BATCH_SIZE];
+  CacheResult results[BATCH_SIZE];
   unsigned long stats[CACHE_N_STATUS + 1] = { 0UL };
+  unsigned long class_counts[N_MISS_CLASSES] = { 0UL };
+  unsigned addr_width = (params->n_mem_addr_bits + 3)/4;
+  unsigned blk_bits = params->n_blk_offset_bits;
+  bool is_per_access =
+    !opts->is_quiet || opts->classifier || opts->results_out;
+  Interval interval = { .index = 0 };
+  if (opts->interval) out_interval_header(opts->interval_out);
+  //per-access results bypass out's stdio buffer
+  fflush(out);
+  ResultWriter *writer =
+    opts->is_quiet ? NULL : new_text_result_writer(fileno(out), addr_width);
+  unsigned long n_total = 0UL;
+  size_t n;
+  do {
+    n = trace_read(in, BATCH_SIZE, addrs, is_writes);
+    if (opts->sampler) {
+      size_t n_sampled = set_sampler_filter(opts->sampler, n, addrs,
+                                            is_writes, addrs, is_writes);
+      cache_sim_results(cache, n_sampled, addrs, is_writes, results);
+      set_sampler_count(opts->sampler, n_sampled, addrs, results);
+      count_results(results, n_sampled, stats);
+      n_total += n;
+      continue;
+    }
+    if (opts->tlb) {
+      tlb_cache_sim_results(opts->tlb, cache, n, addrs, is_writes, results);
+    }
+    else {
+      cache_sim_results(cache, n, addrs, is_writes, results);
+    }
+    n_total += n;
+    //process the batch in segments which end at interval boundaries
+    size_t end;
+    for (size_t i = 0; i < n; i = end) {
+      end = n;
+      if (opts->interval) {
+        unsigned long n_left = opts->interval - interval.n_accesses;
+        if (n_left < n - i) end = i + n_left;
+        count_results(&results[i], end - i, interval.stats);
+        for (size_t k = i; k < end; k++) {
+          hll_add(&interval.blocks, addrs[k] >> blk_bits);
+        }
+        interval.n_accesses += end - i;
+      }
+      else {
+        count_results(&results[i], end - i, stats);
+      }
+      for (size_t k = i; is_per_access && k < end; k++) {
+        const CacheResult *result = &results[k];
+        const char *note = NULL;
+        if (opts->classifier) {
+          MissClass c = classify_access(opts->classifier, addrs[k],
+                                        result->status != CACHE_HIT);
+          class_counts[c]++;
+          if (c != NOT_MISS_C) note = MISS_CLASS_STRS[c];
+        }
+        if (writer) result_write(writer, result, is_writes[k], note);
+        if (opts->results_out) {
+          result_write(opts->results_out, result, is_writes[k], NULL);
+        }
+      }
+      if (opts->interval && interval.n_accesses == opts->interval) {
+        if (writer && opts->interval_out == out) {
+          result_writer_flush(writer);
+        }
+        flush_interval(&interval, stats, opts->interval_out);
+        fflush(opts->interval_out);
+      }
+    }
+  } while (n == BATCH_SIZE);
+  if (writer) finish_result_writer(writer);
+  if (interval.n_accesses > 0) {
+    flush_interval(&interval, stats, opts->interval_out);
+  }
+  if (opts->sampler) {
+    out_sample_estimate(opts->sampler, stats, out);
+    return;
+  }
+  CacheTraffic traffic;
+  cache_sim_traffic(cache, &traffic);
+  out_cache_stats(stats, n_total, opts->is_traffic ? &traffic : NULL, out);
+  if (opts->classifier) {
+    out_miss_classes(class_counts, n_total - stats[CACHE_HIT], out);
+  }
+  if (opts->is_prefetch) {
+    PrefetchStats prefetch_stats;
+    cache_sim_prefetch_stats(cache, &prefetch_stats);
+    out_prefetch_stats(&prefetch_stats,
+                       stats[CACHE_MISS_WITHOUT_REPLACE] +
+                       stats[CACHE_MISS_WITH_REPLACE], out);
+  }
+  if (opts->is_traffic) {
+    out_traffic_stats(&traffic, n_total - stats[CACHE_HIT],
+                      params->n_victim_lines > 0, out);
+  }
+  if (opts->tlb) {
+    out_tlb_stats(opts->tlb, opts->tlb_spec, n_total,
+                  n_total - stats[CACHE_HIT], out);
+  }
+}
+
+static void
+do_sharded_sim(ShardedSim *sim, bool is_quiet,
+               unsigned n_mem_addr_bits, TraceReader *in, FILE *out)
+{
+  enum { BATCH_SIZE = SHARDED_MAX_BATCH };
+  MemAddr addrs[BATCH_SIZE];
+  bool is_writes[BATCH_SIZE];
+  CacheResult results[BATCH_SIZE];
   unsigned addr_width = (n_mem_addr_bits + 3)/4;
   unsigned long n_total = 0UL;
-  char *line = NULL;
-  size_t line_size = 0;
+  fflush(out);
+  ResultWriter *writer =
+    is_quiet ? NULL : new_text_result_writer(fileno(out), addr_width);
+  size_t n;
+  do {
+    n = trace_read(in, BATCH_SIZE, addrs, is_writes);
+    sharded_sim_results(sim, n, addrs, is_writes, results);
+    n_total += n;
+    if (is_quiet) continue;
+    for (size_t i = 0; i < n; i++) {
+      result_write(writer, &results[i], is_writes[i], NULL);
+    }
+  } while (n == BATCH_SIZE);
+  if (writer) finish_result_writer(writer);
+  unsigned long stats[CACHE_N_STATUS + 1];
+  sharded_sim_finish(sim, stats);
+  out_cache_stats(stats, n_total, NULL, out);
+}
+
+static void
+out_hierarchy_stats(const CacheHierarchy *hierarchy, unsigned n_levels,
+                    const char *specs[], const unsigned latencies[],
+                    FILE *out)
+{
+  enum { W = 30 };
+  for (unsigned level = 0; level < n_levels; level++) {
+    LevelStats stats;
+    cache_hierarchy_stats(hierarchy, level, &stats);
+    fprintf(out, "## L%u %s (latency %u)\n", level + 1, specs[level],
+            latencies[level]);
+    fprintf(out, "%-*s %lu\n", W, "# accesses:", stats.accesses);
+    out_count("# hits:", stats.hits, stats.accesses, out);
+    out_count("# misses:", stats.misses, stats.accesses, out);
+    fprintf(out, "%-*s %lu\n", W, "# write-backs in:", stats.writebacks);
+    fprintf(out, "%-*s %lu\n", W, "# back-invalidations:",
+            stats.back_invalidations);
+  }
+  LevelStats mem;
+  cache_hierarchy_stats(hierarchy, n_levels, &mem);
+  fprintf(out, "## memory (latency %u)\n", latencies[n_levels]);
+  fprintf(out, "%-*s %lu\n", W, "# reads:", mem.accesses);
+  fprintf(out, "%-*s %lu\n", W, "# writes:", mem.writebacks);
+  fprintf(out, "%-*s %.2f cycles\n", W, "# AMAT:",
+          cache_hierarchy_amat(hierarchy, latencies));
+}
+
+static void
+do_hierarchy_sim(CacheHierarchy *hierarchy, unsigned n_levels,
+                 const char *specs[], const unsigned latencies[],
+                 bool is_quiet, unsigned n_mem_addr_bits,
+                 TraceReader *in, FILE *out)
+{
+  enum { BATCH_SIZE = 4096 };
+  MemAddr addrs[BATCH_SIZE];
+  bool is_writes[BATCH_SIZE];
+  unsigned addr_width = (n_mem_addr_bits + 3)/4;
+  size_t n;
+  do {
+    n = trace_read(in, BATCH_SIZE, addrs, is_writes);
+    for (size_t i = 0; i < n; i++) {
+      unsigned src = cache_hierarchy_access(hierarchy, addrs[i], is_writes[i]);
+      if (is_quiet) continue;
+      fprintf(out, "0x%0*lx %c: ", addr_width, addrs[i],
+              is_writes[i] ? 'w' : 'r');
+      if (src < n_levels) {
+        fprintf(out, "L%u\n", src + 1);
+      }
+      else {
+        fprintf(out, "mem\n");
+      }
+    }
+  } while (n == BATCH_SIZE);
+  out_hierarchy_stats(hierarchy, n_levels, specs, latencies, out);
+}
+
+static void
+out_coherent_stats(const CoherentSim *sim, unsigned n_cores,
+                   const char *specs[], unsigned n_specs, FILE *out)
+{
+  enum { W = 30 };
+  CoreStats total = { 0 };
+  for (unsigned c = 0; c < n_cores; c++) {
+    CoreStats stats;
+    coherent_sim_core_stats(sim, c, &stats);
+    fprintf(out, "## core %u L1 %s\n", c, specs[0]);
+    fprintf(out, "%-*s %lu\n", W, "# accesses:", stats.accesses);
+    out_count("# hits:", stats.hits, stats.accesses, out);
+    out_count("# misses:", stats.misses, stats.accesses, out);
+    out_count("# coherence misses:", stats.coherence_misses, stats.misses,
+              out);
+    fprintf(out, "%-*s %lu\n", W, "# upgrades:", stats.upgrades);
+    fprintf(out, "%-*s %lu\n", W, "# invalidations:", stats.invalidations);
+    fprintf(out, "%-*s %lu\n", W, "# dirty interventions:",
+            stats.interventions);
+    fprintf(out, "%-*s %lu\n", W, "# write-backs:", stats.writebacks);
+    total.accesses += stats.accesses;
+    total.misses += stats.misses;
+    total.coherence_misses += stats.coherence_misses;
+    total.upgrades += stats.upgrades;
+    total.invalidations += stats.invalidations;
+    total.interventions += stats.interventions;
+  }
+  fprintf(out, "## all cores\n");
+  out_count("# misses:", total.misses, total.accesses, out);
+  out_count("# coherence misses:", total.coherence_misses, total.misses, out);
+  fprintf(out, "%-*s %lu\n", W, "# upgrades:", total.upgrades);
+  fprintf(out, "%-*s %lu\n", W, "# invalidations:", total.invalidations);
+  fprintf(out, "%-*s %lu\n", W, "# dirty interventions:",
+          total.interventions);
+  if (n_specs > 1) {
+    unsigned long stats[CACHE_N_STATUS + 1];
+    coherent_sim_l2_stats(sim, stats);
+    unsigned long n_total = 0;
+    for (int i = 0; i < CACHE_N_STATUS; i++) n_total += stats[i];
+    fprintf(out, "## shared L2 %s\n", specs[1]);
+    out_cache_stats(stats, n_total, NULL, out);
+  }
+}
+
+/** Simulate the per-core traces in[0..n_cores-1], interleaving them
+ *  one access per core at a time until each runs out.
+ */
+static void
+do_coherent_sim(CoherentSim *sim, unsigned n_cores, const char *specs[],
+                unsigned n_specs, bool is_quiet, unsigned n_mem_addr_bits,
+                TraceReader *in[], FILE *out)
+{
+  enum { CORE_BATCH_SIZE = 256,
+         BATCH_SIZE = CORE_BATCH_SIZE * COHERENT_MAX_CORES };
+  MemAddr core_addrs[COHERENT_MAX_CORES][CORE_BATCH_SIZE];
+  bool core_writes[COHERENT_MAX_CORES][CORE_BATCH_SIZE];
+  size_t n_read[COHERENT_MAX_CORES];
+  bool is_live[COHERENT_MAX_CORES];
+  unsigned cores[BATCH_SIZE];
+  MemAddr addrs[BATCH_SIZE];
+  bool is_writes[BATCH_SIZE];
+  CacheResult results[BATCH_SIZE];
+  unsigned addr_width = (n_mem_addr_bits + 3)/4;
+  for (unsigned c = 0; c < n_cores; c++) is_live[c] = true;
+  bool is_any_live = true;
+  while (is_any_live) {
+    size_t max_read = 0;
+    for (unsigned c = 0; c < n_cores; c++) {
+      n_read[c] = is_live[c]
+        ? trace_read(in[c], CORE_BATCH_SIZE, core_addrs[c], core_writes[c])
+        : 0;
+      if (n_read[c] > max_read) max_read = n_read[c];
+    }
+    size_t n = 0;
+    for (size_t k = 0; k < max_read; k++) {
+      for (unsigned c = 0; c < n_cores; c++) {
+        if (k >= n_read[c]) continue;
+        cores[n] = c;
+        addrs[n] = core_addrs[c][k];
+        is_writes[n] = core_writes[c][k];
+        n++;
+      }
+    }
+    if (n > 0) coherent_sim_accesses(sim, n, cores, addrs, is_writes, results);
+    for (size_t i = 0; !is_quiet && i < n; i++) {
+      fprintf(out, "%u: ", cores[i]);
+      out_result(&results[i], is_writes[i], addr_width, NULL, out);
+    }
+    is_any_live = false;
+    for (unsigned c = 0; c < n_cores; c++) {
+      is_live[c] = n_read[c] == CORE_BATCH_SIZE;
+      is_any_live |= is_live[c];
+    }
+  }
+  out_coherent_stats(sim, n_cores, specs, n_specs, out);
+}
+
+/** Return a reader for the trace in file path, binary if it has a
+ *  binary trace header and text otherwise, setting *file to the FILE
+ *  the caller must close for a text trace, NULL for a binary one.
+ *  Exits on error.
+ */
+static TraceReader *
+open_trace_path(const char *path, FILE **file)
+{
+  *file = NULL;
+  TraceReader *reader = open_binary_trace(path);
+  if (reader) return reader;
+  if (errno == EINVAL) *file = fopen(path, "r");
+  if (!*file) {
+    fprintf(stderr, "cannot read trace %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+  return open_text_trace(*file);
+}
+
+/** Parse a comma-separated list of N or LO..HI from spec into
+ *  values[], setting *n_values.  Returns false on error.
+ */
+static bool
+parse_sweep_values(const char *spec, unsigned values[], unsigned *n_values)
+{
+  unsigned n = 0;
+  const char *p = spec;
   while (1) {
-    if (getline(&line, &line_size, stdin) < 0) break;
-    AddrRead read = parse_access(line);
-    if (read.status == ERR_READ) {
-      fprintf(stderr, "bad input; must be \"0[xX]HEX [r|w|\" (default 'r')\n");
-      continue;
+    char *end;
+    unsigned long lo = strtoul(p, &end, 10);
+    if (end == p || !isdigit(*p)) return false;
+    unsigned long hi = lo;
+    p = end;
+    if (p[0] == '.' && p[1] == '.') {
+      p += 2;
+      hi = strtoul(p, &end, 10);
+      if (end == p || !isdigit(*p) || hi < lo) return false;
+      p = end;
     }
-    else if (read.status == SKIP_READ) {
-      continue;
+    for (unsigned long v = lo; v <= hi; v++) {
+      for (unsigned k = 0; k < n; k++) {
+        if (values[k] == v) return false;
+      }
+      if (n >= SWEEP_MAX_VALUES) return false;
+      values[n++] = v;
     }
-    bool is_write = read.rw == 'w';
-    n_total++;
-    CacheResult result = cache_sim_result(cache, read.addr, is_write);
-    stats[result.status]++;
-    if (result.status == CACHE_MISS_WITH_REPLACE && result.is_dirty) {
-      stats[CACHE_N_STATUS]++;
+    if (*p == '\0') break;
+    if (*p++ != ',') return false;
+  }
+  *n_values = n;
+  return true;
+}
+
+/** Fill *params from var=VALUES specs[0..n_specs-1].  Returns NULL on
+ *  success, an error message on error.
+ */
+static const char *
+make_sweep_params(const char *specs[], int n_specs, SweepParams *params)
+{
+  params->n_mem_addr_bits = SWEEP_DEFAULT_MEM_ADDR_BITS;
+  params->n_set_bits_values = params->n_blk_bits_values =
+    params->n_ways_values = 0;
+  for (int i = 0; i < n_specs; i++) {
+    const char *spec = specs[i];
+    if (spec[0] == '\0' || spec[1] != '=') {
+      return "sweep specs must be VAR=VALUES\n";
     }
-    if (!is_quiet) {
-      fprintf(out, "0x%0*lx %c: %s", addr_width, read.addr, read.rw,
-              STATUS_STRS[result.status]);
-      if (result.status == CACHE_MISS_WITH_REPLACE) {
-        fprintf(out, " 0x%0*lx%s", addr_width, result.replace_addr,
-                result.is_dirty ? " w" : "");
+    bool is_ok;
+    switch (spec[0]) {
+    case 'm': {
+      unsigned m_values[SWEEP_MAX_VALUES], n_m;
+      is_ok = parse_sweep_values(&spec[2], m_values, &n_m) && n_m == 1;
+      if (is_ok) params->n_mem_addr_bits = m_values[0];
+      break;
+    }
+    case 's':
+      is_ok = parse_sweep_values(&spec[2], params->set_bits,
+                                 &params->n_set_bits_values);
+      break;
+    case 'b':
+      is_ok = parse_sweep_values(&spec[2], params->blk_bits,
+                                 &params->n_blk_bits_values);
+      break;
+    case 'E':
+      is_ok = parse_sweep_values(&spec[2], params->ways,
+                                 &params->n_ways_values);
+      break;
+    default:
+      return "sweep VAR must be one of m, s, b or E\n";
+    }
+    if (!is_ok) return "invalid sweep VALUES\n";
+  }
+  if (params->n_set_bits_values == 0 || params->n_blk_bits_values == 0 ||
+      params->n_ways_values == 0) {
+    return "sweep requires s=, b= and E= specs\n";
+  }
+  for (unsigned j = 0; j < params->n_ways_values; j++) {
+    if (params->ways[j] == 0) return "sweep E values must be positive\n";
+  }
+  for (unsigned i = 0; i < params->n_set_bits_values; i++) {
+    for (unsigned k = 0; k < params->n_blk_bits_values; k++) {
+      unsigned s = params->set_bits[i], b = params->blk_bits[k];
+      if (b < 2 || s + b >= params->n_mem_addr_bits) {
+        return "sweep values must have 2 <= b and b + s < m\n";
       }
-      fprintf(out, "\n");
     }
-  } // while (1)
-  free(line);
-  out_cache_stats(stats, n_total, out);
+  }
+  return NULL;
+}
+
+/** Run a single-pass LRU sweep over the trace on in, outputting the
+ *  stats for each configuration to out.
+ */
+static void
+do_sweep(const SweepParams *params, TraceReader *in, FILE *out)
+{
+  enum { BATCH_SIZE = 4096 };
+  MemAddr addrs[BATCH_SIZE];
+  bool is_writes[BATCH_SIZE];
+  Sweep *sweep = new_sweep(params);
+  unsigned long n_total = 0UL;
+  size_t n;
+  do {
+    n = trace_read(in, BATCH_SIZE, addrs, is_writes);
+    sweep_accesses(sweep, n, addrs, is_writes);
+    n_total += n;
+  } while (n == BATCH_SIZE);
+  for (unsigned i = 0; i < params->n_set_bits_values; i++) {
+    for (unsigned k = 0; k < params->n_blk_bits_values; k++) {
+      for (unsigned j = 0; j < params->n_ways_values; j++) {
+        unsigned s = params->set_bits[i];
+        unsigned b = params->blk_bits[k];
+        unsigned E = params->ways[j];
+        unsigned long stats[CACHE_N_STATUS + 1];
+        sweep_stats(sweep, s, b, E, stats);
+        fprintf(out, "## %u-%u-%u-%u\n", params->n_mem_addr_bits, s, b, E);
+        out_cache_stats(stats, n_total, NULL, out);
+      }
+    }
+  }
+  free_sweep(sweep);
 }
 
 int
@@ -169,21 +1000,225 @@ main(int argc, const char *argv[])
   const char *program = argv[0];
   if (argc <= 1) usage(program, "");
   bool is_quiet = false;
+  bool is_sweep = false;
+  bool is_classify = false;
+  unsigned long interval = 0;
+  const char *interval_path = NULL;
+  const char *tlb_spec = NULL;
+  unsigned long sample = 0;
+  const char *results_path = NULL;
+  const char *load_state_path = NULL;
+  const char *save_state_path = NULL;
+  TlbParams tlb_params;
+  int inclusion = NINE_H;
+  bool is_inclusion = false;
+  unsigned latencies[MAX_LEVELS + 1];
+  int n_latencies = 0;
+  int n_threads = 0;
+  const char *trace_path = NULL;
+  const char *ring_name = NULL;
+  const char *core_paths[COHERENT_MAX_CORES];
+  char *core_paths_copy = NULL;
+  unsigned n_cores = 0;
   int replacement = LRU_R;
+  PrefetchParams prefetch = { .kind = NO_PF };
+  WriteOptions writes = { .write_policy = WRITE_BACK_W };
+  bool is_traffic = false;
   int seed = 0;
   int i;
   for (i = 1; i < argc && argv[i][0] == '-'; i++) {
     if (strcmp(argv[i], "-q") == 0) {
       is_quiet = true;
     }
+    else if (strcmp(argv[i], "-c") == 0) {
+      is_classify = true;
+    }
+    else if (strcmp(argv[i], "-t") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-t requires binary trace path additional argument\n");
+      }
+      trace_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--ring") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--ring requires trace ring name additional argument\n");
+      }
+      ring_name = argv[++i];
+    }
+    else if (strcmp(argv[i], "-C") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-C requires TRACE,TRACE... additional argument\n");
+      }
+      free(core_paths_copy);
+      n_cores = parse_core_paths(argv[++i], core_paths, &core_paths_copy);
+      if (n_cores == 0) {
+        usage(program, "-C requires 1 to 16 comma-separated traces\n");
+      }
+    }
+    else if (strcmp(argv[i], "-j") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-j requires # of threads additional argument\n");
+      }
+      char *p;
+      n_threads = strtol(argv[++i], &p, 10);
+      if (n_threads <= 0 || *p != '\0') {
+        usage(program, "# of threads must be a positive integer\n");
+      }
+    }
+    else if (strcmp(argv[i], "-i") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-i requires incl|excl|nine additional argument\n");
+      }
+      inclusion = get_inclusion(argv[++i]);
+      is_inclusion = true;
+      if (inclusion < 0) {
+        usage(program, "inclusion must be incl|excl|nine\n");
+      }
+    }
+    else if (strcmp(argv[i], "-l") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-l requires LATENCY,... additional argument\n");
+      }
+      n_latencies = parse_latencies(argv[++i], latencies, MAX_LEVELS + 1);
+      if (n_latencies < 0) {
+        usage(program, "latencies must be comma-separated integers\n");
+      }
+    }
+    else if (strcmp(argv[i], "--interval") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--interval requires # of accesses additional argument\n");
+      }
+      char *p;
+      const char *arg = argv[++i];
+      interval = strtoul(arg, &p, 10);
+      if (interval == 0 || !isdigit(*arg) || *p != '\0') {
+        usage(program, "interval must be a positive integer\n");
+      }
+    }
+    else if (strcmp(argv[i], "--interval-out") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--interval-out requires path additional argument\n");
+      }
+      interval_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--tlb") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--tlb requires ENTRIES-WAYS-4k|2m additional "
+              "argument\n");
+      }
+      tlb_spec = argv[++i];
+      if (!parse_tlb(tlb_spec, &tlb_params)) {
+        usage(program, "TLB must be ENTRIES-WAYS-4k|2m\n");
+      }
+    }
+    else if (strcmp(argv[i], "--sample") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--sample requires K additional argument\n");
+      }
+      char *p;
+      const char *arg = argv[++i];
+      sample = strtoul(arg, &p, 10);
+      if (sample == 0 || sample > UINT_MAX || !isdigit(*arg) || *p != '\0') {
+        usage(program, "sample K must be a positive integer\n");
+      }
+    }
+    else if (strcmp(argv[i], "--results-out") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--results-out requires path additional argument\n");
+      }
+      results_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--load-state") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--load-state requires path additional argument\n");
+      }
+      load_state_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--save-state") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--save-state requires path additional argument\n");
+      }
+      save_state_path = argv[++i];
+    }
+    else if (strcmp(argv[i], "--sweep") == 0) {
+      is_sweep = true;
+    }
     else if (strcmp(argv[i], "-r") == 0) {
       if (i >= argc - 1) {
-        usage(program, "-r requires lru|mru|rand additional argument\n");
+        usage(program, "-r requires " REPLACEMENT_NAMES " additional argument\n");
       }
-      replacement = get_replacement(argv[++i]);
+      replacement = parse_replacement(argv[++i]);
       if (replacement < 0) {
-        usage(program, "replacement must be lru|mru|rand\n");
+        usage(program, "replacement must be " REPLACEMENT_NAMES "\n");
+      }
+    }
+    else if (strcmp(argv[i], "-p") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-p requires " PREFETCH_NAMES " additional argument\n");
+      }
+      if (!parse_prefetch(argv[++i], &prefetch)) {
+        usage(program, "prefetch must be " PREFETCH_NAMES
+              "[:DEGREE[:LATENCY]] with 1 <= DEGREE <= 16\n");
+      }
+    }
+    else if (strcmp(argv[i], "-w") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-w requires back|through additional argument\n");
+      }
+      const char *arg = argv[++i];
+      if (strcmp(arg, "back") == 0) {
+        writes.write_policy = WRITE_BACK_W;
+      }
+      else if (strcmp(arg, "through") == 0) {
+        writes.write_policy = WRITE_THROUGH_W;
+      }
+      else {
+        usage(program, "write policy must be back|through\n");
+      }
+      is_traffic = true;
+    }
+    else if (strcmp(argv[i], "-a") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-a requires alloc|noalloc additional argument\n");
+      }
+      const char *arg = argv[++i];
+      if (strcmp(arg, "alloc") == 0) {
+        writes.allocate_policy = WRITE_ALLOCATE_A;
+      }
+      else if (strcmp(arg, "noalloc") == 0) {
+        writes.allocate_policy = NO_WRITE_ALLOCATE_A;
+      }
+      else {
+        usage(program, "allocate policy must be alloc|noalloc\n");
       }
+      is_traffic = true;
+    }
+    else if (strcmp(argv[i], "-V") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "-V requires # of victim lines additional argument\n");
+      }
+      char *p;
+      const char *arg = argv[++i];
+      unsigned long n = strtoul(arg, &p, 10);
+      if (n == 0 || n > VICTIM_MAX_LINES || !isdigit(*arg) || *p != '\0') {
+        usage(program, "# of victim lines must be from 1 to 64\n");
+      }
+      writes.n_victim_lines = n;
+      is_traffic = true;
+    }
+    else if (strcmp(argv[i], "--sectors") == 0) {
+      if (i >= argc - 1) {
+        usage(program, "--sectors requires # of sectors additional argument\n");
+      }
+      char *p;
+      const char *arg = argv[++i];
+      unsigned long n = strtoul(arg, &p, 10);
+      if (n == 0 || n > SECTOR_MAX || (n & (n - 1)) != 0 || !isdigit(*arg) ||
+          *p != '\0') {
+        usage(program, "# of sectors must be a power of 2 from 1 to 64\n");
+      }
+      writes.n_sectors = n;
+      is_traffic = true;
     }
     else if (strcmp(argv[i], "-s") == 0) {
       if (i >= argc - 1) {
@@ -199,18 +1234,260 @@ main(int argc, const char *argv[])
       usage(program, "invalid option\n");
     }
   }
-  if (i != argc - 1) {
+  if ((is_inclusion || n_latencies > 0) &&
+      (n_cores > 0 || is_sweep || argc - i < 2)) {
+    usage(program, "-i and -l require a hierarchy of 2 or more cache "
+          "specs\n");
+  }
+  if (replacement == PLRU_R) {
+    for (int k = i; k < argc; k++) {
+      unsigned n_lines_per_set;
+      if (sscanf(argv[k], "%*u-%*u-%*u-%u", &n_lines_per_set) == 1 &&
+          (n_lines_per_set & (n_lines_per_set - 1)) != 0) {
+        usage(program, "plru requires E to be a power of 2\n");
+      }
+    }
+  }
+  if (n_cores > 0) {
+    if (trace_path || ring_name || is_sweep || n_threads > 0 ||
+        prefetch.kind != NO_PF || is_classify || interval > 0 || tlb_spec ||
+        sample > 0 || results_path || is_traffic || load_state_path ||
+        save_state_path || replacement == OPT_R) {
+      usage(program, "-C cannot be used with -t, --ring, --sweep, -j, -p, "
+            "-c, --interval, --tlb, --sample, --results-out, -w, -a, -V, "
+            "--sectors, --load-state, --save-state or opt\n");
+    }
+    unsigned n_specs = argc - i;
+    if (n_specs < 1 || n_specs > 2) {
+      usage(program, "-C requires an L1 and an optional L2 cache spec\n");
+    }
+    CacheParams params[2];
+    for (unsigned k = 0; k < n_specs; k++) {
+      if (!parse_cache_params(argv[i + k], replacement, seed, &params[k])) {
+        usage(program, "invalid cache params\n");
+      }
+    }
+    CoherentSim *sim =
+      new_coherent_sim(&params[0], n_cores, n_specs > 1 ? &params[1] : NULL);
+    if (!sim) usage(program, "invalid cache params\n");
+    TraceReader *readers[COHERENT_MAX_CORES];
+    FILE *files[COHERENT_MAX_CORES];
+    for (unsigned c = 0; c < n_cores; c++) {
+      readers[c] = open_trace_path(core_paths[c], &files[c]);
+    }
+    out_memory_size(program, coherent_sim_memory_size(sim), 0);
+    do_coherent_sim(sim, n_cores, &argv[i], n_specs, is_quiet,
+                    params[0].n_mem_addr_bits, readers, stdout);
+    for (unsigned c = 0; c < n_cores; c++) {
+      close_trace(readers[c]);
+      if (files[c]) fclose(files[c]);
+    }
+    free_coherent_sim(sim);
+    free(core_paths_copy);
+    return 0;
+  }
+  if (trace_path && ring_name) {
+    usage(program, "-t cannot be used with --ring\n");
+  }
+  if (is_sweep &&
+      (n_threads > 0 || prefetch.kind != NO_PF || is_classify ||
+       interval > 0 || interval_path || tlb_spec || sample > 0 ||
+       results_path || is_traffic || load_state_path || save_state_path)) {
+    usage(program, "--sweep cannot be used with -j, -p, -c, --interval, "
+          "--tlb, --sample, --results-out, -w, -a, -V, --sectors, "
+          "--load-state or --save-state\n");
+  }
+  TraceReader *in = trace_path ? open_binary_trace(trace_path)
+                  : ring_name ? open_ring_trace(ring_name)
+                  : open_text_trace(stdin);
+  if (!in) {
+    fprintf(stderr, "cannot read %s %s: %s\n",
+            trace_path ? "binary trace" : "trace ring",
+            trace_path ? trace_path : ring_name, strerror(errno));
+    exit(1);
+  }
+  if (is_sweep) {
+    if (replacement != LRU_R) usage(program, "--sweep requires lru\n");
+    SweepParams params;
+    const char *err = make_sweep_params(&argv[i], argc - i, &params);
+    if (err) usage(program, err);
+    do_sweep(&params, in, stdout);
+    close_trace(in);
+    return 0;
+  }
+  if (i == argc) {
     usage(program, "cache spec s-E-b-m required\n");
   }
+  bool is_prefetch = prefetch.kind != NO_PF;
+  if (is_prefetch && (i < argc - 1 || n_threads > 0)) {
+    usage(program, "-p requires a single cache without -j\n");
+  }
+  if (is_classify && (i < argc - 1 || n_threads > 0)) {
+    usage(program, "-c requires a single cache without -j\n");
+  }
+  if (interval > 0 && (i < argc - 1 || n_threads > 0)) {
+    usage(program, "--interval requires a single cache without -j\n");
+  }
+  if (replacement == OPT_R && (i < argc - 1 || is_prefetch)) {
+    usage(program, "opt requires a single cache without -p\n");
+  }
+  if (tlb_spec &&
+      (i < argc - 1 || n_threads > 0 || is_classify || replacement == OPT_R)) {
+    usage(program, "--tlb requires a single cache without -j, -c or opt\n");
+  }
+  if (sample > 0 &&
+      (i < argc - 1 || n_threads > 0 || is_prefetch || is_classify ||
+       interval > 0 || tlb_spec || replacement == OPT_R)) {
+    usage(program, "--sample requires a single cache without -j, -p, -c, "
+          "--interval, --tlb or opt\n");
+  }
+  if (results_path && (i < argc - 1 || n_threads > 0 || sample > 0)) {
+    usage(program, "--results-out requires a single cache without -j or "
+          "--sample\n");
+  }
+  if (is_traffic &&
+      (i < argc - 1 || n_threads > 0 || is_prefetch || sample > 0)) {
+    usage(program, "-w, -a, -V and --sectors require a single cache "
+          "without -j, -p or --sample\n");
+  }
+  if ((load_state_path || save_state_path) &&
+      (i < argc - 1 || n_threads > 0 || sample > 0 || replacement == OPT_R)) {
+    usage(program, "--load-state and --save-state require a single cache "
+          "without -j, --sample or opt\n");
+  }
+  if (writes.n_victim_lines > 0 && writes.n_sectors > 1) {
+    usage(program, "--sectors cannot be used with -V\n");
+  }
+  if (interval_path && interval == 0) {
+    usage(program, "--interval-out requires --interval\n");
+  }
+  if (i < argc - 1) {
+    if (n_threads > 0) usage(program, "-j requires a single cache\n");
+    unsigned n_levels = argc - i;
+    if (n_levels > MAX_LEVELS) usage(program, "too many cache levels\n");
+    if (n_latencies == 0) {
+      for (unsigned k = 0; k <= n_levels; k++) {
+        latencies[k] = (k == n_levels)
+          ? DEFAULT_LATENCIES[3]
+          : DEFAULT_LATENCIES[k < 2 ? k : 2];
+      }
+    }
+    else if (n_latencies != n_levels + 1) {
+      usage(program, "-l requires a latency per level plus memory latency\n");
+    }
+    CacheParams params[MAX_LEVELS];
+    for (unsigned k = 0; k < n_levels; k++) {
+      if (!parse_cache_params(argv[i + k], replacement, seed, &params[k])) {
+        usage(program, "invalid cache params\n");
+      }
+    }
+    CacheHierarchy *hierarchy =
+      new_cache_hierarchy(params, n_levels, inclusion);
+    if (!hierarchy) {
+      usage(program, "invalid cache params or excl with different block "
+            "sizes\n");
+    }
+    out_memory_size(program, cache_hierarchy_memory_size(hierarchy), 0);
+    do_hierarchy_sim(hierarchy, n_levels, &argv[i], latencies, is_quiet,
+                     params[0].n_mem_addr_bits, in, stdout);
+    free_cache_hierarchy(hierarchy);
+    close_trace(in);
+    return 0;
+  }
 
-  srand(seed);
   const char *params_spec = argv[i];
 
-  unsigned n_mem_addr_bits;
-  CacheSim *cache = make_cache_sim(params_spec, replacement, &n_mem_addr_bits);
+  if (n_threads > 0) {
+    CacheParams params;
+    if (!parse_cache_params(params_spec, replacement, seed, &params)) {
+      usage(program, "invalid cache params\n");
+    }
+    ShardedSim *sim = new_sharded_sim(&params, n_threads, !is_quiet);
+    if (!sim) {
+      usage(program, "invalid cache params or -j with rand|brrip|opt\n");
+    }
+    out_memory_size(program, sharded_sim_memory_size(sim), 0);
+    do_sharded_sim(sim, is_quiet, params.n_mem_addr_bits, in, stdout);
+    free_sharded_sim(sim);
+    close_trace(in);
+    return 0;
+  }
+
+  CacheParams params;
+  CacheSim *cache = make_cache_sim(params_spec, replacement, seed, &prefetch,
+                                   &writes, load_state_path, &params);
   if (!cache) usage(program, "invalid cache params\n");
-  do_cache_sim(cache, is_quiet, n_mem_addr_bits, stdin, stdout);
+  //opt needs the entire future of the trace
+  MemAddr *future_addrs = NULL;
+  bool *future_writes = NULL;
+  if (replacement == OPT_R) {
+    size_t n = trace_read_all(in, &future_addrs, &future_writes);
+    close_trace(in);
+    in = open_memory_trace(n, future_addrs, future_writes);
+    cache_sim_set_future(cache, n, future_addrs);
+  }
+  out_memory_size(program, cache_sim_memory_size(cache),
+                  cache_sim_set_size(cache));
+  SimOptions opts = {
+    .is_quiet = is_quiet,
+    .is_prefetch = is_prefetch,
+    .is_traffic = is_traffic,
+    .classifier = is_classify ? new_miss_classifier(&params) : NULL,
+    .interval = interval,
+    .interval_out = stdout,
+    .tlb_spec = tlb_spec,
+  };
+  if (sample > 0) {
+    opts.sampler = new_set_sampler(&params, sample);
+    if (!opts.sampler) usage(program, "no set sampled; use a smaller K\n");
+  }
+  if (tlb_spec) {
+    opts.tlb = new_tlb(&tlb_params, params.n_mem_addr_bits);
+    if (!opts.tlb) {
+      usage(program, "TLB sets or pages do not fit in m address bits\n");
+    }
+  }
+  if (interval_path) {
+    opts.interval_out = fopen(interval_path, "w");
+    if (!opts.interval_out) {
+      fprintf(stderr, "cannot write %s: %s\n", interval_path, strerror(errno));
+      exit(1);
+    }
+  }
+  int results_fd = -1;
+  if (results_path) {
+    results_fd = open(results_path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (results_fd < 0) {
+      fprintf(stderr, "cannot write %s: %s\n", results_path, strerror(errno));
+      exit(1);
+    }
+    opts.results_out =
+      new_binary_result_writer(results_fd, params.n_mem_addr_bits);
+  }
+  do_cache_sim(cache, &params, &opts, in, stdout);
+  if (results_path) {
+    finish_result_writer(opts.results_out);
+    if (close(results_fd) != 0) {
+      fprintf(stderr, "cannot write %s: %s\n", results_path, strerror(errno));
+      exit(1);
+    }
+  }
+  if (save_state_path && !cache_sim_save(cache, save_state_path)) {
+    fprintf(stderr, "cannot save cache state %s: %s\n", save_state_path,
+            strerror(errno));
+    exit(1);
+  }
+  if (interval_path && fclose(opts.interval_out) != 0) {
+    fprintf(stderr, "cannot write %s: %s\n", interval_path, strerror(errno));
+    exit(1);
+  }
+  free_miss_classifier(opts.classifier);
+  free_tlb(opts.tlb);
+  free_set_sampler(opts.sampler);
   free_cache_sim(cache);
+  close_trace(in);
+  free(future_addrs);
+  free(future_writes);
   return 0;
 
 }
@@ -0,0 +1,297 @@
+#include "prefetch.h"
+#include "memalloc.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************************** Type Definitions  **************************/
+
+enum {
+	REGION_BITS = 12,          // stride detection is per 4K region
+	N_STRIDE_ENTRIES = 16,     // # of entries in stride reference table
+	STRIDE_CONFIDENT = 2,      // confidence at which strides are prefetched
+	STRIDE_MAX_CONFIDENCE = 3,
+	N_STREAM_BUFFERS = 4,
+	POLLUTION_FILTER_SIZE = 4096, // must be a power of 2
+};
+
+/** A reference table entry tracking the accesses to one region */
+typedef struct {
+	bool is_valid;
+	MemAddr region;
+	MemAddr last_addr;         // last address accessed in region
+	long stride;
+	unsigned confidence;
+	unsigned long last_use;    // for LRU replacement of entries
+} StrideEntry;
+
+/** A FIFO of the degree consecutive blocks starting at block number
+ *  head_blk; issue_times[(head + i) % degree] is the time at which
+ *  block head_blk + i was prefetched.
+ */
+typedef struct {
+	bool is_valid;
+	MemAddr head_blk;
+	unsigned head;
+	long *issue_times;
+	long last_use;
+} StreamBuffer;
+
+struct PrefetcherImpl {
+	PrefetchParams params;
+	unsigned blk_bits;
+	PrefetchStats stats;
+	unsigned long n_trains;
+	StrideEntry strides[N_STRIDE_ENTRIES];
+	StreamBuffer streams[N_STREAM_BUFFERS];
+	/** block number + 1 of recent demand blocks evicted by prefetch
+	 *  fills, direct-mapped by block number; 0 if empty.
+	 */
+	MemAddr pollution[POLLUTION_FILTER_SIZE];
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+Prefetcher *
+new_prefetcher(const PrefetchParams *params, unsigned n_blk_offset_bits)
+{
+	assert(params->kind != NO_PF);
+	assert(0 < params->degree && params->degree <= PREFETCH_MAX_DEGREE);
+	Prefetcher *prefetcher = calloc_chk(1, sizeof(Prefetcher));
+	prefetcher->params = *params;
+	prefetcher->blk_bits = n_blk_offset_bits;
+	if (params->kind == STREAM_PF) {
+		for (unsigned i = 0; i < N_STREAM_BUFFERS; i++) {
+			prefetcher->streams[i].issue_times =
+				calloc_chk(params->degree, sizeof(long));
+		}
+	}
+	return prefetcher;
+}
+
+void
+free_prefetcher(Prefetcher *prefetcher)
+{
+	if (!prefetcher) return;
+	for (unsigned i = 0; i < N_STREAM_BUFFERS; i++) {
+		free(prefetcher->streams[i].issue_times);
+	}
+	free(prefetcher);
+}
+
+/**************************** Prediction *******************************/
+
+/** Set addrs[] to the addresses of the blocks degree strides beyond
+ *  addr, skipping addr's own block and repeats.  Return their #.
+ */
+static unsigned
+stride_addrs(const Prefetcher *prefetcher, MemAddr addr, long stride,
+             MemAddr addrs[])
+{
+	unsigned blk_bits = prefetcher->blk_bits;
+	MemAddr last_blk = addr >> blk_bits;
+	unsigned n = 0;
+	for (unsigned k = 1; k <= prefetcher->params.degree; k++) {
+		MemAddr blk = (addr + k * stride) >> blk_bits;
+		if (blk == last_blk) continue;
+		addrs[n++] = blk << blk_bits;
+		last_blk = blk;
+	}
+	return n;
+}
+
+static unsigned
+train_stride(Prefetcher *prefetcher, MemAddr addr, MemAddr addrs[])
+{
+	MemAddr region = addr >> REGION_BITS;
+	StrideEntry *entry = NULL;
+	StrideEntry *lru = &prefetcher->strides[0];
+	for (unsigned i = 0; i < N_STRIDE_ENTRIES; i++) {
+		StrideEntry *e = &prefetcher->strides[i];
+		if (e->is_valid && e->region == region) {
+			entry = e;
+			break;
+		}
+		if (!e->is_valid || (lru->is_valid && e->last_use < lru->last_use)) {
+			lru = e;
+		}
+	}
+	unsigned long now = ++prefetcher->n_trains;
+	if (!entry) {
+		*lru = (StrideEntry) {
+			.is_valid = true, .region = region, .last_addr = addr, .last_use = now,
+		};
+		return 0;
+	}
+	entry->last_use = now;
+	long stride = (long)(addr - entry->last_addr);
+	if (stride == 0) return 0;
+	entry->last_addr = addr;
+	if (stride == entry->stride) {
+		if (entry->confidence < STRIDE_MAX_CONFIDENCE) entry->confidence++;
+	}
+	else if (entry->confidence > 0) {
+		entry->confidence--;
+	}
+	else {
+		entry->stride = stride;
+	}
+	return (entry->confidence >= STRIDE_CONFIDENT)
+		? stride_addrs(prefetcher, addr, entry->stride, addrs)
+		: 0;
+}
+
+unsigned
+prefetcher_train(Prefetcher *prefetcher, MemAddr addr, bool is_miss,
+                 bool is_prefetch_hit, MemAddr addrs[PREFETCH_MAX_DEGREE])
+{
+	switch (prefetcher->params.kind) {
+	case NEXT_LINE_PF:
+		if (!is_miss && !is_prefetch_hit) return 0;
+		return stride_addrs(prefetcher, addr, 1L << prefetcher->blk_bits, addrs);
+	case STRIDE_PF:
+		return train_stride(prefetcher, addr, addrs);
+	default:
+		return 0;
+	}
+}
+
+/*************************** Stream Buffers ****************************/
+
+bool
+prefetcher_stream_hit(Prefetcher *prefetcher, MemAddr addr, long now)
+{
+	if (prefetcher->params.kind != STREAM_PF) return false;
+	unsigned degree = prefetcher->params.degree;
+	MemAddr blk = addr >> prefetcher->blk_bits;
+	StreamBuffer *lru = &prefetcher->streams[0];
+	for (unsigned i = 0; i < N_STREAM_BUFFERS; i++) {
+		StreamBuffer *buf = &prefetcher->streams[i];
+		if (buf->is_valid && buf->head_blk == blk) {
+			prefetcher->stats.useful++;
+			prefetcher->stats.buffer_hits++;
+			if (prefetcher_is_late(prefetcher, buf->issue_times[buf->head], now)) {
+				prefetcher->stats.late++;
+			}
+			//the head moves into the cache; refill the tail
+			buf->issue_times[buf->head] = now;
+			buf->head = (buf->head + 1) % degree;
+			buf->head_blk++;
+			buf->last_use = now;
+			prefetcher->stats.issued++;
+			return true;
+		}
+		if (!buf->is_valid || (lru->is_valid && buf->last_use < lru->last_use)) {
+			lru = buf;
+		}
+	}
+	if (lru->is_valid) prefetcher->stats.useless += degree;
+	lru->is_valid = true;
+	lru->head_blk = blk + 1;
+	lru->head = 0;
+	lru->last_use = now;
+	for (unsigned k = 0; k < degree; k++) lru->issue_times[k] = now;
+	prefetcher->stats.issued += degree;
+	return false;
+}
+
+/************************** Pollution Filter ***************************/
+
+static MemAddr *
+pollution_slot(Prefetcher *prefetcher, MemAddr blk)
+{
+	return &prefetcher->pollution[blk & (POLLUTION_FILTER_SIZE - 1)];
+}
+
+void
+prefetcher_note_eviction(Prefetcher *prefetcher, MemAddr addr)
+{
+	MemAddr blk = addr >> prefetcher->blk_bits;
+	*pollution_slot(prefetcher, blk) = blk + 1;
+}
+
+void
+prefetcher_note_miss(Prefetcher *prefetcher, MemAddr addr)
+{
+	MemAddr blk = addr >> prefetcher->blk_bits;
+	MemAddr *slot = pollution_slot(prefetcher, blk);
+	if (*slot == blk + 1) {
+		prefetcher->stats.pollution++;
+		*slot = 0;
+	}
+}
+
+/****************************** Counts *********************************/
+
+bool
+prefetcher_is_late(const Prefetcher *prefetcher, long issued, long now)
+{
+	return now - issued < (long)prefetcher->params.latency;
+}
+
+PrefetchStats *
+prefetcher_stats(Prefetcher *prefetcher)
+{
+	return &prefetcher->stats;
+}
+
+/************************** Saving / Loading ***************************/
+
+/** Each stream buffer is saved as its StreamBuffer, whose issue_times
+ *  pointer is ignored on loading, followed by its degree issue times.
+ */
+size_t
+prefetcher_save_size(const Prefetcher *prefetcher)
+{
+	size_t stream_size =
+		sizeof(StreamBuffer) + prefetcher->params.degree * sizeof(long);
+	return sizeof(prefetcher->n_trains) + sizeof(prefetcher->strides) +
+		N_STREAM_BUFFERS * stream_size + sizeof(prefetcher->pollution);
+}
+
+void
+prefetcher_save(const Prefetcher *prefetcher, void *buf)
+{
+	unsigned char *p = buf;
+	size_t times_size = prefetcher->params.degree * sizeof(long);
+	memcpy(p, &prefetcher->n_trains, sizeof(prefetcher->n_trains));
+	p += sizeof(prefetcher->n_trains);
+	memcpy(p, prefetcher->strides, sizeof(prefetcher->strides));
+	p += sizeof(prefetcher->strides);
+	for (unsigned i = 0; i < N_STREAM_BUFFERS; i++) {
+		const StreamBuffer *stream = &prefetcher->streams[i];
+		memcpy(p, stream, sizeof(StreamBuffer));
+		p += sizeof(StreamBuffer);
+		if (stream->issue_times) {
+			memcpy(p, stream->issue_times, times_size);
+		}
+		else {
+			memset(p, 0, times_size);
+		}
+		p += times_size;
+	}
+	memcpy(p, prefetcher->pollution, sizeof(prefetcher->pollution));
+}
+
+void
+prefetcher_load(Prefetcher *prefetcher, const void *buf)
+{
+	const unsigned char *p = buf;
+	size_t times_size = prefetcher->params.degree * sizeof(long);
+	memcpy(&prefetcher->n_trains, p, sizeof(prefetcher->n_trains));
+	p += sizeof(prefetcher->n_trains);
+	memcpy(prefetcher->strides, p, sizeof(prefetcher->strides));
+	p += sizeof(prefetcher->strides);
+	for (unsigned i = 0; i < N_STREAM_BUFFERS; i++) {
+		StreamBuffer *stream = &prefetcher->streams[i];
+		long *issue_times = stream->issue_times;
+		memcpy(stream, p, sizeof(StreamBuffer));
+		stream->issue_times = issue_times;
+		p += sizeof(StreamBuffer);
+		if (issue_times) memcpy(issue_times, p, times_size);
+		p += times_size;
+	}
+	memcpy(prefetcher->pollution, p, sizeof(prefetcher->pollution));
+}
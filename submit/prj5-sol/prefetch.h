@@ -0,0 +1,76 @@
+#ifndef PREFETCH_H_
+#define PREFETCH_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** The prediction half of a CacheSim prefetcher: decides which blocks
+ *  to prefetch, holds the stream buffers and the pollution filter, and
+ *  keeps the prefetch counts.  The cache performs (and counts the
+ *  outcome of) prefetch fills into its own lines.  All times are
+ *  values of the cache's access clock.
+ */
+typedef struct PrefetcherImpl Prefetcher;
+
+/** Return a new prefetcher for a cache with 2**n_blk_offset_bits byte
+ *  blocks; params->kind must not be NO_PF.
+ */
+Prefetcher *new_prefetcher(const PrefetchParams *params,
+                           unsigned n_blk_offset_bits);
+
+/** Free all resources used by *prefetcher */
+void free_prefetcher(Prefetcher *prefetcher);
+
+/** Train on a demand access to addr which missed the cache if is_miss
+ *  or hit a prefetched line for the first time if is_prefetch_hit.
+ *  Set addrs[] to the addresses of blocks to prefetch into the cache
+ *  and return their #.
+ */
+unsigned prefetcher_train(Prefetcher *prefetcher, MemAddr addr, bool is_miss,
+                          bool is_prefetch_hit,
+                          MemAddr addrs[PREFETCH_MAX_DEGREE]);
+
+/** Look up a demand miss on addr at time now in the stream buffers.
+ *  On a hit, counts a useful (and possibly late) prefetch, advances
+ *  the buffer and returns true; otherwise reallocates the least
+ *  recently used buffer to the blocks following addr.  Returns false
+ *  if the prefetcher has no stream buffers.
+ */
+bool prefetcher_stream_hit(Prefetcher *prefetcher, MemAddr addr, long now);
+
+/** Record that the demand block containing addr was evicted by a
+ *  prefetch fill.
+ */
+void prefetcher_note_eviction(Prefetcher *prefetcher, MemAddr addr);
+
+/** Record a demand miss on addr, counting it as pollution if its block
+ *  was evicted by a prefetch fill.
+ */
+void prefetcher_note_miss(Prefetcher *prefetcher, MemAddr addr);
+
+/** Return true iff a prefetch issued at time issued is still
+ *  in flight at time now.
+ */
+bool prefetcher_is_late(const Prefetcher *prefetcher, long issued, long now);
+
+/** Return the prefetch counts, which the cache updates directly for
+ *  prefetches into its lines.
+ */
+PrefetchStats *prefetcher_stats(Prefetcher *prefetcher);
+
+/** Return the # of bytes prefetcher_save() stores for prefetcher */
+size_t prefetcher_save_size(const Prefetcher *prefetcher);
+
+/** Store the predictor state of prefetcher, but not its counts, in
+ *  the prefetcher_save_size() bytes at buf.
+ */
+void prefetcher_save(const Prefetcher *prefetcher, void *buf);
+
+/** Restore into prefetcher the state stored at buf by
+ *  prefetcher_save() for a prefetcher with the same parameters.
+ */
+void prefetcher_load(Prefetcher *prefetcher, const void *buf);
+
+#endif //ifndef PREFETCH_H_
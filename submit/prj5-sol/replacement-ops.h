@@ -0,0 +1,603 @@
+#ifndef REPLACEMENT_OPS_H_
+#define REPLACEMENT_OPS_H_
+
+#include "replacement.h"
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/** The operations of the replacement policies, as static inline
+ *  functions so that simulation kernels specialized for a policy and a
+ *  constant E can inline them.  replacement.c builds the
+ *  ReplacementPolicy table from them.
+ */
+
+/** Way and bucket indexes are stored in 16 bits with NONE as a null
+ *  link, limiting list-based policies to fewer than NONE ways.
+ */
+typedef uint16_t Link;
+enum { NONE = 0xffff };
+
+static inline bool
+is_any_ways(unsigned E)
+{
+  return E > 0;
+}
+
+static inline bool
+is_link_ways(unsigned E)
+{
+  return E > 0 && E < NONE;
+}
+
+static inline bool
+is_power_of_2_ways(unsigned E)
+{
+  return E > 0 && (E & (E - 1)) == 0;
+}
+
+static inline void
+remove_nop(void *meta, unsigned E, unsigned way)
+{
+}
+
+/*************************** LRU and MRU *******************************/
+
+/** The valid ways of a set on a doubly-linked recency list: links[2*w]
+ *  and links[2*w + 1] are the previous (more recent) and next (less
+ *  recent) ways of way w.  ends[0] is the most recently used way and
+ *  ends[1] the least recently used.
+ */
+typedef struct {
+  Link ends[2];
+  Link links[];
+} RecencyList;
+
+static inline size_t
+recency_meta_size(unsigned E)
+{
+  return sizeof(RecencyList) + 2 * E * sizeof(Link);
+}
+
+static inline void
+recency_init(void *meta, unsigned E)
+{
+  RecencyList *list = meta;
+  list->ends[0] = list->ends[1] = NONE;
+}
+
+static inline void
+recency_unlink(RecencyList *list, unsigned way)
+{
+  Link prev = list->links[2*way], next = list->links[2*way + 1];
+  if (prev == NONE) list->ends[0] = next; else list->links[2*prev + 1] = next;
+  if (next == NONE) list->ends[1] = prev; else list->links[2*next] = prev;
+}
+
+static inline void
+recency_push_front(RecencyList *list, unsigned way)
+{
+  Link first = list->ends[0];
+  list->links[2*way] = NONE;
+  list->links[2*way + 1] = first;
+  if (first == NONE) list->ends[1] = way; else list->links[2*first] = way;
+  list->ends[0] = way;
+}
+
+static inline void
+recency_touch(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  RecencyList *list = meta;
+  if (list->ends[0] == way) return;
+  recency_unlink(list, way);
+  recency_push_front(list, way);
+}
+
+static inline void
+recency_fill(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  recency_push_front(meta, way);
+}
+
+static inline void
+recency_remove(void *meta, unsigned E, unsigned way)
+{
+  recency_unlink(meta, way);
+}
+
+static inline unsigned
+lru_victim(void *meta, unsigned E, ReplState *state)
+{
+  RecencyList *list = meta;
+  unsigned way = list->ends[1];
+  recency_unlink(list, way);
+  return way;
+}
+
+static inline unsigned
+mru_victim(void *meta, unsigned E, ReplState *state)
+{
+  RecencyList *list = meta;
+  unsigned way = list->ends[0];
+  recency_unlink(list, way);
+  return way;
+}
+
+/****************************** Random *********************************/
+
+static inline size_t
+no_meta_size(unsigned E)
+{
+  return 0;
+}
+
+static inline void
+no_meta_init(void *meta, unsigned E)
+{
+}
+
+static inline void
+no_meta_update(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+}
+
+static inline unsigned
+random_victim(void *meta, unsigned E, ReplState *state)
+{
+  return repl_rand_below(state, E);
+}
+
+/***************************** Tree PLRU *******************************/
+
+/** A complete binary tree over the ways stored heap-style in the bits
+ *  of meta: node n (1 <= n < E) has children 2n and 2n + 1, and leaf
+ *  node E + w is way w.  A node's bit gives the side of the next
+ *  victim: 0 for the left subtree, 1 for the right.
+ */
+static inline size_t
+plru_meta_size(unsigned E)
+{
+  return ((E + 63)/64) * sizeof(uint64_t);
+}
+
+static inline void
+plru_init(void *meta, unsigned E)
+{
+  memset(meta, 0, plru_meta_size(E));
+}
+
+static inline void
+plru_touch(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  uint64_t *bits = meta;
+  //walk up from the leaf, pointing each ancestor away from way
+  for (unsigned node = E + way; node > 1; node /= 2) {
+    unsigned parent = node / 2;
+    uint64_t bit = (uint64_t)1 << (parent % 64);
+    if (node & 1) {
+      bits[parent / 64] &= ~bit;
+    }
+    else {
+      bits[parent / 64] |= bit;
+    }
+  }
+}
+
+static inline unsigned
+plru_victim(void *meta, unsigned E, ReplState *state)
+{
+  const uint64_t *bits = meta;
+  unsigned node = 1;
+  while (node < E) {
+    node = 2*node + ((bits[node / 64] >> (node % 64)) & 1);
+  }
+  return node - E;
+}
+
+/*************************** SRRIP / BRRIP *****************************/
+
+/** Re-reference prediction values (RRPV) of 2 bits.  Rather than
+ *  storing an RRPV per way, each set has one bitmask of ways per RRPV
+ *  value, so a victim (a way with RRPV 3) is found with a
+ *  count-trailing-zeros and aging all ways is a shift of the masks.
+ *  masks[v*n_words + k] is word k of the mask of ways with RRPV v.
+ */
+enum { RRPV_MAX = 3, RRPV_LONG = RRPV_MAX - 1, BRRIP_LONG_ODDS = 32 };
+
+static inline unsigned
+rrip_n_words(unsigned E)
+{
+  return (E + 63)/64;
+}
+
+static inline size_t
+rrip_meta_size(unsigned E)
+{
+  return (RRPV_MAX + 1) * rrip_n_words(E) * sizeof(uint64_t);
+}
+
+static inline void
+rrip_init(void *meta, unsigned E)
+{
+  memset(meta, 0, rrip_meta_size(E));
+}
+
+static inline void
+rrip_set(uint64_t *masks, unsigned E, unsigned way, unsigned rrpv)
+{
+  unsigned n_words = rrip_n_words(E);
+  uint64_t bit = (uint64_t)1 << (way % 64);
+  for (unsigned v = 0; v <= RRPV_MAX; v++) {
+    if (v == rrpv) {
+      masks[v*n_words + way/64] |= bit;
+    }
+    else {
+      masks[v*n_words + way/64] &= ~bit;
+    }
+  }
+}
+
+static inline void
+rrip_touch(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  rrip_set(meta, E, way, 0);
+}
+
+static inline void
+srrip_fill(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  rrip_set(meta, E, way, RRPV_LONG);
+}
+
+static inline void
+brrip_fill(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  bool is_long = repl_rand_below(state, BRRIP_LONG_ODDS) == 0;
+  rrip_set(meta, E, way, is_long ? RRPV_LONG : RRPV_MAX);
+}
+
+static inline void
+rrip_remove(void *meta, unsigned E, unsigned way)
+{
+  rrip_set(meta, E, way, RRPV_MAX + 1);
+}
+
+static inline unsigned
+rrip_victim(void *meta, unsigned E, ReplState *state)
+{
+  uint64_t *masks = meta;
+  unsigned n_words = rrip_n_words(E);
+  while (1) {
+    uint64_t *distant = &masks[RRPV_MAX*n_words];
+    for (unsigned k = 0; k < n_words; k++) {
+      if (distant[k]) return k*64 + __builtin_ctzll(distant[k]);
+    }
+    //no way has RRPV_MAX: age all ways by one
+    memmove(&masks[n_words], masks, RRPV_MAX * n_words * sizeof(uint64_t));
+    memset(masks, 0, n_words * sizeof(uint64_t));
+  }
+}
+
+/******************************** LFU **********************************/
+
+/** Ways with equal use counts share a bucket; buckets are on a list in
+ *  increasing count order and each holds its ways on a recency list,
+ *  so the victim (least recently used of the least frequently used) is
+ *  the tail of the first bucket.  A hit moves a way to the next
+ *  bucket, creating it if its count is not exactly one more.  A set
+ *  needs at most E buckets, allocated from a per-set free list.
+ */
+typedef struct {
+  uint32_t *counts;          // [bucket]
+  Link *way_links;           // [2*way], [2*way + 1]: prev, next in bucket
+  Link *way_buckets;         // [way]
+  Link *bucket_ends;         // [2*bucket], [2*bucket + 1]: head, tail way
+  Link *bucket_links;        // [2*bucket], [2*bucket + 1]: prev, next bucket
+  Link *first;               // bucket with lowest count
+  Link *free;                // free bucket list, linked by next
+} LfuSet;
+
+static inline size_t
+lfu_meta_size(unsigned E)
+{
+  return E * sizeof(uint32_t) + (7*E + 2) * sizeof(Link);
+}
+
+static inline LfuSet
+lfu_set(void *meta, unsigned E)
+{
+  LfuSet set;
+  set.counts = meta;
+  Link *links = (Link *)&set.counts[E];
+  set.way_links = links;
+  set.way_buckets = &links[2*E];
+  set.bucket_ends = &links[3*E];
+  set.bucket_links = &links[5*E];
+  set.first = &links[7*E];
+  set.free = &links[7*E + 1];
+  return set;
+}
+
+static inline void
+lfu_init(void *meta, unsigned E)
+{
+  LfuSet set = lfu_set(meta, E);
+  *set.first = NONE;
+  *set.free = 0;
+  for (unsigned b = 0; b < E; b++) {
+    set.bucket_links[2*b + 1] = (b + 1 < E) ? b + 1 : NONE;
+  }
+}
+
+/** Return a new empty bucket with count inserted after bucket prev
+ *  (at the front of the bucket list if prev is NONE).
+ */
+static inline unsigned
+lfu_new_bucket(LfuSet *set, Link prev, uint32_t count)
+{
+  unsigned b = *set->free;
+  assert(b != NONE);
+  *set->free = set->bucket_links[2*b + 1];
+  Link next = (prev == NONE) ? *set->first : set->bucket_links[2*prev + 1];
+  set->counts[b] = count;
+  set->bucket_ends[2*b] = set->bucket_ends[2*b + 1] = NONE;
+  set->bucket_links[2*b] = prev;
+  set->bucket_links[2*b + 1] = next;
+  if (prev == NONE) *set->first = b; else set->bucket_links[2*prev + 1] = b;
+  if (next != NONE) set->bucket_links[2*next] = b;
+  return b;
+}
+
+static inline void
+lfu_push_way(LfuSet *set, unsigned b, unsigned way)
+{
+  Link head = set->bucket_ends[2*b];
+  set->way_buckets[way] = b;
+  set->way_links[2*way] = NONE;
+  set->way_links[2*way + 1] = head;
+  if (head == NONE) set->bucket_ends[2*b + 1] = way;
+  else set->way_links[2*head] = way;
+  set->bucket_ends[2*b] = way;
+}
+
+/** Unlink way from its bucket, freeing the bucket if it is now empty */
+static inline void
+lfu_unlink_way(LfuSet *set, unsigned way)
+{
+  unsigned b = set->way_buckets[way];
+  Link prev = set->way_links[2*way], next = set->way_links[2*way + 1];
+  if (prev == NONE) set->bucket_ends[2*b] = next;
+  else set->way_links[2*prev + 1] = next;
+  if (next == NONE) set->bucket_ends[2*b + 1] = prev;
+  else set->way_links[2*next] = prev;
+  if (set->bucket_ends[2*b] != NONE) return;
+
+  Link bprev = set->bucket_links[2*b], bnext = set->bucket_links[2*b + 1];
+  if (bprev == NONE) *set->first = bnext;
+  else set->bucket_links[2*bprev + 1] = bnext;
+  if (bnext != NONE) set->bucket_links[2*bnext] = bprev;
+  set->bucket_links[2*b + 1] = *set->free;
+  *set->free = b;
+}
+
+static inline void
+lfu_touch(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  LfuSet set = lfu_set(meta, E);
+  unsigned b = set.way_buckets[way];
+  uint32_t count = set.counts[b];
+  if (count == UINT32_MAX) {
+    //saturated: just make way the most recent in its bucket
+    Link prev = set.way_links[2*way], next = set.way_links[2*way + 1];
+    if (prev == NONE) return;
+    set.way_links[2*prev + 1] = next;
+    if (next == NONE) set.bucket_ends[2*b + 1] = prev;
+    else set.way_links[2*next] = prev;
+    lfu_push_way(&set, b, way);
+    return;
+  }
+  Link next = set.bucket_links[2*b + 1];
+  bool is_next_count = next != NONE && set.counts[next] == count + 1;
+  bool is_alone = set.bucket_ends[2*b] == way && set.bucket_ends[2*b + 1] == way;
+  if (is_alone && !is_next_count) {
+    //way keeps its bucket; this also means a full set never needs
+    //more than E buckets
+    set.counts[b]++;
+    return;
+  }
+  unsigned target = is_next_count ? next : lfu_new_bucket(&set, b, count + 1);
+  lfu_unlink_way(&set, way);
+  lfu_push_way(&set, target, way);
+}
+
+static inline void
+lfu_fill(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  LfuSet set = lfu_set(meta, E);
+  Link first = *set.first;
+  unsigned b = (first != NONE && set.counts[first] == 1)
+    ? first
+    : lfu_new_bucket(&set, NONE, 1);
+  lfu_push_way(&set, b, way);
+}
+
+static inline void
+lfu_remove(void *meta, unsigned E, unsigned way)
+{
+  LfuSet set = lfu_set(meta, E);
+  lfu_unlink_way(&set, way);
+}
+
+static inline unsigned
+lfu_victim(void *meta, unsigned E, ReplState *state)
+{
+  LfuSet set = lfu_set(meta, E);
+  unsigned way = set.bucket_ends[2 * *set.first + 1];
+  lfu_unlink_way(&set, way);
+  return way;
+}
+
+/******************************** OPT **********************************/
+
+/** The valid ways of a set on a binary max-heap keyed by the index of
+ *  the next access to each way's block, so the victim is the way whose
+ *  block is needed furthest in the future.  pos[way] is the index of
+ *  way in heap[].
+ */
+typedef struct {
+  unsigned long *next_uses;  // [way]
+  Link *heap;                // [0, *size)
+  Link *pos;                 // [way]
+  Link *size;
+} OptSet;
+
+static inline size_t
+opt_meta_size(unsigned E)
+{
+  return E * sizeof(unsigned long) + (2*E + 1) * sizeof(Link);
+}
+
+static inline OptSet
+opt_set(void *meta, unsigned E)
+{
+  OptSet set;
+  set.next_uses = meta;
+  Link *links = (Link *)&set.next_uses[E];
+  set.heap = links;
+  set.pos = &links[E];
+  set.size = &links[2*E];
+  return set;
+}
+
+static inline void
+opt_init(void *meta, unsigned E)
+{
+  *opt_set(meta, E).size = 0;
+}
+
+static inline void
+opt_put(OptSet *set, unsigned i, unsigned way)
+{
+  set->heap[i] = way;
+  set->pos[way] = i;
+}
+
+/** Restore the heap order for the way at heap index i */
+static inline void
+opt_sift(OptSet *set, unsigned i)
+{
+  unsigned way = set->heap[i];
+  unsigned long key = set->next_uses[way];
+  while (i > 0) {
+    unsigned parent = (i - 1) / 2;
+    if (set->next_uses[set->heap[parent]] >= key) break;
+    opt_put(set, i, set->heap[parent]);
+    i = parent;
+  }
+  unsigned size = *set->size;
+  while (2*i + 1 < size) {
+    unsigned child = 2*i + 1;
+    if (child + 1 < size &&
+        set->next_uses[set->heap[child + 1]] > set->next_uses[set->heap[child]]) {
+      child++;
+    }
+    if (set->next_uses[set->heap[child]] <= key) break;
+    opt_put(set, i, set->heap[child]);
+    i = child;
+  }
+  opt_put(set, i, way);
+}
+
+static inline void
+opt_touch(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  OptSet set = opt_set(meta, E);
+  set.next_uses[way] = state->next_use;
+  opt_sift(&set, set.pos[way]);
+}
+
+static inline void
+opt_fill(void *meta, unsigned E, unsigned way, ReplState *state)
+{
+  OptSet set = opt_set(meta, E);
+  set.next_uses[way] = state->next_use;
+  opt_put(&set, (*set.size)++, way);
+  opt_sift(&set, set.pos[way]);
+}
+
+static inline void
+opt_remove(void *meta, unsigned E, unsigned way)
+{
+  OptSet set = opt_set(meta, E);
+  unsigned i = set.pos[way];
+  unsigned last = set.heap[--*set.size];
+  if (last == way) return;
+  opt_put(&set, i, last);
+  opt_sift(&set, i);
+}
+
+static inline unsigned
+opt_victim(void *meta, unsigned E, ReplState *state)
+{
+  unsigned way = opt_set(meta, E).heap[0];
+  opt_remove(meta, E, way);
+  return way;
+}
+
+/**************************** Static Dispatch **************************/
+
+/** The repl_*() functions call the operation of replacement, which
+ *  should be a compile-time constant so that the switch folds away.
+ *  Must be in sync with the policy table in replacement.c.
+ */
+
+static inline void
+repl_touch(Replacement replacement, void *meta, unsigned E, unsigned way,
+           ReplState *state)
+{
+  switch (replacement) {
+  case LRU_R: case MRU_R: recency_touch(meta, E, way, state); break;
+  case RANDOM_R: break;
+  case PLRU_R: plru_touch(meta, E, way, state); break;
+  case SRRIP_R: case BRRIP_R: rrip_touch(meta, E, way, state); break;
+  case LFU_R: lfu_touch(meta, E, way, state); break;
+  case OPT_R: opt_touch(meta, E, way, state); break;
+  }
+}
+
+static inline void
+repl_fill(Replacement replacement, void *meta, unsigned E, unsigned way,
+          ReplState *state)
+{
+  switch (replacement) {
+  case LRU_R: case MRU_R: recency_fill(meta, E, way, state); break;
+  case RANDOM_R: break;
+  case PLRU_R: plru_touch(meta, E, way, state); break;
+  case SRRIP_R: srrip_fill(meta, E, way, state); break;
+  case BRRIP_R: brrip_fill(meta, E, way, state); break;
+  case LFU_R: lfu_fill(meta, E, way, state); break;
+  case OPT_R: opt_fill(meta, E, way, state); break;
+  }
+}
+
+static inline unsigned
+repl_victim(Replacement replacement, void *meta, unsigned E,
+            ReplState *state)
+{
+  switch (replacement) {
+  case LRU_R: return lru_victim(meta, E, state);
+  case MRU_R: return mru_victim(meta, E, state);
+  case RANDOM_R: return random_victim(meta, E, state);
+  case PLRU_R: return plru_victim(meta, E, state);
+  case SRRIP_R: case BRRIP_R: return rrip_victim(meta, E, state);
+  case LFU_R: return lfu_victim(meta, E, state);
+  case OPT_R: return opt_victim(meta, E, state);
+  }
+  return 0;
+}
+
+#endif //ifndef REPLACEMENT_OPS_H_
@@ -0,0 +1,92 @@
+#include "replacement.h"
+#include "replacement-ops.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/***************************** Policy Table ****************************/
+
+static const ReplacementPolicy POLICIES[N_REPLACEMENTS] = {
+	[LRU_R] = {
+		.name = "lru", .is_deterministic = true, .is_supported = is_link_ways,
+		.meta_size = recency_meta_size, .init = recency_init,
+		.touch = recency_touch, .fill = recency_fill,
+		.remove = recency_remove, .victim = lru_victim,
+	},
+	[MRU_R] = {
+		.name = "mru", .is_deterministic = true, .is_supported = is_link_ways,
+		.meta_size = recency_meta_size, .init = recency_init,
+		.touch = recency_touch, .fill = recency_fill,
+		.remove = recency_remove, .victim = mru_victim,
+	},
+	[RANDOM_R] = {
+		.name = "rand", .is_deterministic = false, .is_supported = is_any_ways,
+		.meta_size = no_meta_size, .init = no_meta_init,
+		.touch = no_meta_update, .fill = no_meta_update,
+		.remove = remove_nop, .victim = random_victim,
+	},
+	[PLRU_R] = {
+		.name = "plru", .is_deterministic = true,
+		.is_supported = is_power_of_2_ways,
+		.meta_size = plru_meta_size, .init = plru_init,
+		.touch = plru_touch, .fill = plru_touch,
+		.remove = remove_nop, .victim = plru_victim,
+	},
+	[SRRIP_R] = {
+		.name = "srrip", .is_deterministic = true, .is_supported = is_any_ways,
+		.meta_size = rrip_meta_size, .init = rrip_init,
+		.touch = rrip_touch, .fill = srrip_fill,
+		.remove = rrip_remove, .victim = rrip_victim,
+	},
+	[BRRIP_R] = {
+		.name = "brrip", .is_deterministic = false, .is_supported = is_any_ways,
+		.meta_size = rrip_meta_size, .init = rrip_init,
+		.touch = rrip_touch, .fill = brrip_fill,
+		.remove = rrip_remove, .victim = rrip_victim,
+	},
+	[LFU_R] = {
+		.name = "lfu", .is_deterministic = true, .is_supported = is_link_ways,
+		.meta_size = lfu_meta_size, .init = lfu_init,
+		.touch = lfu_touch, .fill = lfu_fill,
+		.remove = lfu_remove, .victim = lfu_victim,
+	},
+	[OPT_R] = {
+		.name = "opt", .is_deterministic = true, .needs_future = true,
+		.is_supported = is_link_ways,
+		.meta_size = opt_meta_size, .init = opt_init,
+		.touch = opt_touch, .fill = opt_fill,
+		.remove = opt_remove, .victim = opt_victim,
+	},
+};
+
+const ReplacementPolicy *
+get_replacement_policy(Replacement replacement)
+{
+	assert(replacement < sizeof(POLICIES)/sizeof(POLICIES[0]));
+	return &POLICIES[replacement];
+}
+
+int
+parse_replacement(const char *name)
+{
+	for (int r = 0; r < N_REPLACEMENTS; r++) {
+		if (strcmp(name, POLICIES[r].name) == 0) return r;
+	}
+	return -1;
+}
+
+void
+init_repl_state(ReplState *state, unsigned long seed)
+{
+	//splitmix64 finalizer so that small and zero seeds give good,
+	//non-zero xorshift states
+	uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	state->rng = z ? z : 1;
+	state->next_use = ULONG_MAX;
+}
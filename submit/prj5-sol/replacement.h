@@ -0,0 +1,78 @@
+#ifndef REPLACEMENT_H_
+#define REPLACEMENT_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Replacement state shared by all the sets of a cache */
+typedef struct {
+  uint64_t rng;              // xorshift64* state; never 0
+  unsigned long next_use;    // for policies which need the future: the
+                             // index of the next access to the block
+                             // being touched or filled, ULONG_MAX if none
+} ReplState;
+
+/** A replacement policy.  Each set of a cache has meta_size(E) bytes
+ *  of policy metadata (8-byte aligned) which track the valid ways of
+ *  the set; invalid ways are always filled before victim() is called.
+ *  No operation takes time linear in E.
+ */
+typedef struct {
+  const char *name;
+  /** true if the policy makes no use of ReplState.rng */
+  bool is_deterministic;
+  /** true if the policy uses ReplState.next_use */
+  bool needs_future;
+  /** return true iff the policy can manage sets with E ways */
+  bool (*is_supported)(unsigned E);
+  /** return # of bytes of metadata needed for a set with E ways */
+  size_t (*meta_size)(unsigned E);
+  /** initialize the metadata for a set whose ways are all invalid */
+  void (*init)(void *meta, unsigned E);
+  /** record a hit on valid way */
+  void (*touch)(void *meta, unsigned E, unsigned way, ReplState *state);
+  /** record a fill of previously invalid or victimized way */
+  void (*fill)(void *meta, unsigned E, unsigned way, ReplState *state);
+  /** record that way has become invalid */
+  void (*remove)(void *meta, unsigned E, unsigned way);
+  /** return the way to replace in a set with all ways valid; the
+   *  way is then refilled with fill()
+   */
+  unsigned (*victim)(void *meta, unsigned E, ReplState *state);
+} ReplacementPolicy;
+
+/** Return the policy implementing replacement */
+const ReplacementPolicy *get_replacement_policy(Replacement replacement);
+
+/** # of Replacement values */
+enum { N_REPLACEMENTS = OPT_R + 1 };
+
+/** Return the Replacement whose policy has name name, < 0 if none */
+int parse_replacement(const char *name);
+
+/** Initialize state from seed */
+void init_repl_state(ReplState *state, unsigned long seed);
+
+/** Return the next pseudo-random number from state */
+static inline uint64_t
+repl_rand(ReplState *state)
+{
+  uint64_t x = state->rng;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  state->rng = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+/** Return a pseudo-random number in [0, n) from state */
+static inline unsigned
+repl_rand_below(ReplState *state, unsigned n)
+{
+  return (unsigned)(((unsigned __int128)repl_rand(state) * n) >> 64);
+}
+
+#endif //ifndef REPLACEMENT_H_
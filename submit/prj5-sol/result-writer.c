@@ -0,0 +1,191 @@
+#include "result-writer.h"
+#include "memalloc.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static const char RESULTS_MAGIC[4] = { 'C', 'S', 'R', 'S' };
+
+enum {
+	BUF_SIZE = 64*1024,
+	MAX_VARINT_SIZE = 10,
+	//longest text line without its note: 2 addresses of up to 16
+	//digits, their "0x"s and the separators and codes around them
+	MAX_LINE_SIZE = 64,
+};
+
+/************************** Type Definitions  **************************/
+
+struct ResultWriterImpl {
+	bool is_binary;
+	int fd;
+	unsigned addr_width;
+	bool is_ok;
+	int err;                    //errno of first failed write
+	size_t n;                   //# of bytes buffered
+	char buf[BUF_SIZE];
+};
+
+//must be in sync with CACHE_STATUS enum
+static const char STATUS_CHARS[] = { 'h', 'm', 'M' };
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+/******************** Creation / Destruction Routines ******************/
+
+static ResultWriter *
+new_result_writer(int fd, bool is_binary, unsigned addr_width)
+{
+	ResultWriter *writer = malloc_chk(sizeof(ResultWriter));
+	writer->is_binary = is_binary;
+	writer->fd = fd;
+	writer->addr_width = addr_width;
+	writer->is_ok = true;
+	writer->err = 0;
+	writer->n = 0;
+	return writer;
+}
+
+ResultWriter *
+new_text_result_writer(int fd, unsigned addr_width)
+{
+	return new_result_writer(fd, false, addr_width);
+}
+
+ResultWriter *
+new_binary_result_writer(int fd, unsigned n_addr_bits)
+{
+	ResultWriter *writer = new_result_writer(fd, true, 0);
+	char *header = writer->buf;
+	memset(header, 0, RESULTS_HEADER_SIZE);
+	memcpy(header, RESULTS_MAGIC, sizeof(RESULTS_MAGIC));
+	header[4] = RESULTS_VERSION;
+	header[5] = n_addr_bits;
+	writer->n = RESULTS_HEADER_SIZE;
+	return writer;
+}
+
+bool
+free_result_writer(ResultWriter *writer)
+{
+	bool is_ok = result_writer_flush(writer);
+	free(writer);
+	return is_ok;
+}
+
+/****************************** Flushing *******************************/
+
+bool
+result_writer_flush(ResultWriter *writer)
+{
+	const char *p = writer->buf;
+	size_t n_left = writer->n;
+	while (writer->is_ok && n_left > 0) {
+		ssize_t n = write(writer->fd, p, n_left);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			writer->is_ok = false;
+			writer->err = errno;
+		}
+		else {
+			p += n;
+			n_left -= n;
+		}
+	}
+	writer->n = 0;
+	if (!writer->is_ok) errno = writer->err;
+	return writer->is_ok;
+}
+
+/** Flush writer unless its buffer has room for n more bytes */
+static inline void
+reserve(ResultWriter *writer, size_t n)
+{
+	if (writer->n + n > BUF_SIZE) result_writer_flush(writer);
+}
+
+/***************************** Formatting ******************************/
+
+/** Format addr as "0x" followed by at least width hex digits at p,
+ *  returning the end of the formatted address.  Like printf()'s
+ *  "0x%0*lx".
+ */
+static inline char *
+put_hex(char *p, MemAddr addr, unsigned width)
+{
+	unsigned n_digits = 1;
+	for (MemAddr a = addr >> 4; a != 0; a >>= 4) n_digits++;
+	if (n_digits < width) n_digits = width;
+	*p++ = '0';
+	*p++ = 'x';
+	char *end = p + n_digits;
+	for (char *q = end; q > p; addr >>= 4) *--q = HEX_DIGITS[addr & 0xf];
+	return end;
+}
+
+static void
+write_text(ResultWriter *writer, const CacheResult *result, bool is_write,
+           const char *note)
+{
+	size_t note_len = note ? strlen(note) : 0;
+	reserve(writer, MAX_LINE_SIZE + note_len);
+	char *p = &writer->buf[writer->n];
+	p = put_hex(p, result->access_addr, writer->addr_width);
+	*p++ = ' ';
+	*p++ = is_write ? 'w' : 'r';
+	*p++ = ':';
+	*p++ = ' ';
+	*p++ = STATUS_CHARS[result->status];
+	if (result->status == CACHE_MISS_WITH_REPLACE) {
+		*p++ = ' ';
+		p = put_hex(p, result->replace_addr, writer->addr_width);
+		if (result->is_dirty) {
+			*p++ = ' ';
+			*p++ = 'w';
+		}
+	}
+	if (note) {
+		*p++ = ' ';
+		*p++ = '[';
+		memcpy(p, note, note_len);
+		p += note_len;
+		*p++ = ']';
+	}
+	*p++ = '\n';
+	writer->n = p - writer->buf;
+}
+
+static void
+write_binary(ResultWriter *writer, const CacheResult *result, bool is_write)
+{
+	reserve(writer, 1 + MAX_VARINT_SIZE);
+	uint8_t *p = (uint8_t *)&writer->buf[writer->n];
+	bool is_replace = result->status == CACHE_MISS_WITH_REPLACE;
+	bool is_dirty = is_replace && result->is_dirty;
+	*p++ = result->status | is_dirty << 2 | is_write << 3;
+	if (is_replace) {
+		uint64_t addr = result->replace_addr;
+		while (addr >= 0x80) {
+			*p++ = (addr & 0x7f) | 0x80;
+			addr >>= 7;
+		}
+		*p++ = addr;
+	}
+	writer->n = (char *)p - writer->buf;
+}
+
+void
+result_write(ResultWriter *writer, const CacheResult *result, bool is_write,
+             const char *note)
+{
+	if (writer->is_binary) {
+		write_binary(writer, result, is_write);
+	}
+	else {
+		write_text(writer, result, is_write, note);
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef RESULT_WRITER_H_
+#define RESULT_WRITER_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+
+/** Per-access results are written either as text, one
+ *  "0xADDR r|w: h|m|M[ 0xREPLACE[ w]][ [NOTE]]" line per access with
+ *  addresses zero-padded to a fixed # of hex digits, or as a binary
+ *  stream:
+ *
+ *    header:   "CSRS", version byte RESULTS_VERSION, address-width byte
+ *              (# of significant address bits), 2 zero bytes.
+ *    results:  one byte per access, the CacheStatus in bits 0-1,
+ *              is_write in bit 3 and, for a CACHE_MISS_WITH_REPLACE,
+ *              is_dirty in bit 2 followed by the replace address as an
+ *              unsigned LEB128 varint.
+ *
+ *  Access addresses are not written to the binary stream, since they
+ *  are those of the trace.  Both are formatted into a large buffer
+ *  which is flushed with write() calls on a file descriptor, so any
+ *  stdio buffer for the descriptor must be flushed before results are
+ *  written.
+ */
+typedef struct ResultWriterImpl ResultWriter;
+
+enum {
+  RESULTS_VERSION = 1,
+  RESULTS_HEADER_SIZE = 8,
+};
+
+/** Return a writer of text results to fd with addresses padded to
+ *  addr_width hex digits.
+ */
+ResultWriter *new_text_result_writer(int fd, unsigned addr_width);
+
+/** Return a writer of binary results to fd, writing a header for
+ *  addresses of n_addr_bits bits.
+ */
+ResultWriter *new_binary_result_writer(int fd, unsigned n_addr_bits);
+
+/** Write *result for an access with is_write.  A non-NULL note is
+ *  appended in [] to a text result and ignored for a binary one.
+ */
+void result_write(ResultWriter *writer, const CacheResult *result,
+                  bool is_write, const char *note);
+
+/** Write all buffered results to the file descriptor.  Returns false
+ *  with errno set if any write so far has failed.
+ */
+bool result_writer_flush(ResultWriter *writer);
+
+/** Flush and free *writer; does not close its file descriptor.
+ *  Returns false with errno set if any write failed.
+ */
+bool free_result_writer(ResultWriter *writer);
+
+#endif //ifndef RESULT_WRITER_H_
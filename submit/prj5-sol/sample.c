@@ -0,0 +1,132 @@
+#include "sample.h"
+#include "hash-map.h"
+#include "memalloc.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/************************** Type Definitions  **************************/
+
+enum { NOT_SAMPLED = UINT32_MAX };
+
+/** slots[set] is the index of a sampled set in the per-set counts,
+ *  NOT_SAMPLED for other sets.
+ */
+struct SetSamplerImpl {
+	unsigned blk_bits;
+	unsigned long set_mask;
+	unsigned long n_sets;
+	unsigned long n_sampled_sets;
+	uint32_t *slots;            // [n_sets]
+	unsigned long *accesses;    // [n_sampled_sets]
+	unsigned long *misses;      // [n_sampled_sets]
+	unsigned long n_accesses;
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+SetSampler *
+new_set_sampler(const CacheParams *params, unsigned k)
+{
+	if (k == 0) return NULL;
+	unsigned long n_sets = 1UL << params->n_set_index_bits;
+	uint32_t *slots = malloc_chk(n_sets * sizeof(uint32_t));
+	unsigned long n_sampled = 0;
+	for (unsigned long set = 0; set < n_sets; set++) {
+		slots[set] = (hash_mem_addr(set) % k == 0) ? n_sampled++ : NOT_SAMPLED;
+	}
+	if (n_sampled == 0) {
+		free(slots);
+		return NULL;
+	}
+	SetSampler *sampler = malloc_chk(sizeof(SetSampler));
+	sampler->blk_bits = params->n_blk_offset_bits;
+	sampler->set_mask = n_sets - 1;
+	sampler->n_sets = n_sets;
+	sampler->n_sampled_sets = n_sampled;
+	sampler->slots = slots;
+	sampler->accesses = calloc_chk(n_sampled, sizeof(unsigned long));
+	sampler->misses = calloc_chk(n_sampled, sizeof(unsigned long));
+	sampler->n_accesses = 0;
+	return sampler;
+}
+
+void
+free_set_sampler(SetSampler *sampler)
+{
+	if (!sampler) return;
+	free(sampler->slots);
+	free(sampler->accesses);
+	free(sampler->misses);
+	free(sampler);
+}
+
+/***************************** Operations ******************************/
+
+static inline uint32_t
+get_slot(const SetSampler *sampler, MemAddr addr)
+{
+	return sampler->slots[(addr >> sampler->blk_bits) & sampler->set_mask];
+}
+
+size_t
+set_sampler_filter(SetSampler *sampler, size_t n,
+                   const MemAddr access_addrs[], const bool is_writes[],
+                   MemAddr sampled_addrs[], bool sampled_writes[])
+{
+	size_t n_sampled = 0;
+	for (size_t i = 0; i < n; i++) {
+		//copy unconditionally and advance only for sampled sets
+		sampled_addrs[n_sampled] = access_addrs[i];
+		sampled_writes[n_sampled] = is_writes[i];
+		n_sampled += get_slot(sampler, access_addrs[i]) != NOT_SAMPLED;
+	}
+	sampler->n_accesses += n;
+	return n_sampled;
+}
+
+void
+set_sampler_count(SetSampler *sampler, size_t n,
+                  const MemAddr sampled_addrs[], const CacheResult results[])
+{
+	for (size_t i = 0; i < n; i++) {
+		uint32_t slot = get_slot(sampler, sampled_addrs[i]);
+		sampler->accesses[slot]++;
+		sampler->misses[slot] += results[i].status != CACHE_HIT;
+	}
+}
+
+void
+set_sampler_estimate(const SetSampler *sampler, SampleEstimate *estimate)
+{
+	unsigned long n = sampler->n_sampled_sets;
+	unsigned long n_accesses = 0, n_misses = 0;
+	for (unsigned long i = 0; i < n; i++) {
+		n_accesses += sampler->accesses[i];
+		n_misses += sampler->misses[i];
+	}
+	estimate->n_sets = sampler->n_sets;
+	estimate->n_sampled_sets = n;
+	estimate->n_accesses = sampler->n_accesses;
+	estimate->n_sampled_accesses = n_accesses;
+	double rate = (n_accesses == 0) ? 0.0 : (double)n_misses / n_accesses;
+	estimate->miss_rate = rate;
+	if (n < 2 || n_accesses == 0) {
+		estimate->miss_rate_error = NAN;
+		return;
+	}
+	//variance of a ratio estimate from a sample of n of the N sets
+	//(clusters), with the finite population correction
+	double sum_sq = 0.0;
+	for (unsigned long i = 0; i < n; i++) {
+		double residual = sampler->misses[i] - rate * sampler->accesses[i];
+		sum_sq += residual * residual;
+	}
+	double mean_accesses = (double)n_accesses / n;
+	double fpc = 1.0 - (double)n / sampler->n_sets;
+	double variance =
+		fpc * sum_sq / (n - 1) / (n * mean_accesses * mean_accesses);
+	estimate->miss_rate_error = 1.96 * sqrt(variance);
+}
@@ -0,0 +1,57 @@
+#ifndef SAMPLE_H_
+#define SAMPLE_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Set sampling: only the accesses to a deterministic subset of about
+ *  1/k of the sets of a cache are simulated, the sets being those
+ *  whose index hashes to 0 mod k.  Since sets do not interact, the
+ *  sampled sets behave exactly as in a full simulation, and the miss
+ *  rate is estimated from them as a ratio estimate over the sampled
+ *  sets, treated as a simple random sample of clusters.
+ */
+typedef struct SetSamplerImpl SetSampler;
+
+typedef struct {
+  unsigned long n_sets;
+  unsigned long n_sampled_sets;
+  unsigned long n_accesses;           // # of accesses in the trace
+  unsigned long n_sampled_accesses;
+  double miss_rate;                   // estimated
+  double miss_rate_error;             // half-width of the 95% confidence
+                                      // interval for miss_rate
+} SampleEstimate;
+
+/** Return a sampler for about 1 in k sets of the cache with
+ *  parameters *params.  Returns NULL if k is 0 or no set is sampled.
+ */
+SetSampler *new_set_sampler(const CacheParams *params, unsigned k);
+
+/** Free all resources used by *sampler */
+void free_set_sampler(SetSampler *sampler);
+
+/** Copy the accesses among the n in access_addrs[] and is_writes[]
+ *  which map to sampled sets to sampled_addrs[] and
+ *  sampled_writes[], returning their #.  The copies may be made in
+ *  place.
+ */
+size_t set_sampler_filter(SetSampler *sampler, size_t n,
+                          const MemAddr access_addrs[],
+                          const bool is_writes[],
+                          MemAddr sampled_addrs[], bool sampled_writes[]);
+
+/** Record the results[] of simulating the n sampled accesses to
+ *  sampled_addrs[].
+ */
+void set_sampler_count(SetSampler *sampler, size_t n,
+                       const MemAddr sampled_addrs[],
+                       const CacheResult results[]);
+
+/** Set *estimate from the accesses filtered and counted so far */
+void set_sampler_estimate(const SetSampler *sampler,
+                          SampleEstimate *estimate);
+
+#endif //ifndef SAMPLE_H_
@@ -0,0 +1,237 @@
+#include "sharded.h"
+#include "memalloc.h"
+#include "replacement.h"
+#include "spsc-ring.h"
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************************** Type Definitions  **************************/
+
+enum {
+	RING_CAPACITY = 2 * SHARDED_MAX_BATCH,
+	WORKER_BATCH = 256,    // # of accesses a worker takes at a time
+};
+
+typedef struct {
+	MemAddr addr;
+	bool is_write;
+} Access;
+
+/** Each shard has its own full-size CacheSim but only simulates the
+ *  sets it owns.
+ */
+typedef struct {
+	pthread_t thread;
+	CacheSim *cache;
+	SpscRing in;                // Access items from the main thread
+	SpscRing out;               // CacheResult items to the main thread
+	const _Atomic bool *is_done;
+	bool want_results;
+	unsigned long stats[CACHE_N_STATUS + 1];
+} Shard;
+
+struct ShardedSimImpl {
+	unsigned n_shards;
+	bool want_results;
+	bool is_finished;
+	_Atomic bool is_done;       // no more accesses will be queued
+	Shard *shards;
+	Access *staged;             // [shard*SHARDED_MAX_BATCH + i]
+	size_t *n_staged;           // [shard]
+	unsigned *shard_of;         // [i]: shard of access i of current batch
+	CacheResult *collected;     // [shard*SHARDED_MAX_BATCH + i]
+};
+
+/*************************** Worker Threads ****************************/
+
+static void
+push_all(SpscRing *ring, const void *items, size_t item_size, size_t n)
+{
+	const unsigned char *p = items;
+	while (n > 0) {
+		size_t n_pushed = spsc_ring_push(ring, p, n);
+		if (n_pushed == 0) sched_yield();
+		p += n_pushed * item_size;
+		n -= n_pushed;
+	}
+}
+
+static void
+pop_all(SpscRing *ring, void *items, size_t item_size, size_t n)
+{
+	unsigned char *p = items;
+	while (n > 0) {
+		size_t n_popped = spsc_ring_pop(ring, p, n);
+		if (n_popped == 0) sched_yield();
+		p += n_popped * item_size;
+		n -= n_popped;
+	}
+}
+
+static void *
+do_shard(void *arg)
+{
+	Shard *shard = arg;
+	Access accesses[WORKER_BATCH];
+	CacheResult results[WORKER_BATCH];
+	while (1) {
+		size_t n = spsc_ring_pop(&shard->in, accesses, WORKER_BATCH);
+		if (n == 0) {
+			if (!atomic_load_explicit(shard->is_done, memory_order_acquire)) {
+				sched_yield();
+				continue;
+			}
+			//all accesses were queued before is_done was set
+			n = spsc_ring_pop(&shard->in, accesses, WORKER_BATCH);
+			if (n == 0) break;
+		}
+		for (size_t i = 0; i < n; i++) {
+			CacheResult result =
+				cache_sim_result(shard->cache, accesses[i].addr, accesses[i].is_write);
+			shard->stats[result.status]++;
+			if (result.status == CACHE_MISS_WITH_REPLACE && result.is_dirty) {
+				shard->stats[CACHE_N_STATUS]++;
+			}
+			results[i] = result;
+		}
+		if (shard->want_results) {
+			push_all(&shard->out, results, sizeof(CacheResult), n);
+		}
+	}
+	return NULL;
+}
+
+/******************** Creation / Destruction Routines ******************/
+
+ShardedSim *
+new_sharded_sim(const CacheParams *params, unsigned n_threads,
+                bool want_results)
+{
+	assert(n_threads > 0);
+	const ReplacementPolicy *policy = get_replacement_policy(params->replacement);
+	if (!policy->is_deterministic || policy->needs_future ||
+	    params->prefetch.kind != NO_PF ||
+	    !policy->is_supported(params->n_lines_per_set)) {
+		return NULL;
+	}
+	ShardedSim *sim = calloc_chk(1, sizeof(ShardedSim));
+	sim->n_shards = n_threads;
+	sim->want_results = want_results;
+	atomic_init(&sim->is_done, false);
+	sim->shards = calloc_chk(n_threads, sizeof(Shard));
+	sim->staged = malloc_chk(n_threads * SHARDED_MAX_BATCH * sizeof(Access));
+	sim->n_staged = calloc_chk(n_threads, sizeof(size_t));
+	sim->shard_of = malloc_chk(SHARDED_MAX_BATCH * sizeof(unsigned));
+	if (want_results) {
+		sim->collected =
+			malloc_chk(n_threads * SHARDED_MAX_BATCH * sizeof(CacheResult));
+	}
+	for (unsigned k = 0; k < n_threads; k++) {
+		Shard *shard = &sim->shards[k];
+		shard->cache = new_cache_sim(params);
+		init_spsc_ring(&shard->in, RING_CAPACITY, sizeof(Access));
+		if (want_results) {
+			init_spsc_ring(&shard->out, RING_CAPACITY, sizeof(CacheResult));
+		}
+		shard->is_done = &sim->is_done;
+		shard->want_results = want_results;
+		int rc = pthread_create(&shard->thread, NULL, do_shard, shard);
+		if (rc != 0) {
+			fprintf(stderr, "cannot create worker thread: %s\n", strerror(rc));
+			exit(1);
+		}
+	}
+	return sim;
+}
+
+void
+sharded_sim_finish(ShardedSim *sim, unsigned long stats[CACHE_N_STATUS + 1])
+{
+	if (!sim->is_finished) {
+		atomic_store_explicit(&sim->is_done, true, memory_order_release);
+		for (unsigned k = 0; k < sim->n_shards; k++) {
+			pthread_join(sim->shards[k].thread, NULL);
+		}
+		sim->is_finished = true;
+	}
+	if (!stats) return;
+	memset(stats, 0, (CACHE_N_STATUS + 1) * sizeof(stats[0]));
+	for (unsigned k = 0; k < sim->n_shards; k++) {
+		for (int i = 0; i < CACHE_N_STATUS + 1; i++) {
+			stats[i] += sim->shards[k].stats[i];
+		}
+	}
+}
+
+void
+free_sharded_sim(ShardedSim *sim)
+{
+	if (!sim) return;
+	sharded_sim_finish(sim, NULL);
+	for (unsigned k = 0; k < sim->n_shards; k++) {
+		Shard *shard = &sim->shards[k];
+		free_cache_sim(shard->cache);
+		destroy_spsc_ring(&shard->in);
+		if (sim->want_results) destroy_spsc_ring(&shard->out);
+	}
+	free(sim->shards);
+	free(sim->staged);
+	free(sim->n_staged);
+	free(sim->shard_of);
+	free(sim->collected);
+	free(sim);
+}
+
+size_t
+sharded_sim_memory_size(const ShardedSim *sim)
+{
+	size_t size = 0;
+	for (unsigned k = 0; k < sim->n_shards; k++) {
+		size += cache_sim_memory_size(sim->shards[k].cache);
+	}
+	return size;
+}
+
+/************************** Simulation Routine *************************/
+
+void
+sharded_sim_results(ShardedSim *sim, size_t n,
+                    const MemAddr access_addrs[], const bool is_writes[],
+                    CacheResult results[])
+{
+	assert(n <= SHARDED_MAX_BATCH && !sim->is_finished);
+	unsigned n_shards = sim->n_shards;
+	const CacheSim *cache = sim->shards[0].cache;
+	memset(sim->n_staged, 0, n_shards * sizeof(size_t));
+	for (size_t i = 0; i < n; i++) {
+		unsigned k = cache_sim_set_index(cache, access_addrs[i]) % n_shards;
+		sim->shard_of[i] = k;
+		Access *access = &sim->staged[k*SHARDED_MAX_BATCH + sim->n_staged[k]++];
+		access->addr = access_addrs[i];
+		access->is_write = is_writes[i];
+	}
+	for (unsigned k = 0; k < n_shards; k++) {
+		push_all(&sim->shards[k].in, &sim->staged[k*SHARDED_MAX_BATCH],
+		         sizeof(Access), sim->n_staged[k]);
+	}
+	if (!sim->want_results) return;
+
+	//each shard returns its results in the order its accesses were
+	//queued, so merging by shard_of[] restores trace order
+	for (unsigned k = 0; k < n_shards; k++) {
+		pop_all(&sim->shards[k].out, &sim->collected[k*SHARDED_MAX_BATCH],
+		        sizeof(CacheResult), sim->n_staged[k]);
+	}
+	size_t cursors[n_shards];
+	memset(cursors, 0, sizeof(cursors));
+	for (size_t i = 0; i < n; i++) {
+		unsigned k = sim->shard_of[i];
+		results[i] = sim->collected[k*SHARDED_MAX_BATCH + cursors[k]++];
+	}
+}
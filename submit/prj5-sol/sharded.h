@@ -0,0 +1,55 @@
+#ifndef SHARDED_H_
+#define SHARDED_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Parallel simulation of a single cache: since the sets of a cache
+ *  never interact, accesses are partitioned by set index over worker
+ *  threads, each of which simulates the sets of its shard with its
+ *  own CacheSim.  Accesses reach workers through fixed-size SPSC
+ *  rings.  Only deterministic replacement (not RANDOM_R or BRRIP_R)
+ *  without prefetching is supported, for which the results are
+ *  identical to a serial simulation.
+ */
+typedef struct ShardedSimImpl ShardedSim;
+
+/** Maximum # of accesses which may be passed to one
+ *  sharded_sim_results() call.
+ */
+enum { SHARDED_MAX_BATCH = 4096 };
+
+/** Return a new sharded simulation of a cache with parameters *params
+ *  using n_threads worker threads.  If want_results is false, results
+ *  are only counted, not returned.  Returns NULL if params->replacement
+ *  is not deterministic, params->prefetch is not NO_PF or
+ *  new_cache_sim() rejects params.
+ */
+ShardedSim *new_sharded_sim(const CacheParams *params, unsigned n_threads,
+                            bool want_results);
+
+/** Simulate n <= SHARDED_MAX_BATCH accesses as cache_sim_results().
+ *  If the simulation was created with want_results, wait for and set
+ *  results[] in access order; otherwise results is ignored and the
+ *  call returns as soon as the accesses are queued.
+ */
+void sharded_sim_results(ShardedSim *sim, size_t n,
+                         const MemAddr access_addrs[], const bool is_writes[],
+                         CacheResult results[]);
+
+/** Wait for all queued accesses to be simulated and stop the workers.
+ *  Set stats[status] to the # of accesses with each CacheStatus and
+ *  stats[CACHE_N_STATUS] to the # of dirty replacements, summed over
+ *  all shards.  No accesses may be simulated after this call.
+ */
+void sharded_sim_finish(ShardedSim *sim, unsigned long stats[CACHE_N_STATUS + 1]);
+
+/** Return the # of bytes of memory used by the caches of all shards */
+size_t sharded_sim_memory_size(const ShardedSim *sim);
+
+/** Free all resources used by *sim; finishes it if necessary */
+void free_sharded_sim(ShardedSim *sim);
+
+#endif //ifndef SHARDED_H_
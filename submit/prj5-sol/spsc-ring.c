@@ -0,0 +1,79 @@
+#include "spsc-ring.h"
+#include "memalloc.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+void
+init_spsc_ring(SpscRing *ring, size_t capacity, size_t item_size)
+{
+	assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	ring->cached_tail = ring->cached_head = 0;
+	ring->capacity = capacity;
+	ring->item_size = item_size;
+	ring->items = malloc_chk(capacity * item_size);
+}
+
+void
+destroy_spsc_ring(SpscRing *ring)
+{
+	free(ring->items);
+	ring->items = NULL;
+}
+
+/** Copy n items between the ring slots starting at index and buf,
+ *  splitting the copy where the slots wrap around.
+ */
+static void
+copy_slots(SpscRing *ring, size_t index, void *buf, size_t n, bool is_in)
+{
+	size_t size = ring->item_size;
+	size_t start = index & (ring->capacity - 1);
+	size_t n1 = (n < ring->capacity - start) ? n : ring->capacity - start;
+	unsigned char *slots = ring->items;
+	unsigned char *p = buf;
+	if (is_in) {
+		memcpy(&slots[start * size], p, n1 * size);
+		memcpy(slots, &p[n1 * size], (n - n1) * size);
+	}
+	else {
+		memcpy(p, &slots[start * size], n1 * size);
+		memcpy(&p[n1 * size], slots, (n - n1) * size);
+	}
+}
+
+size_t
+spsc_ring_push(SpscRing *ring, const void *items, size_t n)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t space = ring->capacity - (head - ring->cached_tail);
+	if (space < n) {
+		ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+		space = ring->capacity - (head - ring->cached_tail);
+	}
+	if (n > space) n = space;
+	if (n == 0) return 0;
+	copy_slots(ring, head, (void *)items, n, true);
+	atomic_store_explicit(&ring->head, head + n, memory_order_release);
+	return n;
+}
+
+size_t
+spsc_ring_pop(SpscRing *ring, void *items, size_t max)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t avail = ring->cached_head - tail;
+	if (avail < max) {
+		ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		avail = ring->cached_head - tail;
+	}
+	size_t n = (max < avail) ? max : avail;
+	if (n == 0) return 0;
+	copy_slots(ring, tail, items, n, false);
+	atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+	return n;
+}
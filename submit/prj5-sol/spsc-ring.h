@@ -0,0 +1,45 @@
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+enum { SPSC_CACHE_LINE = 64 };
+
+/** A fixed-capacity single-producer single-consumer ring of fixed-size
+ *  items.  The producer owns head, the consumer owns tail; each side
+ *  caches the other side's index so that the shared index is only
+ *  re-read when the ring looks full (producer) or empty (consumer).
+ *  Indexes increase without bound and are reduced mod capacity,
+ *  which must be a power of 2.
+ */
+typedef struct {
+  alignas(SPSC_CACHE_LINE) _Atomic size_t head;  // next slot to write
+  size_t cached_tail;                           // producer's view of tail
+  alignas(SPSC_CACHE_LINE) _Atomic size_t tail;  // next slot to read
+  size_t cached_head;                           // consumer's view of head
+  alignas(SPSC_CACHE_LINE) size_t capacity;
+  size_t item_size;
+  unsigned char *items;
+} SpscRing;
+
+/** Initialize *ring for capacity items of item_size bytes each;
+ *  capacity must be a power of 2.
+ */
+void init_spsc_ring(SpscRing *ring, size_t capacity, size_t item_size);
+
+/** Free the storage of *ring (but not ring itself) */
+void destroy_spsc_ring(SpscRing *ring);
+
+/** Producer: copy up to n items from items into ring without
+ *  blocking.  Returns the # of items pushed.
+ */
+size_t spsc_ring_push(SpscRing *ring, const void *items, size_t n);
+
+/** Consumer: copy up to max items from ring into items without
+ *  blocking.  Returns the # of items popped.
+ */
+size_t spsc_ring_pop(SpscRing *ring, void *items, size_t max);
+
+#endif //ifndef SPSC_RING_H_
@@ -0,0 +1,189 @@
+#include "sweep.h"
+#include "memalloc.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************************** Type Definitions  **************************/
+
+/** LRU stacks for all sets of one (s, b) combination.  The stack of
+ *  set i holds the depths[i] most recently used distinct blocks in
+ *  blocks[i*max_ways ..], most recent first; only the max_ways most
+ *  recent blocks are kept since deeper blocks miss in every swept
+ *  cache.  Bit j of dirty[] for a stack entry is set iff that block
+ *  is dirty in the cache with ways[j] lines per set.
+ */
+typedef struct {
+	unsigned set_bits;
+	unsigned blk_bits;
+	MemAddr *blocks;
+	uint64_t *dirty;
+	unsigned *depths;
+	unsigned long *hit_hist;     // [d]: # of hits at stack depth d
+	unsigned long *cold_hist;    // [n]: # of misses on stacks of size n
+	unsigned long dirty_evicts[SWEEP_MAX_VALUES];
+	unsigned long n_accesses;
+} StackModel;
+
+struct SweepImpl {
+	SweepParams params;
+	unsigned max_ways;
+	uint64_t all_ways_mask;
+	uint64_t *deeper_masks;      // [d]: bit j set iff ways[j] > d
+	unsigned n_models;
+	//[i*n_blk_bits_values + k]: set_bits[i], blk_bits[k]
+	StackModel *models;
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+Sweep *
+new_sweep(const SweepParams *params)
+{
+	assert(params->n_ways_values <= SWEEP_MAX_VALUES);
+	Sweep *sweep = malloc_chk(sizeof(Sweep));
+	sweep->params = *params;
+
+	unsigned max_ways = 0;
+	for (unsigned j = 0; j < params->n_ways_values; j++) {
+		if (params->ways[j] > max_ways) max_ways = params->ways[j];
+	}
+	sweep->max_ways = max_ways;
+	sweep->all_ways_mask = (params->n_ways_values == 64)
+		? ~(uint64_t)0
+		: ((uint64_t)1 << params->n_ways_values) - 1;
+	sweep->deeper_masks = calloc_chk(max_ways, sizeof(uint64_t));
+	for (unsigned d = 0; d < max_ways; d++) {
+		for (unsigned j = 0; j < params->n_ways_values; j++) {
+			if (params->ways[j] > d) sweep->deeper_masks[d] |= (uint64_t)1 << j;
+		}
+	}
+
+	sweep->n_models = params->n_set_bits_values * params->n_blk_bits_values;
+	sweep->models = calloc_chk(sweep->n_models, sizeof(StackModel));
+	for (unsigned i = 0; i < params->n_set_bits_values; i++) {
+		for (unsigned k = 0; k < params->n_blk_bits_values; k++) {
+			StackModel *model = &sweep->models[i*params->n_blk_bits_values + k];
+			size_t n_sets = (size_t)1 << params->set_bits[i];
+			model->set_bits = params->set_bits[i];
+			model->blk_bits = params->blk_bits[k];
+			model->blocks = calloc_chk(n_sets * max_ways, sizeof(MemAddr));
+			model->dirty = calloc_chk(n_sets * max_ways, sizeof(uint64_t));
+			model->depths = calloc_chk(n_sets, sizeof(unsigned));
+			model->hit_hist = calloc_chk(max_ways, sizeof(unsigned long));
+			model->cold_hist = calloc_chk(max_ways + 1, sizeof(unsigned long));
+		}
+	}
+	return sweep;
+}
+
+void
+free_sweep(Sweep *sweep)
+{
+	if (!sweep) return;
+	for (unsigned m = 0; m < sweep->n_models; m++) {
+		StackModel *model = &sweep->models[m];
+		free(model->blocks);
+		free(model->dirty);
+		free(model->depths);
+		free(model->hit_hist);
+		free(model->cold_hist);
+	}
+	free(sweep->models);
+	free(sweep->deeper_masks);
+	free(sweep);
+}
+
+/************************* Simulation Routines *************************/
+
+static inline void
+stack_access(const Sweep *sweep, StackModel *model, MemAddr addr, bool is_write)
+{
+	unsigned max_ways = sweep->max_ways;
+	MemAddr block = addr >> model->blk_bits;
+	size_t set_idx = block & (((size_t)1 << model->set_bits) - 1);
+	MemAddr *blocks = &model->blocks[set_idx * max_ways];
+	uint64_t *dirty = &model->dirty[set_idx * max_ways];
+	unsigned depth = model->depths[set_idx];
+
+	unsigned d;
+	for (d = 0; d < depth && blocks[d] != block; d++) {
+		//linear search down the LRU stack
+	}
+
+	uint64_t new_dirty;
+	unsigned n_pushed;   // # of entries pushed one deeper
+	if (d < depth) {
+		model->hit_hist[d]++;
+		new_dirty = is_write
+			? sweep->all_ways_mask
+			: dirty[d] & sweep->deeper_masks[d];
+		n_pushed = d;
+	}
+	else {
+		model->cold_hist[depth]++;
+		new_dirty = is_write ? sweep->all_ways_mask : 0;
+		n_pushed = depth;
+		if (depth < max_ways) model->depths[set_idx] = depth + 1;
+	}
+
+	//the entry at depth E - 1 pushed to depth E is the block evicted
+	//from the cache with E lines per set
+	for (unsigned j = 0; j < sweep->params.n_ways_values; j++) {
+		unsigned k = sweep->params.ways[j] - 1;
+		if (k < n_pushed && ((dirty[k] >> j) & 1)) model->dirty_evicts[j]++;
+	}
+
+	if (n_pushed == max_ways) n_pushed--;   //deepest entry falls off
+	memmove(&blocks[1], &blocks[0], n_pushed * sizeof(MemAddr));
+	memmove(&dirty[1], &dirty[0], n_pushed * sizeof(uint64_t));
+	blocks[0] = block;
+	dirty[0] = new_dirty;
+	model->n_accesses++;
+}
+
+void
+sweep_accesses(Sweep *sweep, size_t n,
+               const MemAddr access_addrs[], const bool is_writes[])
+{
+	for (unsigned m = 0; m < sweep->n_models; m++) {
+		StackModel *model = &sweep->models[m];
+		for (size_t i = 0; i < n; i++) {
+			stack_access(sweep, model, access_addrs[i], is_writes[i]);
+		}
+	}
+}
+
+static int
+find_value(const unsigned values[], unsigned n_values, unsigned value)
+{
+	for (unsigned i = 0; i < n_values; i++) {
+		if (values[i] == value) return i;
+	}
+	return -1;
+}
+
+void
+sweep_stats(const Sweep *sweep, unsigned set_bits, unsigned blk_bits,
+            unsigned ways, unsigned long stats[CACHE_N_STATUS + 1])
+{
+	const SweepParams *params = &sweep->params;
+	int i = find_value(params->set_bits, params->n_set_bits_values, set_bits);
+	int k = find_value(params->blk_bits, params->n_blk_bits_values, blk_bits);
+	int j = find_value(params->ways, params->n_ways_values, ways);
+	assert(i >= 0 && k >= 0 && j >= 0);
+	const StackModel *model = &sweep->models[i*params->n_blk_bits_values + k];
+
+	unsigned long n_hits = 0, n_no_replace = 0;
+	for (unsigned d = 0; d < ways; d++) {
+		n_hits += model->hit_hist[d];
+		n_no_replace += model->cold_hist[d];
+	}
+	stats[CACHE_HIT] = n_hits;
+	stats[CACHE_MISS_WITHOUT_REPLACE] = n_no_replace;
+	stats[CACHE_MISS_WITH_REPLACE] = model->n_accesses - n_hits - n_no_replace;
+	stats[CACHE_N_STATUS] = model->dirty_evicts[j];
+}
@@ -0,0 +1,55 @@
+#ifndef SWEEP_H_
+#define SWEEP_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** Simulates LRU caches for every combination of a set of set-index
+ *  bits, block-offset bits and associativities in a single pass over
+ *  a trace, using Mattson stack-distance simulation: for each (s, b)
+ *  combination, each set keeps its blocks ordered by recency, and an
+ *  access at stack depth d hits in exactly those caches with E > d.
+ */
+typedef struct SweepImpl Sweep;
+
+enum { SWEEP_MAX_VALUES = 64 };
+
+/** Values to sweep over.  Each array must contain distinct values;
+ *  every combination must satisfy the CacheParams constraints.
+ */
+typedef struct {
+  unsigned n_mem_addr_bits;
+  unsigned n_set_bits_values;
+  unsigned set_bits[SWEEP_MAX_VALUES];
+  unsigned n_blk_bits_values;
+  unsigned blk_bits[SWEEP_MAX_VALUES];
+  unsigned n_ways_values;
+  unsigned ways[SWEEP_MAX_VALUES];
+} SweepParams;
+
+/** Return a new sweep over *params; *params need not remain valid
+ *  after this call.
+ */
+Sweep *new_sweep(const SweepParams *params);
+
+/** Free all resources used by *sweep */
+void free_sweep(Sweep *sweep);
+
+/** Simulate n accesses to access_addrs[] (writes where is_writes[])
+ *  for every swept cache configuration.
+ */
+void sweep_accesses(Sweep *sweep, size_t n,
+                    const MemAddr access_addrs[], const bool is_writes[]);
+
+/** Set stats[] to the counts for the LRU cache with set-index bits
+ *  set_bits, block-offset bits blk_bits and ways lines per set, all
+ *  of which must be among the swept values: stats[status] counts the
+ *  accesses with each CacheStatus and stats[CACHE_N_STATUS] the dirty
+ *  evictions, exactly as separate cache_sim_result() runs would.
+ */
+void sweep_stats(const Sweep *sweep, unsigned set_bits, unsigned blk_bits,
+                 unsigned ways, unsigned long stats[CACHE_N_STATUS + 1]);
+
+#endif //ifndef SWEEP_H_
@@ -0,0 +1,170 @@
+#include "tlb.h"
+#include "hash-map.h"
+#include "memalloc.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/************************** Type Definitions  **************************/
+
+/** The TLB itself is a CacheSim whose blocks are pages.  tables maps
+ *  (prefix << 3) | level, where prefix is the VPN bits above those
+ *  indexing the level, to the # of the table in walk order.
+ */
+struct TlbImpl {
+	unsigned n_mem_addr_bits;
+	unsigned page_bits;
+	unsigned n_levels;
+	CacheSim *entries;
+	HashMap *tables;
+	TlbStats stats;
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+Tlb *
+new_tlb(const TlbParams *params, unsigned n_mem_addr_bits)
+{
+	unsigned n_ways = params->n_ways;
+	if (n_ways == 0 || params->n_entries % n_ways != 0) return NULL;
+	unsigned n_sets = params->n_entries / n_ways;
+	if (n_sets == 0 || (n_sets & (n_sets - 1)) != 0) return NULL;
+	unsigned set_bits = __builtin_ctz(n_sets);
+	if (params->page_bits + set_bits >= n_mem_addr_bits) return NULL;
+	unsigned vpn_bits = n_mem_addr_bits - params->page_bits;
+	unsigned n_levels = (vpn_bits + TLB_LEVEL_BITS - 1) / TLB_LEVEL_BITS;
+	if (n_levels > TLB_MAX_LEVELS) return NULL;
+
+	CacheParams entry_params = {
+		.n_mem_addr_bits = n_mem_addr_bits,
+		.n_set_index_bits = set_bits,
+		.n_blk_offset_bits = params->page_bits,
+		.n_lines_per_set = n_ways,
+		.replacement = LRU_R,
+	};
+	CacheSim *entries = new_cache_sim(&entry_params);
+	if (!entries) return NULL;
+	Tlb *tlb = calloc_chk(1, sizeof(Tlb));
+	tlb->n_mem_addr_bits = n_mem_addr_bits;
+	tlb->page_bits = params->page_bits;
+	tlb->n_levels = n_levels;
+	tlb->entries = entries;
+	tlb->tables = new_hash_map(64);
+	return tlb;
+}
+
+void
+free_tlb(Tlb *tlb)
+{
+	if (!tlb) return;
+	free_cache_sim(tlb->entries);
+	free_hash_map(tlb->tables);
+	free(tlb);
+}
+
+unsigned
+tlb_n_levels(const Tlb *tlb)
+{
+	return tlb->n_levels;
+}
+
+size_t
+tlb_memory_size(const Tlb *tlb)
+{
+	return sizeof(Tlb) + cache_sim_memory_size(tlb->entries);
+}
+
+/**************************** Translation ******************************/
+
+/** Return the address of table # k */
+static MemAddr
+table_addr(const Tlb *tlb, unsigned long k)
+{
+	MemAddr top = (tlb->n_mem_addr_bits < 8*sizeof(MemAddr))
+		? (MemAddr)1 << tlb->n_mem_addr_bits
+		: 0;
+	MemAddr addr = top - ((MemAddr)(k + 1) << TLB_TABLE_BITS);
+	//wrap if the tables outgrow the address space
+	return (tlb->n_mem_addr_bits < 8*sizeof(MemAddr))
+		? addr & (top - 1)
+		: addr;
+}
+
+/** Set pte_addrs[] to the addresses of the entries read, from the
+ *  root down, by a walk for addr, returning their #.
+ */
+static unsigned
+page_walk(Tlb *tlb, MemAddr addr, MemAddr pte_addrs[])
+{
+	MemAddr vpn = addr >> tlb->page_bits;
+	for (unsigned level = 0; level < tlb->n_levels; level++) {
+		unsigned shift = (tlb->n_levels - 1 - level) * TLB_LEVEL_BITS;
+		MemAddr prefix = (shift + TLB_LEVEL_BITS < 8*sizeof(MemAddr))
+			? vpn >> (shift + TLB_LEVEL_BITS)
+			: 0;
+		bool is_new;
+		unsigned long *k =
+			hash_map_put(tlb->tables, (prefix << 3) | level, &is_new);
+		if (is_new) *k = hash_map_size(tlb->tables) - 1;
+		unsigned index = (vpn >> shift) & ((1U << TLB_LEVEL_BITS) - 1);
+		pte_addrs[level] = table_addr(tlb, *k) + index * TLB_PTE_SIZE;
+	}
+	return tlb->n_levels;
+}
+
+void
+tlb_cache_sim_results(Tlb *tlb, CacheSim *cache, size_t n,
+                      const MemAddr access_addrs[], const bool is_writes[],
+                      CacheResult results[])
+{
+	//accesses and their walks are simulated in chunks, with
+	//result_index[k] the index in results[] for chunk access k, or
+	//NO_RESULT for a walk read
+	enum { CHUNK_SIZE = 1024 };
+	static const size_t NO_RESULT = SIZE_MAX;
+	MemAddr addrs[CHUNK_SIZE];
+	bool writes[CHUNK_SIZE];
+	size_t result_index[CHUNK_SIZE];
+	CacheResult chunk_results[CHUNK_SIZE];
+	size_t i = 0;
+	while (i < n) {
+		size_t k = 0;
+		for (; i < n && k + tlb->n_levels + 1 <= CHUNK_SIZE; i++) {
+			tlb->stats.accesses++;
+			CacheResult entry =
+				cache_sim_result(tlb->entries, access_addrs[i], false);
+			if (entry.status == CACHE_HIT) {
+				tlb->stats.hits++;
+			}
+			else {
+				tlb->stats.misses++;
+				unsigned n_reads = page_walk(tlb, access_addrs[i], &addrs[k]);
+				for (unsigned j = 0; j < n_reads; j++, k++) {
+					writes[k] = false;
+					result_index[k] = NO_RESULT;
+				}
+			}
+			addrs[k] = access_addrs[i];
+			writes[k] = is_writes[i];
+			result_index[k] = i;
+			k++;
+		}
+		cache_sim_results(cache, k, addrs, writes, chunk_results);
+		for (size_t j = 0; j < k; j++) {
+			if (result_index[j] != NO_RESULT) {
+				results[result_index[j]] = chunk_results[j];
+			}
+			else {
+				tlb->stats.walk_reads++;
+				tlb->stats.walk_misses += chunk_results[j].status != CACHE_HIT;
+			}
+		}
+	}
+}
+
+void
+tlb_stats(const Tlb *tlb, TlbStats *stats)
+{
+	*stats = tlb->stats;
+}
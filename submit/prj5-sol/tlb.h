@@ -0,0 +1,71 @@
+#ifndef TLB_H_
+#define TLB_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** A set-associative LRU TLB in front of a data cache, with a radix
+ *  page table walked on every TLB miss.  Each page-table level is
+ *  indexed by TLB_LEVEL_BITS bits of the virtual page number, so an
+ *  m-bit address space has ceil((m - page_bits)/TLB_LEVEL_BITS)
+ *  levels.  Each table is a page of TLB_PTE_SIZE-byte entries; tables
+ *  are placed downward from the top of the m-bit address space in the
+ *  order they are first walked, and a walk reads one entry per level
+ *  through the data cache.  Data addresses are not translated: they
+ *  are used unchanged as physical addresses.
+ */
+typedef struct TlbImpl Tlb;
+
+enum {
+  TLB_LEVEL_BITS = 9,
+  TLB_PTE_SIZE = 8,
+  TLB_TABLE_BITS = 12,          // each table is 2**this bytes
+  TLB_MAX_LEVELS = 8,
+};
+
+typedef struct {
+  unsigned n_entries;
+  unsigned n_ways;              // n_entries/n_ways must be a power of 2
+  unsigned page_bits;           // 12 for 4K pages, 21 for 2M pages
+} TlbParams;
+
+typedef struct {
+  unsigned long accesses;
+  unsigned long hits;
+  unsigned long misses;         // each causes a page walk
+  unsigned long walk_reads;     // page-table entries read by walks
+  unsigned long walk_misses;    // walk reads which missed the data cache
+} TlbStats;
+
+/** Return a new TLB with parameters *params for an address space of
+ *  n_mem_addr_bits bits.  Returns NULL if the TLB's sets and pages do
+ *  not fit in the address space or it needs more than TLB_MAX_LEVELS
+ *  page-table levels.
+ */
+Tlb *new_tlb(const TlbParams *params, unsigned n_mem_addr_bits);
+
+/** Free all resources used by *tlb */
+void free_tlb(Tlb *tlb);
+
+/** Return the # of page-table levels walked on a TLB miss */
+unsigned tlb_n_levels(const Tlb *tlb);
+
+/** Return the # of bytes of memory used by tlb, excluding its
+ *  page-table index, which grows with the # of tables walked.
+ */
+size_t tlb_memory_size(const Tlb *tlb);
+
+/** Like cache_sim_results(), but each access is first looked up in
+ *  tlb and, on a TLB miss, preceded in cache by the reads of its page
+ *  walk.  results[] only holds the results of the n accesses.
+ */
+void tlb_cache_sim_results(Tlb *tlb, CacheSim *cache, size_t n,
+                           const MemAddr access_addrs[],
+                           const bool is_writes[], CacheResult results[]);
+
+/** Set *stats to the counts for tlb */
+void tlb_stats(const Tlb *tlb, TlbStats *stats);
+
+#endif //ifndef TLB_H_
@@ -0,0 +1,85 @@
+#include "trace.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void
+usage(const char *program, const char *msg)
+{
+  fprintf(stderr, "%susage: %s m\n"
+          "       %s -d BINARY_TRACE\n"
+          "first form converts a text trace on stdin for m-bit addresses\n"
+          "to a binary trace on stdout; second form converts BINARY_TRACE\n"
+          "back to a text trace on stdout\n",
+          msg, program, program);
+  exit(1);
+}
+
+enum { BATCH_SIZE = 4096 };
+
+static void
+text_to_binary(unsigned n_addr_bits, FILE *in, FILE *out)
+{
+  MemAddr addrs[BATCH_SIZE];
+  bool is_writes[BATCH_SIZE];
+  TraceReader *reader = open_text_trace(in);
+  TraceWriter *writer = new_trace_writer(out, n_addr_bits);
+  size_t n;
+  do {
+    n = trace_read(reader, BATCH_SIZE, addrs, is_writes);
+    for (size_t i = 0; i < n; i++) {
+      trace_write(writer, addrs[i], is_writes[i]);
+    }
+  } while (n == BATCH_SIZE);
+  close_trace(reader);
+  if (!free_trace_writer(writer)) {
+    fprintf(stderr, "error writing binary trace: %s\n", strerror(errno));
+    exit(1);
+  }
+}
+
+static void
+binary_to_text(const char *path, FILE *out)
+{
+  MemAddr addrs[BATCH_SIZE];
+  bool is_writes[BATCH_SIZE];
+  TraceReader *reader = open_binary_trace(path);
+  if (!reader) {
+    fprintf(stderr, "cannot read binary trace %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+  unsigned addr_width = (trace_addr_bits(reader) + 3)/4;
+  size_t n;
+  do {
+    n = trace_read(reader, BATCH_SIZE, addrs, is_writes);
+    for (size_t i = 0; i < n; i++) {
+      fprintf(out, "0x%0*lx %c\n", addr_width, addrs[i],
+              is_writes[i] ? 'w' : 'r');
+    }
+  } while (n == BATCH_SIZE);
+  close_trace(reader);
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *program = argv[0];
+  if (argc == 3 && strcmp(argv[1], "-d") == 0) {
+    binary_to_text(argv[2], stdout);
+  }
+  else if (argc == 2) {
+    char *p;
+    long n_addr_bits = strtol(argv[1], &p, 10);
+    if (*p != '\0' || n_addr_bits <= 0 || n_addr_bits > 64) {
+      usage(program, "m must be an integer in [1, 64]\n");
+    }
+    text_to_binary(n_addr_bits, stdin, stdout);
+  }
+  else {
+    usage(program, "");
+  }
+  return 0;
+}
@@ -0,0 +1,265 @@
+#include "trace-gen.h"
+#include "memalloc.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************************** Type Definitions  **************************/
+
+//program mode constants from gen-addr-trace.mjs
+enum {
+	MAX_NEAR_RANGE = 1024,
+	MAX_FAR_RANGE = 1024*64,
+	MAX_OP_LEN = 15,
+};
+
+enum { RANDOM_GRANULARITY = 4 };
+
+/** The loop variables of the test mode's triply nested loop over
+ *  sets s, tags and ways w; done once s runs past the last set.
+ */
+typedef struct {
+	unsigned long s;
+	unsigned long tag;
+	unsigned long w;
+	unsigned long offset;
+	bool done;
+} TestState;
+
+struct TraceGenImpl {
+	GenParams params;
+	uint64_t rand_state;
+	unsigned long n;            // # of accesses generated
+	//PROGRAM_G; addresses are signed since jumps may go below 0
+	long addr;
+	long near_range;
+	long far_range;
+	double log_near;
+	long *stack;
+	size_t stack_size;
+	size_t stack_capacity;
+	//STRIDE_G
+	MemAddr stride_addr;
+	TestState test;
+};
+
+/******************** Creation / Destruction Routines ******************/
+
+void
+default_gen_params(GenMode mode, GenParams *params)
+{
+	*params = (GenParams) {
+		.mode = mode,
+		.len = 100,
+		.lo_addr = 0x1000,
+		.mem = 64*1024,
+		.seed = 0,
+		.write_prob = (mode == STRIDE_G) ? 0.4 : 0.2,
+		.jump_prob = 0.1,
+		.call_prob = 0.04,
+		.stride = 4,
+		.blk = 4,
+		.set = 4,
+		.ways = 2,
+	};
+}
+
+TraceGen *
+new_trace_gen(const GenParams *params)
+{
+	if (params->mode != TEST_G && params->lo_addr > params->mem) return NULL;
+	TraceGen *gen = calloc_chk(1, sizeof(TraceGen));
+	gen->params = *params;
+	gen->rand_state = params->seed;
+	long range = params->mem - params->lo_addr;
+	gen->near_range = range/1000;
+	if (gen->near_range > MAX_NEAR_RANGE) gen->near_range = MAX_NEAR_RANGE;
+	//log10(0) is -infinity in the original; jump by at most 1 instead
+	gen->log_near = (gen->near_range > 0) ? trunc(log10(gen->near_range)) : 0;
+	gen->far_range = range/100;
+	if (gen->far_range > MAX_FAR_RANGE) gen->far_range = MAX_FAR_RANGE;
+	gen->addr = params->lo_addr + range/2;
+	gen->stride_addr = params->lo_addr;
+	gen->test.done = params->set >= 8*sizeof(MemAddr) || params->ways == 0;
+	return gen;
+}
+
+void
+free_trace_gen(TraceGen *gen)
+{
+	if (!gen) return;
+	free(gen->stack);
+	free(gen);
+}
+
+/************************** Random Numbers *****************************/
+
+/** splitmix64: every seed, including 0, gives a full-period stream */
+static uint64_t
+next_rand(TraceGen *gen)
+{
+	uint64_t z = (gen->rand_state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/** Return a double uniformly distributed in [0, 1) */
+static double
+rand_unit(TraceGen *gen)
+{
+	return (next_rand(gen) >> 11) * 0x1.0p-53;
+}
+
+/** Return trunc(lo + u*(hi - lo)) for u uniform in [0, 1) */
+static long
+rand_range(TraceGen *gen, double lo, double hi)
+{
+	return (long)trunc(lo + rand_unit(gen)*(hi - lo));
+}
+
+/*************************** Program Trace *****************************/
+
+static void
+push_return(TraceGen *gen, long addr)
+{
+	if (gen->stack_size == gen->stack_capacity) {
+		size_t capacity = gen->stack_capacity ? 2*gen->stack_capacity : 64;
+		long *stack = malloc_chk(capacity * sizeof(long));
+		if (gen->stack_size > 0) {
+			memcpy(stack, gen->stack, gen->stack_size * sizeof(long));
+		}
+		free(gen->stack);
+		gen->stack = stack;
+		gen->stack_capacity = capacity;
+	}
+	gen->stack[gen->stack_size++] = addr;
+}
+
+static long
+next_program_addr(TraceGen *gen, long addr)
+{
+	if (rand_unit(gen) < gen->params.jump_prob) {
+		//use log's to make close jumps more likely than far jumps
+		double r = rand_unit(gen)*(gen->log_near - 2) + 2;
+		long offset = rand_range(gen, pow(10, r - 1), pow(10, r));
+		if (offset > gen->near_range) offset = gen->near_range;
+		return (rand_unit(gen) < 0.3) ? addr + offset : addr - offset;
+	}
+	if (rand_unit(gen) < gen->params.call_prob) {
+		if (gen->stack_size == 0 || rand_unit(gen) < 0.5) {
+			push_return(gen, addr + 1 + rand_range(gen, 0, MAX_OP_LEN));
+			long call_offset = rand_range(gen, 0, gen->far_range);
+			return (rand_unit(gen) < 0.5) ? addr + call_offset : addr - call_offset;
+		}
+		else {
+			return gen->stack[--gen->stack_size];
+		}
+	}
+	return addr + 1 + rand_range(gen, 0, MAX_OP_LEN);
+}
+
+static void
+program_access(TraceGen *gen, MemAddr *addr, bool *is_write)
+{
+	long lo = gen->params.lo_addr, hi = gen->params.mem;
+	long next = next_program_addr(gen, gen->addr);
+	if (next < lo || next > hi) next = lo + rand_range(gen, 0, 20);
+	gen->addr = next;
+	*addr = next;
+	*is_write = false;
+}
+
+/************************** Random / Stride Traces *********************/
+
+static void
+random_access(TraceGen *gen, MemAddr *addr, bool *is_write)
+{
+	const GenParams *params = &gen->params;
+	double range = (double)(params->mem - params->lo_addr)/RANDOM_GRANULARITY;
+	*addr = (MemAddr)trunc(rand_unit(gen)*range)*RANDOM_GRANULARITY
+		+ params->lo_addr;
+	*is_write = rand_unit(gen) < params->write_prob;
+}
+
+static void
+stride_access(TraceGen *gen, MemAddr *addr, bool *is_write)
+{
+	const GenParams *params = &gen->params;
+	*is_write = rand_unit(gen) < params->write_prob;
+	*addr = gen->stride_addr;
+	gen->stride_addr += params->stride;
+	if (gen->stride_addr > params->mem) gen->stride_addr = params->lo_addr;
+}
+
+/***************************** Test Trace ******************************/
+
+/** One iteration of the original's loops.  As there, reaching len
+ *  only breaks out of the innermost loop over ways, so each remaining
+ *  set and tag still yields one access; hence the trace does not
+ *  end at len.  Returns false once the loops are done.
+ */
+static bool
+test_access(TraceGen *gen, MemAddr *addr, bool *is_write)
+{
+	const GenParams *params = &gen->params;
+	TestState *t = &gen->test;
+	if (t->done) return false;
+	unsigned long s1 = (t->offset % 2 == 0) ? t->s : t->s + 1;
+	*addr = ((MemAddr)t->tag << (params->set + params->blk))
+		+ ((MemAddr)s1 << params->blk) + t->offset;
+	*is_write = t->offset % 3 == 0;
+	if (++gen->n >= params->len) {
+		t->w = params->ways;
+	}
+	else {
+		if (++t->offset >= 1UL << params->blk) t->offset = 0;
+		t->w++;
+	}
+	if (t->w >= params->ways) {
+		t->w = 0;
+		if (++t->tag >= 2UL*params->ways) {
+			t->tag = 0;
+			t->s += 2;
+			t->done = t->s >= 1UL << params->set;
+		}
+	}
+	return true;
+}
+
+/***************************** Generation ******************************/
+
+size_t
+trace_gen_read(TraceGen *gen, size_t max,
+               MemAddr access_addrs[], bool is_writes[])
+{
+	if (gen->params.mode == TEST_G) {
+		size_t i = 0;
+		while (i < max && test_access(gen, &access_addrs[i], &is_writes[i])) {
+			i++;
+		}
+		return i;
+	}
+	unsigned long n_left = gen->params.len - gen->n;
+	size_t n = (n_left < max) ? n_left : max;
+	for (size_t i = 0; i < n; i++) {
+		switch (gen->params.mode) {
+		case PROGRAM_G:
+			program_access(gen, &access_addrs[i], &is_writes[i]);
+			break;
+		case RANDOM_G:
+			random_access(gen, &access_addrs[i], &is_writes[i]);
+			break;
+		case STRIDE_G:
+			stride_access(gen, &access_addrs[i], &is_writes[i]);
+			break;
+		default:
+			break;
+		}
+	}
+	gen->n += n;
+	return n;
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_GEN_H_
+#define TRACE_GEN_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Synthetic address traces, generated in-process with the modes of
+ *  extras/gen-addr-trace.mjs but from a seeded PRNG, so that a trace
+ *  is determined by its GenParams.
+ */
+typedef struct TraceGenImpl TraceGen;
+
+typedef enum {
+  PROGRAM_G,     /** read-only instruction fetches with sequential runs,
+                     near jumps and far calls/returns */
+  RANDOM_G,      /** uniformly random word addresses */
+  STRIDE_G,      /** a constant stride through memory, wrapping */
+  TEST_G,        /** systematic set/tag/offset coverage of a cache; the
+                     same trace as gen-addr-trace.mjs */
+} GenMode;
+
+typedef struct {
+  GenMode mode;
+  unsigned long len;          // # of accesses
+  MemAddr lo_addr;            // lowest address (not used by TEST_G)
+  MemAddr mem;                // highest address (not used by TEST_G)
+  uint64_t seed;
+  double write_prob;          // RANDOM_G, STRIDE_G
+  double jump_prob;           // PROGRAM_G
+  double call_prob;           // PROGRAM_G
+  unsigned long stride;       // STRIDE_G
+  unsigned blk;               // TEST_G: # of block offset bits
+  unsigned set;               // TEST_G: # of set index bits
+  unsigned ways;              // TEST_G
+} GenParams;
+
+/** Set *params to the gen-addr-trace.mjs defaults for mode */
+void default_gen_params(GenMode mode, GenParams *params);
+
+/** Return a new generator for the trace specified by *params, NULL if
+ *  lo_addr > mem.  No requirement that *params remains valid after
+ *  this call.
+ */
+TraceGen *new_trace_gen(const GenParams *params);
+
+/** Free all resources used by *gen */
+void free_trace_gen(TraceGen *gen);
+
+/** Generate up to max accesses into access_addrs[] and is_writes[] as
+ *  for trace_read(), returning the # generated; < max only at the end
+ *  of the trace.
+ */
+size_t trace_gen_read(TraceGen *gen, size_t max,
+                      MemAddr access_addrs[], bool is_writes[]);
+
+#endif //ifndef TRACE_GEN_H_
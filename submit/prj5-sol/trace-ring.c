@@ -0,0 +1,211 @@
+#define _POSIX_C_SOURCE 200809L //for ftruncate() and nanosleep() under -std=c18
+
+#include "trace-ring.h"
+#include "memalloc.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+	RING_MAGIC = 0x47525343,   // "CSRG" in little-endian byte order
+	RING_VERSION = 1,
+	RING_LINE = 64,
+	POLL_NSECS = 50*1000,      // wait between polls of the other side
+	OPEN_POLL_NSECS = 1000*1000,
+};
+
+/************************** Type Definitions  **************************/
+
+/** The start of the shared object; the data follows it.  magic is
+ *  stored last by the producer, so the other fields are valid once it
+ *  is seen.  head and tail are the # of bytes ever written and read.
+ */
+typedef struct {
+	_Atomic uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	alignas(RING_LINE) _Atomic uint64_t head;
+	_Atomic uint32_t is_closed;
+	alignas(RING_LINE) _Atomic uint64_t tail;
+} RingControl;
+
+struct TraceRingImpl {
+	bool is_producer;
+	RingControl *control;
+	uint8_t *data;
+	size_t map_size;
+	uint64_t mask;             // size - 1
+	uint64_t cached;           // last seen index of the other side
+	MemAddr prev_addr;         // producer: last access address
+};
+
+/******************************* Helpers *******************************/
+
+static void
+pause_nsecs(long nsecs)
+{
+	struct timespec t = { .tv_sec = 0, .tv_nsec = nsecs };
+	nanosleep(&t, NULL);
+}
+
+static TraceRing *
+new_trace_ring(bool is_producer, void *map, size_t map_size, uint64_t size)
+{
+	TraceRing *ring = calloc_chk(1, sizeof(TraceRing));
+	ring->is_producer = is_producer;
+	ring->control = map;
+	ring->data = (uint8_t *)map + sizeof(RingControl);
+	ring->map_size = map_size;
+	ring->mask = size - 1;
+	return ring;
+}
+
+/****************************** Producer *******************************/
+
+TraceRing *
+create_trace_ring(const char *name, size_t size, unsigned n_addr_bits)
+{
+	if (size < TRACE_HEADER_SIZE || (size & (size - 1)) != 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = shm_open(name, O_RDWR|O_CREAT|O_EXCL, 0600);
+	if (fd < 0) return NULL;
+	size_t map_size = sizeof(RingControl) + size;
+	void *map = MAP_FAILED;
+	if (ftruncate(fd, map_size) == 0) {
+		map = mmap(NULL, map_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	int err = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		shm_unlink(name);
+		errno = err;
+		return NULL;
+	}
+	TraceRing *ring = new_trace_ring(true, map, map_size, size);
+	RingControl *control = ring->control;
+	control->version = RING_VERSION;
+	control->size = size;
+	atomic_init(&control->head, TRACE_HEADER_SIZE);
+	atomic_init(&control->is_closed, 0);
+	atomic_init(&control->tail, 0);
+	trace_encode_header(ring->data, n_addr_bits);
+	atomic_store_explicit(&control->magic, RING_MAGIC, memory_order_release);
+	return ring;
+}
+
+void
+trace_ring_write(TraceRing *ring, MemAddr access_addr, bool is_write)
+{
+	uint8_t buf[TRACE_MAX_VARINT_SIZE];
+	unsigned n = trace_encode_access(buf, &ring->prev_addr, access_addr,
+	                                 is_write);
+	RingControl *control = ring->control;
+	uint64_t head = atomic_load_explicit(&control->head, memory_order_relaxed);
+	uint64_t size = ring->mask + 1;
+	while (head + n - ring->cached > size) {
+		ring->cached = atomic_load_explicit(&control->tail, memory_order_acquire);
+		if (head + n - ring->cached > size) pause_nsecs(POLL_NSECS);
+	}
+	for (unsigned i = 0; i < n; i++) {
+		ring->data[(head + i) & ring->mask] = buf[i];
+	}
+	atomic_store_explicit(&control->head, head + n, memory_order_release);
+}
+
+/****************************** Consumer *******************************/
+
+TraceRing *
+open_trace_ring(const char *name)
+{
+	int fd;
+	while ((fd = shm_open(name, O_RDWR, 0)) < 0) {
+		if (errno != ENOENT) return NULL;
+		pause_nsecs(OPEN_POLL_NSECS);
+	}
+	shm_unlink(name);
+	//wait for the producer to size the object
+	struct stat st;
+	do {
+		if (fstat(fd, &st) < 0) {
+			int err = errno;
+			close(fd);
+			errno = err;
+			return NULL;
+		}
+		if (st.st_size == 0) pause_nsecs(OPEN_POLL_NSECS);
+	} while (st.st_size == 0);
+	size_t map_size = st.st_size;
+	void *map = (map_size > sizeof(RingControl))
+		? mmap(NULL, map_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0)
+		: MAP_FAILED;
+	int err = (map_size > sizeof(RingControl)) ? errno : EINVAL;
+	close(fd);
+	if (map == MAP_FAILED) {
+		errno = err;
+		return NULL;
+	}
+	RingControl *control = map;
+	while (atomic_load_explicit(&control->magic, memory_order_acquire) == 0) {
+		pause_nsecs(OPEN_POLL_NSECS);
+	}
+	uint64_t size = control->size;
+	uint32_t magic = atomic_load_explicit(&control->magic, memory_order_relaxed);
+	if (magic != RING_MAGIC ||
+	    control->version != RING_VERSION || size == 0 ||
+	    (size & (size - 1)) != 0 || sizeof(RingControl) + size != map_size) {
+		munmap(map, map_size);
+		errno = EINVAL;
+		return NULL;
+	}
+	return new_trace_ring(false, map, map_size, size);
+}
+
+size_t
+trace_ring_read(TraceRing *ring, void *buf, size_t max)
+{
+	RingControl *control = ring->control;
+	uint64_t tail = atomic_load_explicit(&control->tail, memory_order_relaxed);
+	while (ring->cached == tail && max > 0) {
+		//read is_closed before head so that no bytes are missed
+		bool is_closed =
+			atomic_load_explicit(&control->is_closed, memory_order_acquire);
+		ring->cached = atomic_load_explicit(&control->head, memory_order_acquire);
+		if (ring->cached != tail) break;
+		if (is_closed) return 0;
+		pause_nsecs(POLL_NSECS);
+	}
+	size_t n = ring->cached - tail;
+	if (n > max) n = max;
+	size_t start = tail & ring->mask;
+	size_t n1 = (n < ring->mask + 1 - start) ? n : ring->mask + 1 - start;
+	memcpy(buf, &ring->data[start], n1);
+	memcpy((uint8_t *)buf + n1, ring->data, n - n1);
+	atomic_store_explicit(&control->tail, tail + n, memory_order_release);
+	return n;
+}
+
+/******************************* Closing *******************************/
+
+void
+close_trace_ring(TraceRing *ring)
+{
+	if (!ring) return;
+	if (ring->is_producer) {
+		atomic_store_explicit(&ring->control->is_closed, 1, memory_order_release);
+	}
+	munmap(ring->control, ring->map_size);
+	free(ring);
+}
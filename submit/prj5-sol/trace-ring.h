@@ -0,0 +1,51 @@
+#ifndef TRACE_RING_H_
+#define TRACE_RING_H_
+
+#include "cache-sim.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/** A POSIX shared-memory ring which carries a binary trace (see
+ *  trace.h), header included, from a producer process to a consumer
+ *  process while the trace is being produced, so that a trace of a
+ *  running program can be simulated without being stored.  The shared
+ *  object holds the ring indexes followed by a power-of-2 # of bytes
+ *  of trace data.  The producer blocks while the ring is full and the
+ *  consumer while it is empty, polling the other side's index.
+ */
+typedef struct TraceRingImpl TraceRing;
+
+enum { TRACE_RING_DEFAULT_SIZE = 1 << 20 };
+
+/** Address width of a trace of a running program */
+enum { N_ADDR_BITS = 48 };  //user-space x86-64 addresses
+
+/** Producer: create the shared-memory object name ("/NAME") with
+ *  room for size bytes of trace, a power of 2, and write the header
+ *  of a trace of n_addr_bits-bit addresses to it.  Returns NULL with
+ *  errno set on error, EEXIST if name already exists.
+ */
+TraceRing *create_trace_ring(const char *name, size_t size,
+                             unsigned n_addr_bits);
+
+/** Producer: append an access to access_addr to the trace */
+void trace_ring_write(TraceRing *ring, MemAddr access_addr, bool is_write);
+
+/** Consumer: open the ring name, waiting for a producer to create
+ *  it, and remove name so that the ring goes away once both sides
+ *  close it.  Returns NULL with errno set on error, EINVAL if name is
+ *  not a trace ring.
+ */
+TraceRing *open_trace_ring(const char *name);
+
+/** Consumer: copy up to max bytes of the trace into buf, waiting
+ *  until at least 1 is available.  Returns 0 only once the producer
+ *  has closed the ring and all its bytes have been read.
+ */
+size_t trace_ring_read(TraceRing *ring, void *buf, size_t max);
+
+/** Unmap ring and free it; a producer's close ends the trace */
+void close_trace_ring(TraceRing *ring);
+
+#endif //ifndef TRACE_RING_H_
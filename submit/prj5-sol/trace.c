@@ -0,0 +1,395 @@
+#include "trace.h"
+#include "memalloc.h"
+#include "trace-ring.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char TRACE_MAGIC[4] = { 'C', 'S', 'T', 'R' };
+
+/************************** Type Definitions  **************************/
+
+struct TraceReaderImpl {
+	bool is_binary;
+	bool is_memory;
+	bool is_ring;
+	unsigned n_addr_bits;
+	//text traces
+	FILE *in;
+	char *line;
+	size_t line_size;
+	//binary traces
+	const uint8_t *map;
+	size_t map_size;
+	const uint8_t *p;      //next unread byte
+	const uint8_t *end;
+	MemAddr prev_addr;
+	//memory traces
+	const MemAddr *addrs;
+	const bool *writes;
+	size_t n_accesses;
+	size_t next;           //index of next unread access
+	//ring traces: ring_buf[ring_pos..ring_n) holds unread bytes
+	TraceRing *ring;
+	uint8_t *ring_buf;
+	size_t ring_pos;
+	size_t ring_n;
+};
+
+enum { RING_BUF_SIZE = 64*1024 };
+
+struct TraceWriterImpl {
+	FILE *out;
+	MemAddr prev_addr;
+};
+
+/**************************** Text Traces ******************************/
+
+typedef struct {
+	enum { OK_READ, SKIP_READ, ERR_READ } status;
+	MemAddr addr;
+	char rw;
+} AddrRead;
+
+static AddrRead
+parse_access(const char *line)
+{
+	AddrRead read;
+	char *p;
+	for (p = (char *)line; isspace(*p); p++) {
+		//skip space
+	}
+	if (*p == '#' || *p == '\0') { read.status = SKIP_READ; return read; }
+	if (*p != '0' || (p[1] != 'x' && p[1] != 'X')) {
+		read.status = ERR_READ; return read;
+	}
+	read.addr = strtol(line, &p, 0);
+	if (p == line) { read.status = ERR_READ; return read; }
+	char rw = 'r';
+	sscanf(p, " %c", &rw);
+	read.status = OK_READ;
+	if (rw == '#') { read.rw = 'r'; return read; }
+	if (rw != 'r' && rw != 'w') { read.status = ERR_READ; return read; };
+	read.rw = rw;
+	return read;
+}
+
+TraceReader *
+open_text_trace(FILE *in)
+{
+	TraceReader *reader = calloc_chk(1, sizeof(TraceReader));
+	reader->in = in;
+	return reader;
+}
+
+static size_t
+read_text(TraceReader *reader, size_t max,
+          MemAddr access_addrs[], bool is_writes[])
+{
+	size_t n = 0;
+	while (n < max && getline(&reader->line, &reader->line_size, reader->in) >= 0) {
+		AddrRead read = parse_access(reader->line);
+		if (read.status == ERR_READ) {
+			fprintf(stderr, "bad input; must be \"0[xX]HEX [r|w|\" (default 'r')\n");
+			continue;
+		}
+		else if (read.status == SKIP_READ) {
+			continue;
+		}
+		access_addrs[n] = read.addr;
+		is_writes[n] = read.rw == 'w';
+		n++;
+	}
+	return n;
+}
+
+/*************************** Binary Traces *****************************/
+
+TraceReader *
+open_binary_trace(const char *path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	size_t size = st.st_size;
+	if (size < TRACE_HEADER_SIZE) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	const uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int err = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		errno = err;
+		return NULL;
+	}
+	if (memcmp(map, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+	    map[4] != TRACE_VERSION) {
+		munmap((void *)map, size);
+		errno = EINVAL;
+		return NULL;
+	}
+	madvise((void *)map, size, MADV_SEQUENTIAL);
+
+	TraceReader *reader = calloc_chk(1, sizeof(TraceReader));
+	reader->is_binary = true;
+	reader->n_addr_bits = map[5];
+	reader->map = map;
+	reader->map_size = size;
+	reader->p = map + TRACE_HEADER_SIZE;
+	reader->end = map + size;
+	return reader;
+}
+
+static size_t
+read_binary(TraceReader *reader, size_t max,
+            MemAddr access_addrs[], bool is_writes[])
+{
+	const uint8_t *p = reader->p;
+	const uint8_t *end = reader->end;
+	MemAddr addr = reader->prev_addr;
+	size_t n;
+	for (n = 0; n < max && p < end; n++) {
+		//first byte holds is_write and the low 6 bits of the zigzag delta
+		uint8_t byte = *p++;
+		bool is_write = byte & 1;
+		uint64_t zz = (byte >> 1) & 0x3f;
+		unsigned shift = 6;
+		while (byte & 0x80) {
+			if (p >= end || shift >= 64) {
+				fprintf(stderr, "truncated or corrupt binary trace\n");
+				p = end;
+				goto done;
+			}
+			byte = *p++;
+			zz |= (uint64_t)(byte & 0x7f) << shift;
+			shift += 7;
+		}
+		addr += (MemAddr)((zz >> 1) ^ -(zz & 1));
+		access_addrs[n] = addr;
+		is_writes[n] = is_write;
+	}
+ done:
+	reader->p = p;
+	reader->prev_addr = addr;
+	return n;
+}
+
+/**************************** Ring Traces ******************************/
+
+/** Move the unread bytes of reader's ring buffer to its start and
+ *  append bytes from the ring, waiting for at least one.  Returns
+ *  false at the end of the trace.
+ */
+static bool
+fill_ring_buf(TraceReader *reader)
+{
+	size_t n_unread = reader->ring_n - reader->ring_pos;
+	memmove(reader->ring_buf, &reader->ring_buf[reader->ring_pos], n_unread);
+	reader->ring_pos = 0;
+	reader->ring_n = n_unread;
+	size_t n = trace_ring_read(reader->ring, &reader->ring_buf[n_unread],
+	                           RING_BUF_SIZE - n_unread);
+	reader->ring_n += n;
+	return n > 0;
+}
+
+TraceReader *
+open_ring_trace(const char *name)
+{
+	TraceRing *ring = open_trace_ring(name);
+	if (!ring) return NULL;
+	TraceReader *reader = calloc_chk(1, sizeof(TraceReader));
+	reader->is_ring = true;
+	reader->ring = ring;
+	reader->ring_buf = malloc_chk(RING_BUF_SIZE);
+	while (reader->ring_n < TRACE_HEADER_SIZE && fill_ring_buf(reader)) {
+		//read the whole header
+	}
+	const uint8_t *header = reader->ring_buf;
+	if (reader->ring_n < TRACE_HEADER_SIZE ||
+	    memcmp(header, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+	    header[4] != TRACE_VERSION) {
+		close_trace(reader);
+		errno = EINVAL;
+		return NULL;
+	}
+	reader->n_addr_bits = header[5];
+	reader->ring_pos = TRACE_HEADER_SIZE;
+	return reader;
+}
+
+/** Read accesses from the ring a buffer at a time, decoding only the
+ *  complete varints in the buffer.
+ */
+static size_t
+read_ring(TraceReader *reader, size_t max,
+          MemAddr access_addrs[], bool is_writes[])
+{
+	MemAddr addr = reader->prev_addr;
+	size_t n = 0;
+	while (n < max) {
+		//find the last byte of the next varint
+		const uint8_t *start = &reader->ring_buf[reader->ring_pos];
+		const uint8_t *end = &reader->ring_buf[reader->ring_n];
+		const uint8_t *last = start;
+		while (last < end && (*last & 0x80)) last++;
+		if (last == end) {
+			if (fill_ring_buf(reader)) continue;
+			if (start < end) fprintf(stderr, "truncated trace ring\n");
+			reader->ring_pos = reader->ring_n;
+			break;
+		}
+		if (last - start >= TRACE_MAX_VARINT_SIZE) {
+			fprintf(stderr, "corrupt trace ring\n");
+			reader->ring_pos = reader->ring_n;
+			break;
+		}
+		bool is_write = *start & 1;
+		uint64_t zz = (*start >> 1) & 0x3f;
+		unsigned shift = 6;
+		for (const uint8_t *p = start + 1; p <= last; p++) {
+			zz |= (uint64_t)(*p & 0x7f) << shift;
+			shift += 7;
+		}
+		addr += (MemAddr)((zz >> 1) ^ -(zz & 1));
+		access_addrs[n] = addr;
+		is_writes[n] = is_write;
+		n++;
+		reader->ring_pos = last + 1 - reader->ring_buf;
+	}
+	reader->prev_addr = addr;
+	return n;
+}
+
+/*************************** Memory Traces *****************************/
+
+TraceReader *
+open_memory_trace(size_t n, const MemAddr access_addrs[],
+                  const bool is_writes[])
+{
+	TraceReader *reader = calloc_chk(1, sizeof(TraceReader));
+	reader->is_memory = true;
+	reader->addrs = access_addrs;
+	reader->writes = is_writes;
+	reader->n_accesses = n;
+	return reader;
+}
+
+static size_t
+read_memory(TraceReader *reader, size_t max,
+            MemAddr access_addrs[], bool is_writes[])
+{
+	size_t n = reader->n_accesses - reader->next;
+	if (n > max) n = max;
+	memcpy(access_addrs, &reader->addrs[reader->next], n * sizeof(MemAddr));
+	memcpy(is_writes, &reader->writes[reader->next], n * sizeof(bool));
+	reader->next += n;
+	return n;
+}
+
+/************************* Reader Entry Points *************************/
+
+unsigned
+trace_addr_bits(const TraceReader *reader)
+{
+	return reader->n_addr_bits;
+}
+
+size_t
+trace_read(TraceReader *reader, size_t max,
+           MemAddr access_addrs[], bool is_writes[])
+{
+	if (reader->is_memory) {
+		return read_memory(reader, max, access_addrs, is_writes);
+	}
+	if (reader->is_ring) {
+		return read_ring(reader, max, access_addrs, is_writes);
+	}
+	return (reader->is_binary)
+		? read_binary(reader, max, access_addrs, is_writes)
+		: read_text(reader, max, access_addrs, is_writes);
+}
+
+size_t
+trace_read_all(TraceReader *reader, MemAddr **access_addrs, bool **is_writes)
+{
+	size_t capacity = 4096;
+	MemAddr *addrs = malloc_chk(capacity * sizeof(MemAddr));
+	bool *writes = malloc_chk(capacity * sizeof(bool));
+	size_t n = 0;
+	while (1) {
+		n += trace_read(reader, capacity - n, &addrs[n], &writes[n]);
+		if (n < capacity) break;
+		//full: double the arrays
+		MemAddr *new_addrs = malloc_chk(2 * capacity * sizeof(MemAddr));
+		bool *new_writes = malloc_chk(2 * capacity * sizeof(bool));
+		memcpy(new_addrs, addrs, n * sizeof(MemAddr));
+		memcpy(new_writes, writes, n * sizeof(bool));
+		free(addrs);
+		free(writes);
+		addrs = new_addrs;
+		writes = new_writes;
+		capacity *= 2;
+	}
+	*access_addrs = addrs;
+	*is_writes = writes;
+	return n;
+}
+
+void
+close_trace(TraceReader *reader)
+{
+	if (!reader) return;
+	if (reader->is_binary) munmap((void *)reader->map, reader->map_size);
+	close_trace_ring(reader->ring);
+	free(reader->ring_buf);
+	free(reader->line);
+	free(reader);
+}
+
+/**************************** Trace Writer *****************************/
+
+TraceWriter *
+new_trace_writer(FILE *out, unsigned n_addr_bits)
+{
+	TraceWriter *writer = calloc_chk(1, sizeof(TraceWriter));
+	writer->out = out;
+	uint8_t header[TRACE_HEADER_SIZE];
+	trace_encode_header(header, n_addr_bits);
+	fwrite(header, 1, sizeof(header), out);
+	return writer;
+}
+
+void
+trace_write(TraceWriter *writer, MemAddr access_addr, bool is_write)
+{
+	uint8_t buf[TRACE_MAX_VARINT_SIZE];
+	unsigned n =
+		trace_encode_access(buf, &writer->prev_addr, access_addr, is_write);
+	fwrite(buf, 1, n, writer->out);
+}
+
+bool
+free_trace_writer(TraceWriter *writer)
+{
+	bool is_ok = fflush(writer->out) == 0 && !ferror(writer->out);
+	free(writer);
+	return is_ok;
+}
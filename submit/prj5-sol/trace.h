@@ -0,0 +1,136 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "cache-sim.h"
+#include "trace-ring.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/** Address traces are read either in the text format, one
+ *  "0xHEX [r|w]" access per line with # comments, or in a compact
+ *  binary format:
+ *
+ *    header:   "CSTR", version byte TRACE_VERSION, address-width byte
+ *              (# of significant address bits), 2 zero bytes.
+ *    accesses: one unsigned LEB128 varint per access, encoding
+ *              (zigzag(addr - prev_addr) << 1) | is_write, where
+ *              prev_addr is the previous access address (initially 0)
+ *              and the subtraction is modulo 2**64.
+ *
+ *  Since the shifted value can need 65 bits, a varint may be up to
+ *  10 bytes long.
+ */
+
+enum {
+  TRACE_VERSION = 1,
+  TRACE_HEADER_SIZE = 8,
+  TRACE_MAX_VARINT_SIZE = 10,
+};
+
+/** Set header[] to the header of a binary trace of n_addr_bits-bit
+ *  addresses.
+ */
+static inline void
+trace_encode_header(uint8_t header[TRACE_HEADER_SIZE], unsigned n_addr_bits)
+{
+  memset(header, 0, TRACE_HEADER_SIZE);
+  memcpy(header, "CSTR", 4);
+  header[4] = TRACE_VERSION;
+  header[5] = n_addr_bits;
+}
+
+/** Set buf[] to the varint for an access to access_addr following one
+ *  to *prev_addr, which is updated.  Returns the # of bytes in the
+ *  varint.
+ */
+static inline unsigned
+trace_encode_access(uint8_t buf[TRACE_MAX_VARINT_SIZE], MemAddr *prev_addr,
+                    MemAddr access_addr, bool is_write)
+{
+  int64_t delta = (int64_t)(access_addr - *prev_addr);
+  uint64_t zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+  *prev_addr = access_addr;
+  unsigned n = 0;
+  uint8_t byte = is_write | (zz & 0x3f) << 1;
+  zz >>= 6;
+  while (zz) {
+    buf[n++] = byte | 0x80;
+    byte = zz & 0x7f;
+    zz >>= 7;
+  }
+  buf[n++] = byte;
+  return n;
+}
+
+/** Opaque trace reader */
+typedef struct TraceReaderImpl TraceReader;
+
+/** Return a reader for the text trace on in.  Bad lines are reported
+ *  on stderr and skipped.
+ */
+TraceReader *open_text_trace(FILE *in);
+
+/** Return a reader for the binary trace in file path, which is
+ *  mapped into memory.  Returns NULL with errno set if the file
+ *  cannot be mapped, with errno EINVAL if it is not a binary trace.
+ */
+TraceReader *open_binary_trace(const char *path);
+
+/** Return a reader for the binary trace produced into the trace ring
+ *  name (see trace-ring.h), waiting for it to be created.  Returns
+ *  NULL with errno set on error, with errno EINVAL if the ring does
+ *  not carry a binary trace.
+ */
+TraceReader *open_ring_trace(const char *name);
+
+/** Return a reader for the n accesses in access_addrs[] and
+ *  is_writes[], which must remain valid until the reader is closed.
+ */
+TraceReader *open_memory_trace(size_t n, const MemAddr access_addrs[],
+                               const bool is_writes[]);
+
+/** Return the address width recorded in a binary or ring trace; 0 for
+ *  a text or memory trace.
+ */
+unsigned trace_addr_bits(const TraceReader *reader);
+
+/** Read up to max accesses into access_addrs[] and is_writes[].
+ *  Returns the # of accesses read; < max only at the end of the
+ *  trace.
+ */
+size_t trace_read(TraceReader *reader, size_t max,
+                  MemAddr access_addrs[], bool is_writes[]);
+
+/** Read the rest of the trace into newly allocated arrays returned in
+ *  *access_addrs and *is_writes, which the caller must free.  Returns
+ *  the # of accesses read.
+ */
+size_t trace_read_all(TraceReader *reader,
+                      MemAddr **access_addrs, bool **is_writes);
+
+/** Free all resources used by *reader; does not close a text
+ *  reader's FILE.
+ */
+void close_trace(TraceReader *reader);
+
+/** Opaque binary trace writer */
+typedef struct TraceWriterImpl TraceWriter;
+
+/** Return a writer which writes a binary trace header for addresses
+ *  of n_addr_bits bits to out.
+ */
+TraceWriter *new_trace_writer(FILE *out, unsigned n_addr_bits);
+
+/** Append an access to access_addr to the trace */
+void trace_write(TraceWriter *writer, MemAddr access_addr, bool is_write);
+
+/** Flush and free *writer; does not close its FILE.  Returns false
+ *  if any write error occurred.
+ */
+bool free_trace_writer(TraceWriter *writer);
+
+#endif //ifndef TRACE_H_